@@ -14,6 +14,28 @@
 #include <linux/proc_fs.h>
 #include <linux/skbuff.h>
 #include <linux/kthread.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/spinlock.h>
+#include <linux/netdevice.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_ether.h>
+#include <linux/if_vlan.h>
+#include <linux/etherdevice.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/rculist.h>
+#include <linux/notifier.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/bitops.h>
+#include <linux/workqueue.h>
+#include <linux/capability.h>
 
 #include <net/sock.h>
 #include <net/netlink.h>
@@ -44,23 +66,130 @@ static short int recv_active = 1;
 module_param(recv_active, short, S_IRUGO|S_IWUSR);
 MODULE_PARM_DESC(recv_active, "GOOSE receiving control: 0 - no receiving");
 
-static unsigned int num_pkt_trans = 0;
-module_param(num_pkt_trans, int, S_IRUGO|S_IWUSR);
+static short int rx_tstamp = 1;
+module_param(rx_tstamp, short, S_IRUGO);
+MODULE_PARM_DESC(rx_tstamp, "Timestamp frames when they reach the host: 0 - at the module");
+
+static short int rx_ack = 0;
+module_param(rx_ack, short, S_IRUGO|S_IWUSR);
+MODULE_PARM_DESC(rx_ack, "ACK received frames asking for it: 0 - never");
+
+static int get_num_pkt_trans(char *buffer, struct kernel_param *kp);
+static int set_num_pkt_trans(const char *val, struct kernel_param *kp);
+module_param_call(num_pkt_trans, set_num_pkt_trans, get_num_pkt_trans, NULL, S_IRUGO);
 MODULE_PARM_DESC(num_pkt_trans, "Number of GOOSE messages transmitted by Enhanced Transmission");
 
+/* Statistics, per cpu and summed when read.
+ * Updates run with bh disabled, so that the softirq paths
+ * can not interleave with an update from process context.
+ */
+struct goose_stats_entry {
+	unsigned int key;                 /* ifindex or APPID + 1, 0 if unused */
+	unsigned long rx_frames, rx_bytes;
+	unsigned long tx_frames, tx_bytes;
+};
+
+struct goose_stats {
+	unsigned long rx_frames, rx_bytes;
+	unsigned long rx_drop_inactive;   /* recv_active is 0 */
+	unsigned long rx_drop_filter;     /* dropped by receiving filters */
+	unsigned long rx_drop_netlink;    /* netlink socket overflows */
+	unsigned long rx_drop_ring;       /* RX ring is full */
+	unsigned long tx_frames, tx_bytes;
+	unsigned long tx_fail;            /* dev_queue_xmit failures */
+	unsigned long tx_realloc;         /* headroom reallocations */
+	unsigned long tx_drop_mtu;        /* frames larger than the device MTU */
+	unsigned long tx_prp_copies;      /* copies of redundant frames sent on LAN B */
+	unsigned long rx_drop_prp_dup;    /* second copies of redundant frames */
+	unsigned long retrans_attempts;   /* retransmissions of reliable messages */
+	unsigned long retrans_done;       /* reliable messages completed */
+	unsigned long retrans_acked;      /* reliable messages stopped by ACKs */
+	unsigned long ack_tx, ack_rx;     /* ACKs of reliable frames */
+	unsigned long tx_pace_trips;      /* frames bypassing the pacing buckets */
+	unsigned long tx_pace_drop;       /* frames dropped by pacing overflows */
+	unsigned long pub_repeats;        /* repetitions of publications */
+	/* The last entry of each table is "other" */
+	struct goose_stats_entry dev[GOOSE_STATS_DEV_SLOTS + 1];
+	struct goose_stats_entry appid[GOOSE_STATS_APPID_SLOTS + 1];
+};
+
+static DEFINE_PER_CPU(struct goose_stats, goose_stats);
+
+#define GOOSE_STAT_ADD(field, val) do {			\
+		local_bh_disable();						\
+		__get_cpu_var(goose_stats).field += (val);	\
+		local_bh_enable();						\
+	} while (0)
+
+#define GOOSE_STAT_INC(field) GOOSE_STAT_ADD(field, 1)
+
+/* Entry of key in a per-device or per-APPID table of this cpu,
+ * bh must be disabled.
+ */
+static inline struct goose_stats_entry *goose_stats_slot(struct goose_stats_entry *tbl,
+														 unsigned int slots,
+														 unsigned int key)
+{
+	struct goose_stats_entry *e = &tbl[key & (slots - 1)];
+
+	if (e->key == 0)
+		e->key = key + 1;
+	if (e->key == key + 1)
+		return e;
+
+	tbl[slots].key = 1;
+	return &tbl[slots];
+}
+
+/* Account a received (rx != 0) or transmitted frame */
+static void goose_stats_frame(struct net_device *dev, unsigned short appid,
+							  unsigned int len, int rx)
+{
+	struct goose_stats *st;
+	struct goose_stats_entry *e_dev, *e_appid;
+
+	local_bh_disable();
+
+	st = &__get_cpu_var(goose_stats);
+	e_dev = goose_stats_slot(st->dev, GOOSE_STATS_DEV_SLOTS, dev->ifindex);
+	e_appid = goose_stats_slot(st->appid, GOOSE_STATS_APPID_SLOTS, appid);
+
+	if (rx) {
+		st->rx_frames++;
+		st->rx_bytes += len;
+		e_dev->rx_frames++;
+		e_dev->rx_bytes += len;
+		e_appid->rx_frames++;
+		e_appid->rx_bytes += len;
+	} else {
+		st->tx_frames++;
+		st->tx_bytes += len;
+		e_dev->tx_frames++;
+		e_dev->tx_bytes += len;
+		e_appid->tx_frames++;
+		e_appid->tx_bytes += len;
+	}
+
+	local_bh_enable();
+}
+
 /* proc file systems */
 static struct proc_dir_entry *proc_dir, /* dir */
 	*proc_def_dev, *proc_tran_intvl, *proc_delay_thre,
-	*proc_retran_intvl, *proc_retran_incre, *proc_max_retran_intvl; /* files */
+	*proc_retran_intvl, *proc_retran_incre, *proc_max_retran_intvl,
+	*proc_rx_batch_num, *proc_rx_batch_intvl, *proc_filter, *proc_stats,
+	*proc_vlan_tag, *proc_vlan_id, *proc_vlan_pcp,
+	*proc_prp_lan_a, *proc_prp_lan_b, *proc_profiles, *proc_pace; /* files */
 
 /* Assign default values to proc files */
 static char buf_proc_def_dev [PROC_DEF_DEV_BUFLEN] = DEFBUF_PROC_DEF_DEV;
 
 static unsigned int tran_intvl       = DEF_TRAN_INTVL;       /*  ms  */
-static unsigned int delay_thre       = DEF_DELAY_THRE;       /*  ms  */
-static unsigned int retran_intvl     = DEF_RETRAN_INTVL;     /*  ms  */
-static unsigned int retran_incre     = DEF_RETRAN_INCRE;     /*  ms  */
-static unsigned int max_retran_intvl = DEF_MAX_RETRAN_INTVL; /*  ms  */
+static unsigned int rx_batch_num     = DEF_RX_BATCH_NUM;     /* frames */
+static unsigned int rx_batch_intvl   = DEF_RX_BATCH_INTVL;   /*  us  */
+static unsigned int vlan_tag         = DEF_VLAN_TAG;         /* 0 or 1 */
+static unsigned int vlan_id          = DEF_VLAN_ID;
+static unsigned int vlan_pcp         = DEF_VLAN_PCP;
 
 /* Netlink socket */
 static struct sock *nl_sk = NULL;
@@ -71,15 +200,279 @@ static u32 user_pid = 0;
 /* Task pointer to server daemon thread */
 static struct task_struct *dmn_task = NULL;
 
-/* Default NIC to transmit */
-static struct net_device * def_dev = NULL;
+/* Headroom of a frame to transmit: link-layer header and an
+ * 802.1Q tag, so that tagging never reallocates.
+ */
+#define GOOSE_LL_SPACE(dev)  (LL_RESERVED_SPACE(dev) + VLAN_HLEN)
+
+/* Default NIC to transmit, followed by name through renames */
+static int def_ifindex = 0;
+
+/* Device registry: devices that are up, indexed by ifindex, so
+ * transmission looks a handle up without a name search or a lock.
+ * Updated by the netdevice notifier under RTNL, read under RCU.
+ * A device colliding with another one in its slot is found by
+ * dev_get_by_index instead.
+ */
+#define GOOSE_DEV_SLOTS  256   /* power of 2 */
+static struct net_device *goose_devs[GOOSE_DEV_SLOTS];
+
+/* In-flight table of GOOSE Enhanced Retransmission.
+ * Each reliable message holds one entry until its retransmission
+ * schedule finishes. The schedule is driven by a tasklet hrtimer,
+ * so the sending process never sleeps in the netlink input path.
+ * appid, seq and the ACK fields are changed under retrans_lock.
+ * A finished entry is only marked done from its timer, it is free
+ * again once the timer has been cancelled by its next user.
+ */
+struct goose_retrans_entry {
+	struct tasklet_hrtimer timer;
+	struct sk_buff *skb;              /* master copy, cloned per attempt */
+	unsigned int waiting_time;        /* us */
+	unsigned int total_waiting_time;  /* us */
+	unsigned int trans_count;
+	unsigned int delay_thre;          /* us */
+	unsigned int retran_incre;        /* us */
+	unsigned int max_retran_intvl;    /* us */
+	int in_use;
+	int done;                         /* schedule over, timer may still run */
+	unsigned short appid;             /* network order */
+	unsigned char seq;                /* goosehdr reserv2, 0 if no ACK is asked */
+	unsigned char daddr[ETH_ALEN];
+	ktime_t sent;                     /* first transmission */
+	unsigned int acks;                /* ACKs that stop the schedule, 0 for none */
+	unsigned int ack_count;
+	unsigned char ackers[GOOSE_ACK_MAX_SRC][ETH_ALEN];
+	int acked;
+};
+
+static struct goose_retrans_entry retrans_tbl[MAX_GOOSE_INFLIGHT];
+static unsigned char retrans_seq = 0;
+static DEFINE_SPINLOCK(retrans_lock);
+
+/* Round trip time to the destinations of reliable frames, taken
+ * from their ACKs (RFC 6298, without retransmitted frames), under
+ * retrans_lock. A destination colliding with another one in its
+ * slot takes it over.
+ */
+struct goose_rtt {
+	unsigned char addr[ETH_ALEN];
+	unsigned int srtt, rttvar;        /* us, srtt is 0 for no estimate */
+};
+
+static struct goose_rtt rtt_tbl[GOOSE_RTT_SLOTS];
+
+/* Coalescing of received frames.
+ * A pending message is sent to user space when it holds rx_batch_num
+ * frames, when rx_batch_intvl us elapsed since its first frame, or
+ * when the next frame does not fit.
+ */
+static struct sk_buff *rx_batch_skb = NULL;
+static unsigned int rx_batch_count = 0;
+static struct tasklet_hrtimer rx_batch_timer;
+static DEFINE_SPINLOCK(rx_batch_lock);
+
+/* Subscriptions, hashed by APPID.
+ * Readers (goose_rcv) walk the buckets under RCU, writers hold sub_lock.
+ */
+struct goose_sub {
+	struct hlist_node node;
+	struct rcu_head rcu;
+	u32 pid;                          /* netlink port of the subscriber */
+	unsigned short appid;
+	unsigned char daddr[ETH_ALEN];    /* all zero for any destination */
+};
+
+static struct hlist_head sub_hash[GOOSE_SUB_HASH_SIZE];
+static unsigned int sub_count = 0;
+static DEFINE_SPINLOCK(sub_lock);
+
+/* Receiving filters, one per device and one for all devices
+ * (ifindex 0). The list is walked under RCU; APPID and MAC bits
+ * are changed in place with atomic bit operations.
+ */
+struct goose_filter_stats {
+	unsigned long hit;                /* frames accepted */
+	unsigned long drop;               /* frames dropped */
+};
+
+struct goose_filter {
+	struct list_head list;
+	struct rcu_head rcu;
+	int ifindex;
+	char dev_name[IFNAMSIZ];
+	unsigned long appid_map[BITS_TO_LONGS(65536)];
+	unsigned char macs[GOOSE_FILTER_MAX_MAC][ETH_ALEN];
+	unsigned long mac_map;            /* bit i set: macs[i] is used */
+	struct goose_filter_stats *stats; /* per cpu */
+};
+
+static LIST_HEAD(filter_list);
+static unsigned int filter_count = 0;
+static DEFINE_MUTEX(filter_mutex);
+
+/* 802.1Q tags of APPIDs, see NL_MSG_VLAN. Changed under vlan_lock,
+ * looked up under RCU by every transmission.
+ */
+struct goose_vlan {
+	struct hlist_node node;
+	struct rcu_head rcu;
+	unsigned short appid;
+	u16 tci;
+};
+
+static struct hlist_head vlan_hash[GOOSE_VLAN_HASH_SIZE];
+static unsigned int vlan_count = 0;
+static DEFINE_SPINLOCK(vlan_lock);
+
+/* Retransmission profiles, see NL_MSG_PROFILE. A profile is never
+ * changed in place: a new copy is published under profile_lock and
+ * goose_enhan_retrans takes a snapshot of it under RCU. Profile 0
+ * starts as goose_profile_def, others are NULL until set.
+ */
+struct goose_profile {
+	struct rcu_head rcu;
+	struct goose_param_t param;
+	unsigned int acks;                /* ACKs of a multicast frame, 0 for none */
+};
+
+#define GOOSE_PROFILE_KEEP   (~0U)    /* acks of goose_profile_update */
+
+static struct goose_profile goose_profile_def = {
+	.param = {
+		.thresh      = DEF_DELAY_THRE,
+		.intvl_init  = DEF_RETRAN_INTVL,
+		.intvl_max   = DEF_MAX_RETRAN_INTVL,
+		.intvl_incre = DEF_RETRAN_INCRE
+	}
+};
+
+static struct goose_profile *profiles[GOOSE_PROFILES] = {&goose_profile_def};
+static unsigned char appid_profile[65536];  /* profile of each APPID */
+static DEFINE_SPINLOCK(profile_lock);
+
+/* TX pacing, see GOOSE_PACE_XXX. Buckets are looked up under RCU
+ * and added or removed under pace_mutex; the tokens and the queue
+ * of a bucket are under its lock. Tokens are counted in ns of
+ * transmission time: a frame takes cost of them, a full bucket
+ * holds depth (burst frames).
+ */
+struct goose_pacer {
+	struct hlist_node node;           /* APPID buckets only */
+	spinlock_t lock;
+	unsigned short appid;
+	char dev_name[IFNAMSIZ];          /* device buckets only */
+	int ifindex;
+	unsigned int rate, burst;         /* frames/s, frames */
+	u64 cost, depth, credit;          /* ns */
+	ktime_t last;
+	struct sk_buff_head queue;
+	struct tasklet_hrtimer timer;     /* sends the queue as tokens come */
+	int armed, dead;
+	int (*next)(struct sk_buff *skb); /* next bucket, or the device */
+	unsigned long sent, queued, dropped;
+};
+
+static struct goose_pacer *pace_devs[GOOSE_PACE_DEVS];
+static struct hlist_head pace_hash[GOOSE_PACE_HASH_SIZE];
+static unsigned int pace_count = 0;
+static unsigned int pace_trip_pcp = DEF_PACE_TRIP_PCP;
+static unsigned int pace_qlen = DEF_PACE_QLEN;
+static unsigned int pace_policy = DEF_PACE_POLICY;
+static DEFINE_MUTEX(pace_mutex);
+
+/* Redundant transmission, see GOOSE_PRP_XXX. The LANs are followed
+ * by name, as the default device is. [0] is LAN A, [1] LAN B.
+ */
+static char prp_lan_name[2][IFNAMSIZ];
+static int prp_ifindex[2];
+static atomic_t prp_seq = ATOMIC_INIT(0);
+
+/* Sequence numbers received from a source */
+struct goose_prp_node {
+	spinlock_t lock;
+	unsigned char saddr[ETH_ALEN];
+	u16 seq_hi;                       /* highest sequence number */
+	u64 window;                       /* bit i set: seq_hi - i is received */
+	unsigned long last;               /* jiffies, 0 if unused */
+};
+
+static struct goose_prp_node prp_nodes[GOOSE_PRP_NODES];
+
+/* Control block of a frame being transmitted */
+struct goose_skb_cb {
+	int prp;                          /* a copy goes to LAN B */
+	int first;                        /* first send, bypasses pacing */
+};
+
+#define GOOSE_SKB_CB(skb) ((struct goose_skb_cb *) (skb)->cb)
+
+/* Shared memory RX ring, NULL if /dev/goose_rx is not open */
+static struct goose_ring_hdr *rx_ring = NULL;
+static atomic_t rx_ring_users = ATOMIC_INIT(0);
+static DEFINE_SPINLOCK(rx_ring_lock);
+static DECLARE_WAIT_QUEUE_HEAD(rx_ring_wait);
+
+/* Shared memory TX ring, NULL if /dev/goose_tx is not open.
+ * A slot is copied into its skb, so it goes back to user space as
+ * soon as the kick has handed the frame to the device.
+ */
+static struct goose_ring_hdr *tx_ring = NULL;
+static unsigned int tx_ring_head = 0;
+static atomic_t tx_ring_users = ATOMIC_INIT(0);
+static DEFINE_MUTEX(tx_ring_mutex);
+
+/* Publications repeated by the module, see NL_MSG_PUBLISH.
+ * The hash is changed under pub_lock, the frame and the schedule
+ * of a publication under its own lock. Publications of a closed
+ * socket are unhashed by the notifier and freed by pub_reap_work,
+ * which can wait for their timers. The frame buffer is sized by the
+ * MTU of the device when the publication is created.
+ */
+
+struct goose_pub {
+	struct hlist_node node;
+	struct list_head reap;
+	struct tasklet_hrtimer timer;
+	spinlock_t lock;
+	int stopped;
+	u32 pid;                          /* netlink port of the publisher */
+	int ifindex;
+	unsigned short appid;
+	unsigned char daddr[ETH_ALEN];
+	unsigned int t1;                  /* ms */
+	unsigned int intvl;               /* ms, until the next repetition */
+	u32 sqnum;
+	unsigned int sq_off;              /* sqNum field in frame, 0 if none */
+	unsigned int len;                 /* goose header + APDU */
+	unsigned int size;                /* of frame */
+	unsigned char frame[0];
+};
+
+static struct hlist_head pub_hash[GOOSE_PUB_HASH_SIZE];
+static unsigned int pub_count = 0;
+static DEFINE_SPINLOCK(pub_lock);
+static LIST_HEAD(pub_reap_list);
+static void goose_pub_reap(struct work_struct *work);
+static DECLARE_WORK(pub_reap_work, goose_pub_reap);
 
 /* GOOSE kernel API */
 static int goose_rcv(struct sk_buff *skb, struct net_device *dev,
 					 struct packet_type *pt, struct net_device *orin_dev);
 static int goose_trans_skb(struct net_device *dev, unsigned char *daddr,
 						   struct sk_buff *__skb, int reliablity);
+static int goose_xmit_frame(struct net_device *dev, unsigned char *daddr,
+							struct sk_buff *skb, int reliablity, int first);
 static int goose_enhan_retrans(struct sk_buff *__skb);
+static void goose_ack_rcv(struct sk_buff *skb);
+static void goose_pace_netdev(struct net_device *dev, unsigned long event);
+static int read_pace(char *page, char **start, off_t off, int count, int *eof, void *data);
+static ssize_t write_pace(struct file *filp, const char __user *buff, unsigned long len, void *data);
+static void goose_ack_xmit(struct sk_buff *skb, struct net_device *dev);
+static int goose_dev_queue_xmit(struct sk_buff *skb);
+static struct sk_buff *goose_rcv_build_msg(struct sk_buff *skb, struct net_device *dev);
+static int goose_pub_ctrl(u32 pid, struct nlmsghdr *nlh);
+static void goose_pub_del(u32 pid);
 
 /* Define the GOOSE protocol */
 static struct packet_type goose_packet_type = {
@@ -88,6 +481,201 @@ static struct packet_type goose_packet_type = {
 	.func = goose_rcv
 };
 
+/* GOOSE frames with an 802.1Q tag */
+static int goose_vlan_rcv(struct sk_buff *skb, struct net_device *dev,
+						  struct packet_type *pt, struct net_device *orin_dev);
+static struct packet_type goose_vlan_packet_type = {
+	.type = ntohs(ETH_P_8021Q),
+	.dev = NULL,
+	.func = goose_vlan_rcv
+};
+
+/************************************************************
+ * GOOSE retransmission profiles
+ ************************************************************/
+
+static void goose_profile_free_rcu(struct rcu_head *head)
+{
+	struct goose_profile *p = container_of(head, struct goose_profile, rcu);
+
+	if (p != &goose_profile_def)
+		kfree(p);
+}
+
+/* Publish a new copy of profile id: param and acks (the current
+ * ones if GOOSE_PROFILE_KEEP), or if param is NULL, the current one
+ * with the field of struct goose_profile at offset set to value.
+ */
+static int goose_profile_update(unsigned int id, const struct goose_param_t *param,
+								unsigned int acks, size_t offset, unsigned int value)
+{
+	struct goose_profile *p, *old;
+
+	if (id >= GOOSE_PROFILES)
+		return -EINVAL;
+
+	p = kmalloc(sizeof(struct goose_profile), GFP_KERNEL);
+	if (unlikely(p == NULL))
+		return -ENOMEM;
+
+	spin_lock_bh(&profile_lock);
+	old = profiles[id];
+	if (param != NULL) {
+		p->param = *param;
+		p->acks = (acks != GOOSE_PROFILE_KEEP) ? acks : (old != NULL) ? old->acks : 0;
+	} else if (old != NULL) {
+		p->param = old->param;
+		p->acks = old->acks;
+		*(unsigned int *) ((char *) p + offset) = value;
+	} else {
+		spin_unlock_bh(&profile_lock);
+		kfree(p);
+		return -ENOENT;
+	}
+	rcu_assign_pointer(profiles[id], p);
+	spin_unlock_bh(&profile_lock);
+
+	if (old != NULL)
+		call_rcu(&old->rcu, goose_profile_free_rcu);
+	return 0;
+}
+
+/* Make the APPID follow profile id */
+static int goose_profile_map(unsigned short appid, unsigned int id)
+{
+	int ret = 0;
+
+	if (id >= GOOSE_PROFILES)
+		return -EINVAL;
+
+	spin_lock_bh(&profile_lock);
+	if (profiles[id] != NULL)
+		ACCESS_ONCE(appid_profile[appid]) = id;
+	else
+		ret = -ENOENT;
+	spin_unlock_bh(&profile_lock);
+
+	return ret;
+}
+
+/* Apply a profile message */
+static int goose_profile_ctrl(struct nl_profile_header *nl_profile_h)
+{
+	switch (nl_profile_h->op) {
+	case GOOSE_PROFILE_SET:
+		return goose_profile_update(nl_profile_h->id, &nl_profile_h->goose_param,
+									min_t(unsigned int, nl_profile_h->acks, GOOSE_ACK_MAX_SRC),
+									0, 0);
+
+	case GOOSE_PROFILE_MAP:
+		return goose_profile_map(nl_profile_h->appid, nl_profile_h->id);
+
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Snapshot of profile id, profile 0 if it is not set */
+static void goose_profile_get(unsigned int id, struct goose_param_t *param,
+							  unsigned int *acks)
+{
+	struct goose_profile *p;
+
+	rcu_read_lock();
+	p = rcu_dereference(profiles[id]);
+	if (unlikely(p == NULL))
+		p = rcu_dereference(profiles[0]);
+	*param = p->param;
+	*acks = p->acks;
+	rcu_read_unlock();
+}
+
+static inline void goose_profile_of_appid(unsigned short appid, struct goose_param_t *param,
+										  unsigned int *acks)
+{
+	goose_profile_get(ACCESS_ONCE(appid_profile[appid]), param, acks);
+}
+
+static int read_profiles(char *page, char **start, off_t off, int count, int *eof, void *data)
+{
+	struct goose_profile *p;
+	int len = 0, id, i, first;
+
+	rcu_read_lock();
+	for (id = 0; id < GOOSE_PROFILES; id++) {
+		p = rcu_dereference(profiles[id]);
+		if (p == NULL)
+			continue;
+
+		len += sprintf(page + len, "%d thresh %u init %u max %u incre %u acks %u\n  appid:",
+					   id, p->param.thresh, p->param.intvl_init,
+					   p->param.intvl_max, p->param.intvl_incre, p->acks);
+
+		/* Print APPIDs as ranges, all others follow profile 0 */
+		for (i = 0; (id != 0) && (i < 65536); i++) {
+			if (appid_profile[i] != id)
+				continue;
+			if (len > PAGE_SIZE - 128)
+				break;
+			first = i;
+			while ((i + 1 < 65536) && (appid_profile[i + 1] == id))
+				i++;
+			len += (first == i) ? sprintf(page + len, " %d", first)
+				: sprintf(page + len, " %d-%d", first, i);
+		}
+		len += sprintf(page + len, (id == 0) ? " others\n" : "\n");
+
+		if (len > PAGE_SIZE - 256)
+			break;
+	}
+	rcu_read_unlock();
+
+	*eof = 1;
+	return len;
+}
+
+/* "set <id> <thresh> <init> <max> <incre> [<acks>]" or "map <appid> <id>" */
+static ssize_t write_profiles(struct file *filp, const char __user *buff, unsigned long len, void *data)
+{
+	char buf[PROC_PROFILES_BUFLEN];
+	struct goose_param_t param;
+	unsigned int id, appid, acks = GOOSE_PROFILE_KEEP;
+	int ret = -EINVAL;
+
+	if (len > PROC_PROFILES_BUFLEN - 1)
+		return -1;
+	if (copy_from_user(buf, buff, len) > 0)
+		return -1;
+	buf[len] = 0;
+
+	if (sscanf(buf, "set %u %u %u %u %u %u", &id, &param.thresh, &param.intvl_init,
+			   &param.intvl_max, &param.intvl_incre, &acks) >= 5)
+		ret = goose_profile_update(id, &param, (acks != GOOSE_PROFILE_KEEP) ?
+								   min_t(unsigned int, acks, GOOSE_ACK_MAX_SRC) : acks, 0, 0);
+	else if ((sscanf(buf, "map %u %u", &appid, &id) == 2) && (appid < 65536))
+		ret = goose_profile_map(appid, id);
+
+	return (ret != 0) ? ret : len;
+}
+
+static void goose_profile_cleanup(void)
+{
+	struct goose_profile *p;
+	int id;
+
+	spin_lock_bh(&profile_lock);
+	for (id = 0; id < GOOSE_PROFILES; id++) {
+		p = profiles[id];
+		rcu_assign_pointer(profiles[id], (id == 0) ? &goose_profile_def : NULL);
+		if ((p != NULL) && (p != &goose_profile_def))
+			call_rcu(&p->rcu, goose_profile_free_rcu);
+	}
+	spin_unlock_bh(&profile_lock);
+
+	/* Wait for goose_profile_free_rcu callbacks */
+	rcu_barrier();
+}
+
 /************************************************************
  * proc_fs io functions: read and write
  ************************************************************/
@@ -100,24 +688,59 @@ static struct packet_type goose_packet_type = {
 #define FS_FUN_WRITE(fun_name, max_len, var_name) static ssize_t fun_name(struct file *filp, const char __user *buff, unsigned long len, void *data) \
 	{																	\
 		char temp_buf[max_len];											\
+		unsigned int value;												\
 		if (len > max_len -1)											\
 			return -1;													\
 		if (copy_from_user(temp_buf, buff, len)>0)						\
 			return -1;													\
-		sscanf(temp_buf, "%u", &var_name);								\
+		temp_buf[len] = 0;												\
+		if (sscanf(temp_buf, "%u", &value) != 1)						\
+			return -EINVAL;												\
+		ACCESS_ONCE(var_name) = value;									\
 		return len;														\
 	}																	\
 
+/* Fields of profile 0 */
+#define FS_FUN_PROFILE(read_name, write_name, max_len, field)			\
+	static int read_name(char *page, char **start, off_t off, int count, int *eof, void *data) \
+	{																	\
+		struct goose_param_t param;										\
+		unsigned int acks;												\
+		goose_profile_get(0, &param, &acks);							\
+		return sprintf(page, "%u\n", param.field);						\
+	}																	\
+	static ssize_t write_name(struct file *filp, const char __user *buff, unsigned long len, void *data) \
+	{																	\
+		char temp_buf[max_len];											\
+		unsigned int value;												\
+		int ret;														\
+		if (len > max_len -1)											\
+			return -1;													\
+		if (copy_from_user(temp_buf, buff, len)>0)						\
+			return -1;													\
+		temp_buf[len] = 0;												\
+		if (sscanf(temp_buf, "%u", &value) != 1)						\
+			return -EINVAL;												\
+		ret = goose_profile_update(0, NULL, 0, offsetof(struct goose_profile, param.field), value); \
+		return (ret != 0) ? ret : len;									\
+	}																	\
+
 FS_FUN_READ(read_tran_intvl, tran_intvl)
-FS_FUN_READ(read_retran_intvl, retran_intvl)
-FS_FUN_READ(read_retran_incre, retran_incre)
-FS_FUN_READ(read_max_retran_intvl, max_retran_intvl)
-FS_FUN_READ(read_delay_thre, delay_thre)
+FS_FUN_READ(read_rx_batch_num, rx_batch_num)
+FS_FUN_READ(read_rx_batch_intvl, rx_batch_intvl)
+FS_FUN_READ(read_vlan_tag, vlan_tag)
+FS_FUN_READ(read_vlan_id, vlan_id)
+FS_FUN_READ(read_vlan_pcp, vlan_pcp)
 FS_FUN_WRITE(write_tran_intvl, PROC_TRAN_INTVL_BUFLEN, tran_intvl)
-FS_FUN_WRITE(write_retran_intvl, PROC_RETRAN_INTVL_BUFLEN, retran_intvl)
-FS_FUN_WRITE(write_retran_incre, PROC_RETRAN_INCRE_BUFLEN, retran_incre)
-FS_FUN_WRITE(write_max_retran_intvl, PROC_MAX_RETRAN_INTVL_BUFLEN, max_retran_intvl)
-FS_FUN_WRITE(write_delay_thre, PROC_DELAY_THRE_BUFLEN, delay_thre)
+FS_FUN_WRITE(write_rx_batch_num, PROC_RX_BATCH_NUM_BUFLEN, rx_batch_num)
+FS_FUN_WRITE(write_rx_batch_intvl, PROC_RX_BATCH_INTVL_BUFLEN, rx_batch_intvl)
+FS_FUN_WRITE(write_vlan_tag, PROC_VLAN_BUFLEN, vlan_tag)
+FS_FUN_WRITE(write_vlan_id, PROC_VLAN_BUFLEN, vlan_id)
+FS_FUN_WRITE(write_vlan_pcp, PROC_VLAN_BUFLEN, vlan_pcp)
+FS_FUN_PROFILE(read_retran_intvl, write_retran_intvl, PROC_RETRAN_INTVL_BUFLEN, intvl_init)
+FS_FUN_PROFILE(read_retran_incre, write_retran_incre, PROC_RETRAN_INCRE_BUFLEN, intvl_incre)
+FS_FUN_PROFILE(read_max_retran_intvl, write_max_retran_intvl, PROC_MAX_RETRAN_INTVL_BUFLEN, intvl_max)
+FS_FUN_PROFILE(read_delay_thre, write_delay_thre, PROC_DELAY_THRE_BUFLEN, thresh)
 
 
 static int read_def_dev(char *page, char **start, off_t off, int count, int *eof, void *data) 
@@ -125,25 +748,248 @@ static int read_def_dev(char *page, char **start, off_t off, int count, int *eof
 	return sprintf(page, "%s\n",buf_proc_def_dev);
 }
 
+/* Set *ifindex to the device of name, and keep name in buf
+ * (IFNAMSIZ bytes) so that the notifier follows it. Return the
+ * ifindex, 0 if there is no such device yet.
+ */
+static int goose_bind_dev(char *buf, int *ifindex, const char *name)
+{
+	struct net_device *dev;
+	int ret;
+
+	rtnl_lock();
+	if (name != buf)
+		strlcpy(buf, name, IFNAMSIZ);
+	dev = (buf[0] != 0) ? __dev_get_by_name(&init_net, buf) : NULL;
+	ret = *ifindex = (dev != NULL) ? dev->ifindex : 0;
+	rtnl_unlock();
+
+	return ret;
+}
+
+/* Make name the default device */
+static void goose_set_def_dev(const char *name)
+{
+	if (goose_bind_dev(buf_proc_def_dev, &def_ifindex, name) == 0)
+		printk("GOOSE: Can not find %s, choose another device.\n", name);
+	else
+		printk("GOOSE: Change default network device to %s.\n", name);
+}
+
 static ssize_t write_def_dev(struct file *filp, const char __user *buff, unsigned long len, void *data)
 {
+	char buf[PROC_DEF_DEV_BUFLEN];
+
 	if (len > PROC_DEF_DEV_BUFLEN -1)
 		return -1;
-	if (copy_from_user(buf_proc_def_dev, buff, len)>0)
+	if (copy_from_user(buf, buff, len)>0)
 		return -1;
+	buf[len] = 0;
 
-	sscanf(buf_proc_def_dev, "%s", buf_proc_def_dev);
-		
-	def_dev = dev_get_by_name(&init_net, buf_proc_def_dev);
-	
-	if (def_dev == NULL)
-		printk("GOOSE: Can not find %s, choose another device.\n", buf_proc_def_dev);
-	else
-		printk("GOOSE: Change default network device to %s.\n", buf_proc_def_dev);		
-	
+	sscanf(buf, "%s", buf);
+	goose_set_def_dev(buf);
+
+	return len;
+}
+
+static int read_prp_lan(char *page, char **start, off_t off, int count, int *eof, void *data)
+{
+	return sprintf(page, "%s\n", prp_lan_name[(long) data][0] ? prp_lan_name[(long) data] : "none");
+}
+
+static ssize_t write_prp_lan(struct file *filp, const char __user *buff, unsigned long len, void *data)
+{
+	char buf[IFNAMSIZ];
+	long lan = (long) data;
+
+	if (len > IFNAMSIZ - 1)
+		return -1;
+	if (copy_from_user(buf, buff, len) > 0)
+		return -1;
+	buf[len] = 0;
+
+	if ((sscanf(buf, "%s", buf) != 1) || (strcmp(buf, "none") == 0))
+		buf[0] = 0;
+	if ((goose_bind_dev(prp_lan_name[lan], &prp_ifindex[lan], buf) == 0) && (buf[0] != 0))
+		printk("GOOSE: Can not find %s, LAN %c is down.\n", buf, 'A' + (int) lan);
+
+	return len;
+}
+
+
+static int read_filter(char *page, char **start, off_t off, int count, int *eof, void *data)
+{
+	struct goose_filter *f;
+	struct goose_filter_stats *st;
+	unsigned long hit, drop;
+	int len = 0, cpu, i, first;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(f, &filter_list, list) {
+		hit = drop = 0;
+		for_each_possible_cpu(cpu) {
+			st = per_cpu_ptr(f->stats, cpu);
+			hit += st->hit;
+			drop += st->drop;
+		}
+
+		len += scnprintf(page + len, PAGE_SIZE - len, "%s hit %lu drop %lu\n  appid:",
+						 (f->ifindex != 0) ? f->dev_name : "*", hit, drop);
+
+		/* Print APPIDs as ranges, as many as fit */
+		for (i = find_first_bit(f->appid_map, 65536); i < 65536;
+			 i = find_next_bit(f->appid_map, 65536, i + 1)) {
+			if (len >= PAGE_SIZE - 1)
+				break;
+			first = i;
+			while ((i + 1 < 65536) && test_bit(i + 1, f->appid_map))
+				i++;
+			len += (first == i) ? scnprintf(page + len, PAGE_SIZE - len, " %d", first)
+				: scnprintf(page + len, PAGE_SIZE - len, " %d-%d", first, i);
+		}
+
+		len += scnprintf(page + len, PAGE_SIZE - len, "\n  mac:");
+		for (i = 0; i < GOOSE_FILTER_MAX_MAC; i++)
+			if (test_bit(i, &f->mac_map))
+				len += scnprintf(page + len, PAGE_SIZE - len, " %pM", f->macs[i]);
+		len += scnprintf(page + len, PAGE_SIZE - len, "\n");
+
+		if (len >= PAGE_SIZE - 1)
+			break;
+	}
+	rcu_read_unlock();
+
+	*eof = 1;
 	return len;
 }
 
+static unsigned long goose_stats_sum(size_t offset)
+{
+	unsigned long sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *(unsigned long *) ((char *) &per_cpu(goose_stats, cpu) + offset);
+
+	return sum;
+}
+
+#define GOOSE_STAT_SUM(field) goose_stats_sum(offsetof(struct goose_stats, field))
+
+static int get_num_pkt_trans(char *buffer, struct kernel_param *kp)
+{
+	return sprintf(buffer, "%lu", GOOSE_STAT_SUM(retrans_done));
+}
+
+static int set_num_pkt_trans(const char *val, struct kernel_param *kp)
+{
+	return -EPERM;
+}
+
+/* Sum a per-device or per-APPID table over all cpus. A slot takes
+ * the key of the first cpu using it, other keys go to *other.
+ */
+static void goose_stats_sum_entries(size_t offset, unsigned int slots,
+									struct goose_stats_entry *sum,
+									struct goose_stats_entry *other)
+{
+	struct goose_stats_entry *e, *dst;
+	unsigned int i;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		e = (struct goose_stats_entry *) ((char *) &per_cpu(goose_stats, cpu) + offset);
+		for (i = 0; i <= slots; i++, e++) {
+			if (e->key == 0)
+				continue;
+			if ((i < slots) && (sum[i].key == 0))
+				sum[i].key = e->key;
+			dst = ((i < slots) && (sum[i].key == e->key)) ? &sum[i] : other;
+			dst->key = (dst == other) ? 1 : dst->key;
+			dst->rx_frames += e->rx_frames;
+			dst->rx_bytes += e->rx_bytes;
+			dst->tx_frames += e->tx_frames;
+			dst->tx_bytes += e->tx_bytes;
+		}
+	}
+}
+
+static int read_stats(char *page, char **start, off_t off, int count, int *eof, void *data)
+{
+	struct goose_stats_entry *sum, other;
+	struct net_device *dev;
+	unsigned int i;
+	int len = 0;
+
+	len += sprintf(page + len,
+				   "rx_frames %lu\nrx_bytes %lu\n"
+				   "rx_drop_inactive %lu\nrx_drop_filter %lu\n"
+				   "rx_drop_netlink %lu\nrx_drop_ring %lu\n"
+				   "tx_frames %lu\ntx_bytes %lu\n"
+				   "tx_fail %lu\ntx_realloc %lu\ntx_drop_mtu %lu\n"
+				   "tx_prp_copies %lu\nrx_drop_prp_dup %lu\n"
+				   "retrans_attempts %lu\nretrans_done %lu\nretrans_acked %lu\n"
+				   "ack_tx %lu\nack_rx %lu\n"
+				   "tx_pace_trips %lu\ntx_pace_drop %lu\n"
+				   "pub_repeats %lu\n",
+				   GOOSE_STAT_SUM(rx_frames), GOOSE_STAT_SUM(rx_bytes),
+				   GOOSE_STAT_SUM(rx_drop_inactive), GOOSE_STAT_SUM(rx_drop_filter),
+				   GOOSE_STAT_SUM(rx_drop_netlink), GOOSE_STAT_SUM(rx_drop_ring),
+				   GOOSE_STAT_SUM(tx_frames), GOOSE_STAT_SUM(tx_bytes),
+				   GOOSE_STAT_SUM(tx_fail), GOOSE_STAT_SUM(tx_realloc),
+				   GOOSE_STAT_SUM(tx_drop_mtu),
+				   GOOSE_STAT_SUM(tx_prp_copies), GOOSE_STAT_SUM(rx_drop_prp_dup),
+				   GOOSE_STAT_SUM(retrans_attempts), GOOSE_STAT_SUM(retrans_done),
+				   GOOSE_STAT_SUM(retrans_acked),
+				   GOOSE_STAT_SUM(ack_tx), GOOSE_STAT_SUM(ack_rx),
+				   GOOSE_STAT_SUM(tx_pace_trips), GOOSE_STAT_SUM(tx_pace_drop),
+				   GOOSE_STAT_SUM(pub_repeats));
+
+	sum = kzalloc(GOOSE_STATS_APPID_SLOTS * sizeof(struct goose_stats_entry), GFP_KERNEL);
+	if (sum == NULL)
+		goto read_stats_end;
+
+	/* Per device: dev <name> rx_frames rx_bytes tx_frames tx_bytes */
+	memset(&other, 0, sizeof(other));
+	goose_stats_sum_entries(offsetof(struct goose_stats, dev), GOOSE_STATS_DEV_SLOTS,
+							sum, &other);
+	for (i = 0; i < GOOSE_STATS_DEV_SLOTS; i++) {
+		if (sum[i].key == 0)
+			continue;
+		dev = dev_get_by_index(&init_net, sum[i].key - 1);
+		len += sprintf(page + len, "dev %s %lu %lu %lu %lu\n",
+					   (dev != NULL) ? dev->name : "?",
+					   sum[i].rx_frames, sum[i].rx_bytes, sum[i].tx_frames, sum[i].tx_bytes);
+		if (dev != NULL)
+			dev_put(dev);
+	}
+	if (other.key != 0)
+		len += sprintf(page + len, "dev other %lu %lu %lu %lu\n",
+					   other.rx_frames, other.rx_bytes, other.tx_frames, other.tx_bytes);
+
+	/* Per APPID: appid <appid> rx_frames rx_bytes tx_frames tx_bytes */
+	memset(sum, 0, GOOSE_STATS_APPID_SLOTS * sizeof(struct goose_stats_entry));
+	memset(&other, 0, sizeof(other));
+	goose_stats_sum_entries(offsetof(struct goose_stats, appid), GOOSE_STATS_APPID_SLOTS,
+							sum, &other);
+	for (i = 0; i < GOOSE_STATS_APPID_SLOTS; i++) {
+		if (sum[i].key == 0)
+			continue;
+		if (len > PAGE_SIZE - 128)
+			break;
+		len += sprintf(page + len, "appid %u %lu %lu %lu %lu\n", sum[i].key - 1,
+					   sum[i].rx_frames, sum[i].rx_bytes, sum[i].tx_frames, sum[i].tx_bytes);
+	}
+	if ((other.key != 0) && (len <= PAGE_SIZE - 128))
+		len += sprintf(page + len, "appid other %lu %lu %lu %lu\n",
+					   other.rx_frames, other.rx_bytes, other.tx_frames, other.tx_bytes);
+
+	kfree(sum);
+
+read_stats_end:
+	*eof = 1;
+	return len;
+}
 
 /************************************************************
  * proc_fs init: creating and registering
@@ -158,11 +1004,27 @@ static int proc_fs_init(void)
 	proc_retran_intvl = create_proc_entry(PROC_FNAME_RETRAN_INTVL, 0644, proc_dir);
 	proc_retran_incre = create_proc_entry(PROC_FNAME_RETRAN_INCRE, 0644, proc_dir);
 	proc_max_retran_intvl = create_proc_entry(PROC_FNAME_MAX_RETRAN_INTVL, 0644, proc_dir);
+	proc_rx_batch_num = create_proc_entry(PROC_FNAME_RX_BATCH_NUM, 0644, proc_dir);
+	proc_rx_batch_intvl = create_proc_entry(PROC_FNAME_RX_BATCH_INTVL, 0644, proc_dir);
+	proc_filter = create_proc_entry(PROC_FNAME_FILTER, 0444, proc_dir);
+	proc_stats = create_proc_entry(PROC_FNAME_STATS, 0444, proc_dir);
+	proc_vlan_tag = create_proc_entry(PROC_FNAME_VLAN_TAG, 0644, proc_dir);
+	proc_vlan_id = create_proc_entry(PROC_FNAME_VLAN_ID, 0644, proc_dir);
+	proc_vlan_pcp = create_proc_entry(PROC_FNAME_VLAN_PCP, 0644, proc_dir);
+	proc_prp_lan_a = create_proc_entry(PROC_FNAME_PRP_LAN_A, 0644, proc_dir);
+	proc_prp_lan_b = create_proc_entry(PROC_FNAME_PRP_LAN_B, 0644, proc_dir);
+	proc_profiles = create_proc_entry(PROC_FNAME_PROFILES, 0644, proc_dir);
+	proc_pace = create_proc_entry(PROC_FNAME_PACE, 0644, proc_dir);
 	
 	if ((proc_dir == NULL) || (proc_def_dev  == NULL) ||
 		(proc_tran_intvl  == NULL) || (proc_delay_thre == NULL) ||
 		(proc_retran_intvl == NULL) || (proc_retran_incre == NULL) ||
-		(proc_max_retran_intvl == NULL))
+		(proc_max_retran_intvl == NULL) || (proc_rx_batch_num == NULL) ||
+		(proc_rx_batch_intvl == NULL) || (proc_filter == NULL) ||
+		(proc_stats == NULL) || (proc_vlan_tag == NULL) ||
+		(proc_vlan_id == NULL) || (proc_vlan_pcp == NULL) ||
+		(proc_prp_lan_a == NULL) || (proc_prp_lan_b == NULL) ||
+		(proc_profiles == NULL) || (proc_pace == NULL))
 		return -1;
 
 	/* read/write interface for transmission interval */
@@ -189,263 +1051,3072 @@ static int proc_fs_init(void)
 	proc_def_dev->read_proc  =  read_def_dev;
 	proc_def_dev->write_proc = write_def_dev;	
 
+	/* read/write interface for coalescing of received frames */
+	proc_rx_batch_num->read_proc  =  read_rx_batch_num;
+	proc_rx_batch_num->write_proc = write_rx_batch_num;
+	proc_rx_batch_intvl->read_proc  =  read_rx_batch_intvl;
+	proc_rx_batch_intvl->write_proc = write_rx_batch_intvl;
+
+	/* read interface for receiving filters */
+	proc_filter->read_proc  =  read_filter;
+
+	/* read interface for statistics */
+	proc_stats->read_proc  =  read_stats;
+
+	/* read/write interface for the default 802.1Q tag */
+	proc_vlan_tag->read_proc  =  read_vlan_tag;
+	proc_vlan_tag->write_proc = write_vlan_tag;
+	proc_vlan_id->read_proc  =  read_vlan_id;
+	proc_vlan_id->write_proc = write_vlan_id;
+	proc_vlan_pcp->read_proc  =  read_vlan_pcp;
+	proc_vlan_pcp->write_proc = write_vlan_pcp;
+
+	/* read/write interface for the LANs of redundant transmission */
+	proc_prp_lan_a->data = (void *) 0;
+	proc_prp_lan_a->read_proc  =  read_prp_lan;
+	proc_prp_lan_a->write_proc = write_prp_lan;
+	proc_prp_lan_b->data = (void *) 1;
+	proc_prp_lan_b->read_proc  =  read_prp_lan;
+	proc_prp_lan_b->write_proc = write_prp_lan;
+
+	/* read/write interface for retransmission profiles */
+	proc_profiles->read_proc  =  read_profiles;
+	proc_profiles->write_proc = write_profiles;
+
+	/* read/write interface for TX pacing */
+	proc_pace->read_proc  =  read_pace;
+	proc_pace->write_proc = write_pace;
+
 	return 0;
 }
 
 
 /************************************************************
- * Netline interface I/O
+ * GOOSE subscriptions
  ************************************************************/
 
-/*
- * Read data from user space, then pass data to goose_tran
- */
+static inline struct hlist_head *goose_sub_bucket(unsigned short appid)
+{
+	return &sub_hash[appid & (GOOSE_SUB_HASH_SIZE - 1)];
+}
 
-static void nl_goose_read_from_user (struct sk_buff *__skb)
+static void goose_sub_free_rcu(struct rcu_head *head)
 {
-	struct sk_buff *skb;
-	struct nlmsghdr *nlh;
-	struct nl_ctrl_header *nl_ctrl_h;
-	struct nl_data_header *nl_data_h;
-	struct net_device *trans_dev = NULL;
-	unsigned char *data;
-	unsigned int data_len;	
-	
-	skb = skb_get(__skb);
+	kfree(container_of(head, struct goose_sub, rcu));
+}
+
+static int goose_sub_add(u32 pid, struct nl_sub_header *nl_sub_h)
+{
+	struct goose_sub *sub, *new_sub;
+	struct hlist_node *pos;
+
+	new_sub = kmalloc(sizeof(struct goose_sub), GFP_KERNEL);
+	if (unlikely(new_sub == NULL))
+		return -ENOMEM;
+
+	new_sub->pid = pid;
+	new_sub->appid = nl_sub_h->appid;
+	memcpy(new_sub->daddr, nl_sub_h->daddr, ETH_ALEN);
+
+	spin_lock_bh(&sub_lock);
+
+	/* Already subscribed */
+	hlist_for_each_entry(sub, pos, goose_sub_bucket(new_sub->appid), node) {
+		if ((sub->pid == pid) && (sub->appid == new_sub->appid) &&
+			!compare_ether_addr(sub->daddr, new_sub->daddr)) {
+			spin_unlock_bh(&sub_lock);
+			kfree(new_sub);
+			return 0;
+		}
+	}
+
+	hlist_add_head_rcu(&new_sub->node, goose_sub_bucket(new_sub->appid));
+	sub_count++;
+
+	spin_unlock_bh(&sub_lock);
+
+	DEBUG_print("pid %u subscribes appid %u\n", pid, new_sub->appid);
+	return 0;
+}
+
+/* Remove subscriptions of pid, for the APPID and destination of
+ * nl_sub_h, or all of them if nl_sub_h is NULL.
+ */
+static void goose_sub_del(u32 pid, struct nl_sub_header *nl_sub_h)
+{
+	struct goose_sub *sub;
+	struct hlist_node *pos, *n;
+	int i;
+
+	spin_lock_bh(&sub_lock);
+
+	for (i = 0; i < GOOSE_SUB_HASH_SIZE; i++) {
+		if ((nl_sub_h != NULL) && (&sub_hash[i] != goose_sub_bucket(nl_sub_h->appid)))
+			continue;
+
+		hlist_for_each_entry_safe(sub, pos, n, &sub_hash[i], node) {
+			if ((sub->pid != pid) ||
+				((nl_sub_h != NULL) && ((sub->appid != nl_sub_h->appid) ||
+										compare_ether_addr(sub->daddr, nl_sub_h->daddr))))
+				continue;
+
+			hlist_del_rcu(&sub->node);
+			sub_count--;
+			call_rcu(&sub->rcu, goose_sub_free_rcu);
+		}
+	}
+
+	spin_unlock_bh(&sub_lock);
+}
+
+/* Netlink sockets of subscribers going away */
+static int goose_netlink_event(struct notifier_block *this,
+							   unsigned long event, void *ptr)
+{
+	struct netlink_notify *n = ptr;
+
+	if ((event != NETLINK_URELEASE) || (n->protocol != NETLINK_GOOSE) || (n->pid == 0))
+		return NOTIFY_DONE;
+
+	goose_sub_del(n->pid, NULL);
+	goose_pub_del(n->pid);
+
+	if (n->pid == user_pid)
+		user_pid = 0;
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block goose_netlink_notifier = {
+	.notifier_call = goose_netlink_event,
+};
+
+/* Deliver a received frame to the subscribers of its APPID.
+ * The netlink message is built on the first match, then a clone
+ * of it goes to every subscriber.
+ * Return 0 if the frame is consumed, -1 if it has no subscriber.
+ */
+static int goose_sub_deliver(struct sk_buff *skb, struct net_device *dev)
+{
+	struct goose_sub *sub;
+	struct hlist_node *pos;
+	struct sk_buff *msg = NULL, *clone;
+	unsigned char *daddr = eth_hdr(skb)->h_dest;
+	unsigned short appid;
+	int found = 0;
+
+	if (unlikely(!pskb_may_pull(skb, sizeof(struct goosehdr))))
+		return -1;
+	appid = ntohs(((struct goosehdr *) skb->data)->appid);
+
+	rcu_read_lock();
+
+	hlist_for_each_entry_rcu(sub, pos, goose_sub_bucket(appid), node) {
+		if ((sub->appid != appid) ||
+			(!is_zero_ether_addr(sub->daddr) && compare_ether_addr(sub->daddr, daddr)))
+			continue;
+
+		if (!found) {
+			found = 1;
+			msg = goose_rcv_build_msg(skb, dev);
+		}
+		if (unlikely(msg == NULL))
+			break;
+
+		clone = skb_clone(msg, GFP_ATOMIC);
+		if (unlikely((clone == NULL) ||
+					 (netlink_unicast(nl_sk, clone, sub->pid, MSG_DONTWAIT) < 0)))
+			GOOSE_STAT_INC(rx_drop_netlink);
+	}
+
+	rcu_read_unlock();
+
+	kfree_skb(msg);
+	return found ? 0 : -1;
+}
+
+static void goose_sub_cleanup(void)
+{
+	int i;
+	struct goose_sub *sub;
+	struct hlist_node *pos, *n;
+
+	spin_lock_bh(&sub_lock);
+	for (i = 0; i < GOOSE_SUB_HASH_SIZE; i++) {
+		hlist_for_each_entry_safe(sub, pos, n, &sub_hash[i], node) {
+			hlist_del_rcu(&sub->node);
+			call_rcu(&sub->rcu, goose_sub_free_rcu);
+		}
+	}
+	sub_count = 0;
+	spin_unlock_bh(&sub_lock);
+
+	/* Wait for goose_sub_free_rcu callbacks */
+	rcu_barrier();
+}
+
+/************************************************************
+ * GOOSE receiving filters
+ ************************************************************/
+
+static void goose_filter_free_rcu(struct rcu_head *head)
+{
+	struct goose_filter *f = container_of(head, struct goose_filter, rcu);
+
+	free_percpu(f->stats);
+	kfree(f);
+}
+
+/* Find the filter of ifindex, called with filter_mutex held */
+static struct goose_filter *goose_filter_find(int ifindex)
+{
+	struct goose_filter *f;
+
+	list_for_each_entry(f, &filter_list, list)
+		if (f->ifindex == ifindex)
+			return f;
+
+	return NULL;
+}
+
+/* Apply a filter message */
+static int goose_filter_ctrl(struct nl_filter_header *nl_filter_h)
+{
+	struct goose_filter *f;
+	struct net_device *dev;
+	unsigned int appid;
+	int i, ifindex = 0, ret = 0;
+
+	if (nl_filter_h->dev_name[0] != 0) {
+		dev = dev_get_by_name(&init_net, nl_filter_h->dev_name);
+		if (dev == NULL)
+			return -ENODEV;
+		ifindex = dev->ifindex;
+		dev_put(dev);
+	}
+
+	mutex_lock(&filter_mutex);
+
+	f = goose_filter_find(ifindex);
+	if (f == NULL) {
+		if ((nl_filter_h->op != GOOSE_FILTER_ADD_APPID) &&
+			(nl_filter_h->op != GOOSE_FILTER_ADD_MAC))
+			goto goose_filter_ctrl_end;
+
+		f = kzalloc(sizeof(struct goose_filter), GFP_KERNEL);
+		if (f != NULL)
+			f->stats = alloc_percpu(struct goose_filter_stats);
+		if ((f == NULL) || (f->stats == NULL)) {
+			kfree(f);
+			ret = -ENOMEM;
+			goto goose_filter_ctrl_end;
+		}
+
+		f->ifindex = ifindex;
+		memcpy(f->dev_name, nl_filter_h->dev_name, IFNAMSIZ);
+		f->dev_name[IFNAMSIZ - 1] = 0;
+		list_add_tail_rcu(&f->list, &filter_list);
+		filter_count++;
+	}
+
+	switch (nl_filter_h->op) {
+	case GOOSE_FILTER_ADD_APPID:
+		for (appid = nl_filter_h->appid_first; appid <= nl_filter_h->appid_last; appid++)
+			set_bit(appid, f->appid_map);
+		break;
+
+	case GOOSE_FILTER_DEL_APPID:
+		for (appid = nl_filter_h->appid_first; appid <= nl_filter_h->appid_last; appid++)
+			clear_bit(appid, f->appid_map);
+		break;
+
+	case GOOSE_FILTER_ADD_MAC:
+		for (i = 0; i < GOOSE_FILTER_MAX_MAC; i++)
+			if (test_bit(i, &f->mac_map) &&
+				!compare_ether_addr(f->macs[i], nl_filter_h->daddr))
+				goto goose_filter_ctrl_end;
+
+		i = find_first_zero_bit(&f->mac_map, GOOSE_FILTER_MAX_MAC);
+		if (i >= GOOSE_FILTER_MAX_MAC) {
+			ret = -ENOSPC;
+			break;
+		}
+		memcpy(f->macs[i], nl_filter_h->daddr, ETH_ALEN);
+
+		/* Address must be visible before its bit */
+		smp_wmb();
+		set_bit(i, &f->mac_map);
+		break;
+
+	case GOOSE_FILTER_DEL_MAC:
+		for (i = 0; i < GOOSE_FILTER_MAX_MAC; i++)
+			if (test_bit(i, &f->mac_map) &&
+				!compare_ether_addr(f->macs[i], nl_filter_h->daddr))
+				clear_bit(i, &f->mac_map);
+		break;
+
+	case GOOSE_FILTER_CLEAR:
+		list_del_rcu(&f->list);
+		filter_count--;
+		call_rcu(&f->rcu, goose_filter_free_rcu);
+		break;
+
+	default:
+		ret = -EINVAL;
+	}
+
+goose_filter_ctrl_end:
+	mutex_unlock(&filter_mutex);
+	return ret;
+}
+
+/* Check a received frame against the filter of its device.
+ * Return 1 if the frame should be dropped.
+ */
+static int goose_filter_drop(struct sk_buff *skb, struct net_device *dev)
+{
+	struct goose_filter *f, *match = NULL;
+	struct goose_filter_stats *st;
+	unsigned long mac_map;
+	unsigned short appid;
+	int i, drop;
+
+	if (unlikely(!pskb_may_pull(skb, sizeof(struct goosehdr))))
+		return 1;
+
+	rcu_read_lock();
+
+	/* Filter of the device, or the one for all devices */
+	list_for_each_entry_rcu(f, &filter_list, list) {
+		if (f->ifindex == dev->ifindex) {
+			match = f;
+			break;
+		}
+		if (f->ifindex == 0)
+			match = f;
+	}
+
+	if (match == NULL) {
+		rcu_read_unlock();
+		return 0;
+	}
+
+	appid = ntohs(((struct goosehdr *) skb->data)->appid);
+	drop = !test_bit(appid, match->appid_map);
+
+	mac_map = ACCESS_ONCE(match->mac_map);
+	if (!drop && (mac_map != 0)) {
+		smp_rmb();
+		drop = 1;
+		for (i = 0; i < GOOSE_FILTER_MAX_MAC; i++) {
+			if ((mac_map & (1UL << i)) &&
+				!compare_ether_addr(match->macs[i], eth_hdr(skb)->h_dest)) {
+				drop = 0;
+				break;
+			}
+		}
+	}
+
+	st = per_cpu_ptr(match->stats, smp_processor_id());
+	if (drop)
+		st->drop++;
+	else
+		st->hit++;
+
+	rcu_read_unlock();
+	return drop;
+}
+
+static void goose_filter_cleanup(void)
+{
+	struct goose_filter *f, *n;
+
+	mutex_lock(&filter_mutex);
+	list_for_each_entry_safe(f, n, &filter_list, list) {
+		list_del_rcu(&f->list);
+		call_rcu(&f->rcu, goose_filter_free_rcu);
+	}
+	filter_count = 0;
+	mutex_unlock(&filter_mutex);
+
+	/* Wait for goose_filter_free_rcu callbacks */
+	rcu_barrier();
+}
+
+/************************************************************
+ * GOOSE VLAN tagging
+ ************************************************************/
+
+static inline struct hlist_head *goose_vlan_bucket(unsigned short appid)
+{
+	return &vlan_hash[appid & (GOOSE_VLAN_HASH_SIZE - 1)];
+}
+
+static void goose_vlan_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct goose_vlan, rcu));
+}
+
+/* Apply a VLAN message */
+static int goose_vlan_ctrl(struct nl_vlan_header *nl_vlan_h)
+{
+	struct goose_vlan *v, *new_v = NULL;
+	struct hlist_node *pos;
+	int ret = -ENOENT;
+
+	switch (nl_vlan_h->op) {
+	case GOOSE_VLAN_SET:
+		if ((nl_vlan_h->vid >= VLAN_VID_MASK) || (nl_vlan_h->pcp > 7))
+			return -EINVAL;
+
+		new_v = kmalloc(sizeof(struct goose_vlan), GFP_KERNEL);
+		if (unlikely(new_v == NULL))
+			return -ENOMEM;
+		new_v->appid = nl_vlan_h->appid;
+		new_v->tci = (nl_vlan_h->pcp << VLAN_PRIO_SHIFT) | nl_vlan_h->vid;
+		break;
+
+	case GOOSE_VLAN_DEL:
+		break;
+
+	default:
+		return -EINVAL;
+	}
+
+	spin_lock_bh(&vlan_lock);
+
+	hlist_for_each_entry(v, pos, goose_vlan_bucket(nl_vlan_h->appid), node) {
+		if (v->appid != nl_vlan_h->appid)
+			continue;
+
+		if (new_v != NULL) {
+			hlist_replace_rcu(&v->node, &new_v->node);
+			new_v = NULL;
+		} else {
+			hlist_del_rcu(&v->node);
+			vlan_count--;
+		}
+		call_rcu(&v->rcu, goose_vlan_free_rcu);
+		ret = 0;
+		break;
+	}
+
+	if (new_v != NULL) {
+		hlist_add_head_rcu(&new_v->node, goose_vlan_bucket(new_v->appid));
+		vlan_count++;
+		ret = 0;
+	}
+
+	spin_unlock_bh(&vlan_lock);
+	return ret;
+}
+
+/* 802.1Q TCI of the frames of appid, the default one if the APPID
+ * has none. Return 1 if the frames are tagged.
+ */
+static int goose_vlan_get(unsigned short appid, u16 *tci)
+{
+	struct goose_vlan *v;
+	struct hlist_node *pos;
+	int tagged = (vlan_tag != 0);
+
+	*tci = ((vlan_pcp & 0x7) << VLAN_PRIO_SHIFT) | (vlan_id & VLAN_VID_MASK);
+	if (vlan_count == 0)
+		return tagged;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(v, pos, goose_vlan_bucket(appid), node) {
+		if (v->appid == appid) {
+			*tci = v->tci;
+			tagged = 1;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return tagged;
+}
+
+static void goose_vlan_cleanup(void)
+{
+	struct goose_vlan *v;
+	struct hlist_node *pos, *n;
+	int i;
+
+	spin_lock_bh(&vlan_lock);
+	for (i = 0; i < GOOSE_VLAN_HASH_SIZE; i++) {
+		hlist_for_each_entry_safe(v, pos, n, &vlan_hash[i], node) {
+			hlist_del_rcu(&v->node);
+			call_rcu(&v->rcu, goose_vlan_free_rcu);
+		}
+	}
+	vlan_count = 0;
+	spin_unlock_bh(&vlan_lock);
+
+	/* Wait for goose_vlan_free_rcu callbacks */
+	rcu_barrier();
+}
+
+/************************************************************
+ * Device registry
+ ************************************************************/
+
+static inline struct net_device **goose_dev_slot(int ifindex)
+{
+	return &goose_devs[ifindex & (GOOSE_DEV_SLOTS - 1)];
+}
+
+/* Transmission device of a handle (ifindex), 0 for the default
+ * device. The device is held, the caller must dev_put it.
+ */
+static struct net_device *goose_dev_get(int ifindex)
+{
+	struct net_device *dev;
+
+	if (ifindex == 0)
+		ifindex = ACCESS_ONCE(def_ifindex);
+	if (unlikely(ifindex == 0))
+		return NULL;
+
+	rcu_read_lock();
+	dev = rcu_dereference(*goose_dev_slot(ifindex));
+	if (likely((dev != NULL) && (dev->ifindex == ifindex)))
+		dev_hold(dev);
+	else
+		dev = NULL;
+	rcu_read_unlock();
+
+	if (unlikely(dev == NULL))
+		dev = dev_get_by_index(&init_net, ifindex);
+	return dev;
+}
+
+/* Keep *ifindex on the device named name */
+static void goose_netdev_follow(struct net_device *dev, unsigned long event,
+								const char *name, int *ifindex)
+{
+	if (event == NETDEV_UNREGISTER) {
+		if (dev->ifindex == *ifindex)
+			*ifindex = 0;
+	} else if ((name[0] != 0) && (strcmp(dev->name, name) == 0)) {
+		*ifindex = dev->ifindex;
+	} else if (dev->ifindex == *ifindex) {
+		*ifindex = 0;
+	}
+}
+
+/* Keep the registry on the devices that are up, def_ifindex and
+ * prp_ifindex on the devices of their names. Runs under RTNL,
+ * which also serializes it with goose_bind_dev.
+ */
+static int goose_netdev_event(struct notifier_block *this,
+							  unsigned long event, void *ptr)
+{
+	struct net_device *dev = ptr;
+	struct net_device **slot;
+
+	if (dev_net(dev) != &init_net)
+		return NOTIFY_DONE;
+
+	slot = goose_dev_slot(dev->ifindex);
+	switch (event) {
+	case NETDEV_UP:
+		if (*slot == NULL)
+			rcu_assign_pointer(*slot, dev);
+		break;
+	case NETDEV_DOWN:
+	case NETDEV_UNREGISTER:
+		if (*slot == dev) {
+			rcu_assign_pointer(*slot, NULL);
+			/* No lookup may still hold it without a reference */
+			synchronize_net();
+		}
+		goose_pace_netdev(dev, event);
+		if (event == NETDEV_DOWN)
+			break;
+		/* Fall through */
+	case NETDEV_REGISTER:
+	case NETDEV_CHANGENAME:
+		goose_netdev_follow(dev, event, buf_proc_def_dev, &def_ifindex);
+		goose_netdev_follow(dev, event, prp_lan_name[0], &prp_ifindex[0]);
+		goose_netdev_follow(dev, event, prp_lan_name[1], &prp_ifindex[1]);
+		if (event != NETDEV_UNREGISTER)
+			goose_pace_netdev(dev, event);
+		break;
+	}
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block goose_netdev_notifier = {
+	.notifier_call = goose_netdev_event,
+};
+
+/************************************************************
+ * Redundant transmission (PRP)
+ ************************************************************/
+
+static void goose_prp_init(void)
+{
+	int i;
+
+	for (i = 0; i < GOOSE_PRP_NODES; i++)
+		spin_lock_init(&prp_nodes[i].lock);
+}
+
+/* Frames sent on dev have a copy on LAN B */
+static inline int goose_prp_lan_a(struct net_device *dev)
+{
+	return (dev->ifindex == prp_ifindex[0]) && (prp_ifindex[1] != 0);
+}
+
+/* Append the trailer of LAN A to a frame, skb->data points to the
+ * goose header. The frame is copied if it is shared, paged or short
+ * of tailroom. Return the frame, or NULL if it is dropped.
+ */
+static struct sk_buff *goose_prp_put_rct(struct sk_buff *skb)
+{
+	struct sk_buff *nskb;
+	struct prp_rct *rct;
+	unsigned int pad = 0, lsdu;
+
+	if (skb->len + sizeof(struct prp_rct) < PRP_MIN_LSDU)
+		pad = PRP_MIN_LSDU - sizeof(struct prp_rct) - skb->len;
+
+	if (skb_shared(skb) || skb_cloned(skb) || skb_is_nonlinear(skb) ||
+		(skb_tailroom(skb) < pad + sizeof(struct prp_rct))) {
+		nskb = skb_copy_expand(skb, skb_headroom(skb), pad + sizeof(struct prp_rct),
+							   GFP_ATOMIC);
+		kfree_skb(skb);
+		if (unlikely(nskb == NULL))
+			return NULL;
+		skb = nskb;
+		GOOSE_STAT_INC(tx_realloc);
+	}
+
+	memset(skb_put(skb, pad), 0, pad);
+	lsdu = skb->len + sizeof(struct prp_rct);
+	rct = (struct prp_rct *) skb_put(skb, sizeof(struct prp_rct));
+	rct->seq = htons((u16) atomic_inc_return(&prp_seq));
+	rct->lan_size = htons((PRP_LAN_A << 12) | (lsdu & 0x0fff));
+	rct->suffix = htons(PRP_SUFFIX);
+
+	return skb;
+}
+
+/* Copy of a frame with a trailer, under a new sequence number.
+ * Retransmissions take it, the receivers would discard them else.
+ */
+static struct sk_buff *goose_prp_renew(struct sk_buff *skb)
+{
+	struct sk_buff *nskb = skb_copy(skb, GFP_ATOMIC);
+	struct prp_rct *rct;
+
+	if (unlikely(nskb == NULL))
+		return NULL;
+
+	rct = (struct prp_rct *) (skb_tail_pointer(nskb) - sizeof(struct prp_rct));
+	rct->seq = htons((u16) atomic_inc_return(&prp_seq));
+
+	return nskb;
+}
+
+/* Send the copy of a LAN A frame on LAN B: same source address and
+ * sequence number, only the LAN of the trailer differs.
+ * Return 0 if it is sent.
+ */
+static int goose_prp_xmit_b(struct sk_buff *skb)
+{
+	struct net_device *dev_b;
+	struct sk_buff *skb_b;
+	struct prp_rct *rct;
+	int ifindex = prp_ifindex[1];
+	int ret = -1;
+	u16 tci;
+
+	if (unlikely(ifindex == 0))
+		return -1;
+	dev_b = goose_dev_get(ifindex);
+	if (unlikely(dev_b == NULL))
+		return -1;
+
+	skb_b = skb_copy(skb, GFP_ATOMIC);
+	if (unlikely(skb_b == NULL))
+		goto goose_prp_xmit_b_end;
+
+	rct = (struct prp_rct *) (skb_tail_pointer(skb_b) - sizeof(struct prp_rct));
+	rct->lan_size = htons((PRP_LAN_B << 12) | (ntohs(rct->lan_size) & 0x0fff));
+	skb_b->dev = dev_b;
+	GOOSE_SKB_CB(skb_b)->prp = 0;
+
+	/* LAN A may tag in hardware, LAN B not */
+	if (vlan_tx_tag_present(skb_b) && !(dev_b->features & NETIF_F_HW_VLAN_TX)) {
+		tci = vlan_tx_tag_get(skb_b);
+		skb_b->vlan_tci = 0;
+		skb_b = __vlan_put_tag(skb_b, tci);
+		if (unlikely(skb_b == NULL))
+			goto goose_prp_xmit_b_end;
+	}
+
+	ret = goose_dev_queue_xmit(skb_b);
+	if (likely(ret == 0))
+		GOOSE_STAT_INC(tx_prp_copies);
+
+goose_prp_xmit_b_end:
+	dev_put(dev_b);
+	return ret;
+}
+
+static inline unsigned int goose_prp_hash(const unsigned char *addr)
+{
+	return (addr[3] ^ (addr[4] << 3) ^ (addr[5] << 5) ^ addr[2]) & (GOOSE_PRP_NODES - 1);
+}
+
+/* Check the trailer of a received frame, skb->data points to the
+ * goose header. Return 0 if the frame has no trailer, 1 if it is
+ * the first copy, -1 if the other copy is already received.
+ */
+static int goose_prp_rcv(struct sk_buff *skb)
+{
+	struct prp_rct *rct, _rct;
+	struct goose_prp_node *node;
+	unsigned int lan_size;
+	u16 seq, delta;
+	int ret = 1;
+
+	if (skb->len < PRP_MIN_LSDU)
+		return 0;
+
+	rct = skb_header_pointer(skb, skb->len - sizeof(struct prp_rct),
+							 sizeof(struct prp_rct), &_rct);
+	if ((rct == NULL) || (rct->suffix != htons(PRP_SUFFIX)))
+		return 0;
+	lan_size = ntohs(rct->lan_size);
+	if ((((lan_size >> 12) != PRP_LAN_A) && ((lan_size >> 12) != PRP_LAN_B)) ||
+		((lan_size & 0x0fff) != (skb->len & 0x0fff)))
+		return 0;
+
+	seq = ntohs(rct->seq);
+	node = &prp_nodes[goose_prp_hash(eth_hdr(skb)->h_source)];
+
+	spin_lock(&node->lock);
+
+	if ((node->last == 0) ||
+		time_after(jiffies, node->last + msecs_to_jiffies(GOOSE_PRP_NODE_TIMEOUT))) {
+		/* Unused or forgotten, the source takes it */
+		memcpy(node->saddr, eth_hdr(skb)->h_source, ETH_ALEN);
+		node->seq_hi = seq;
+		node->window = 1;
+	} else if (compare_ether_addr(node->saddr, eth_hdr(skb)->h_source)) {
+		/* Taken by another source, no duplicate discard */
+		spin_unlock(&node->lock);
+		return 1;
+	} else {
+		delta = seq - node->seq_hi;
+		if (delta == 0) {
+			ret = -1;
+		} else if (delta < 0x8000) {
+			/* Newer, slide the window */
+			node->window = (delta >= GOOSE_PRP_WINDOW) ? 1 : ((node->window << delta) | 1);
+			node->seq_hi = seq;
+		} else {
+			/* Older, beyond the window it is taken as new */
+			delta = node->seq_hi - seq;
+			if (delta < GOOSE_PRP_WINDOW) {
+				if (node->window & (1ULL << delta))
+					ret = -1;
+				else
+					node->window |= 1ULL << delta;
+			}
+		}
+	}
+	node->last = jiffies;
+
+	spin_unlock(&node->lock);
+	return ret;
+}
+
+/************************************************************
+ * Netline interface I/O
+ ************************************************************/
+
+/* Obtain transmission device of a data message, held */
+static inline struct net_device *nl_goose_get_dev(struct nl_data_header *nl_data_h)
+{
+	return (nl_data_h->dev_name[0] != 0) ?
+		dev_get_by_name(&init_net, nl_data_h->dev_name)
+		: goose_dev_get(nl_data_h->dev_handle);
+}
+
+/*
+ * Transmit one record of a batch. Unlike a single message, the
+ * record is copied into its own skb, because records share the
+ * netlink skb and the link-layer header of one record would
+ * overwrite the tail of the previous one.
+ */
+static int nl_goose_trans_record(struct nlmsghdr *nlh)
+{
+	struct nl_data_header *nl_data_h;
+	struct net_device *trans_dev;
+	struct sk_buff *skb;
+	unsigned int len;
+	int ret;
+
+	if (unlikely((nlh->nlmsg_type & ~NL_MSG_DATA_TYPES) ||
+				 (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(struct nl_data_header)
+												+ sizeof(struct goosehdr)))))
+		return -EINVAL;
+
+	nl_data_h = (struct nl_data_header *) NLMSG_DATA(nlh);
+	trans_dev = nl_goose_get_dev(nl_data_h);
+	if (unlikely(trans_dev == NULL))
+		return -ENODEV;
+
+	len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(struct nl_data_header));
+	skb = alloc_skb(GOOSE_LL_SPACE(trans_dev) + len, GFP_KERNEL);
+	if (unlikely(skb == NULL)) {
+		dev_put(trans_dev);
+		return -ENOMEM;
+	}
+
+	skb_reserve(skb, GOOSE_LL_SPACE(trans_dev));
+	memcpy(skb_put(skb, len), (unsigned char *) nl_data_h + sizeof(struct nl_data_header), len);
+	skb_reset_network_header(skb);
+
+	ret = goose_xmit_frame(trans_dev,
+						   (nlh->nlmsg_type & NL_MSG_DATA_BRDCAST) ?
+						   trans_dev->broadcast : nl_data_h->daddr,
+						   skb, ((nlh->nlmsg_type & NL_MSG_DATA_RELB) != 0),
+						   ((nlh->nlmsg_type & NL_MSG_DATA_RELB) != 0));
+	dev_put(trans_dev);
+	return ret;
+}
+
+/* Reply a single nlmsgerr about the batch of skb */
+static void nl_goose_batch_error(struct sk_buff *skb, int error)
+{
+	struct sk_buff *rep_skb;
+	struct nlmsghdr *rep;
+	struct nlmsgerr *errmsg;
+
+	rep_skb = nlmsg_new(sizeof(struct nlmsgerr), GFP_KERNEL);
+	if (unlikely(rep_skb == NULL))
+		return;
+
+	rep = nlmsg_put(rep_skb, NETLINK_CB(skb).pid, NL_BATCH_SEQ_ALL,
+					NLMSG_ERROR, sizeof(struct nlmsgerr), 0);
+	errmsg = (struct nlmsgerr *) nlmsg_data(rep);
+	errmsg->error = error;
+	memcpy(&errmsg->msg, nlmsg_hdr(skb), sizeof(struct nlmsghdr));
+
+	netlink_unicast(nl_sk, rep_skb, NETLINK_CB(skb).pid, MSG_DONTWAIT);
+}
+
+/*
+ * Walk all records of a batch (NLM_F_MULTI) and transmit them.
+ * Records carrying NLM_F_ACK get a struct nlmsgerr with their
+ * status, records with NL_MSG_DATA_TSTAMP a struct nl_tx_tstamp
+ * with the time they were handed to the device; all of them are
+ * returned in one message to the sender. A sender waiting for a
+ * report always gets one: without memory for it, nothing is sent.
+ */
+static void nl_goose_trans_batch(struct sk_buff *skb)
+{
+	struct nlmsghdr *nlh, *rep;
+	struct nlmsgerr *errmsg;
+	struct nl_tx_tstamp *tsmsg;
+	struct sk_buff *rep_skb = NULL;
+	int rem, ret, num_ack = 0, num_tstamp = 0;
+
+	rem = skb->len;
+	for (nlh = nlmsg_hdr(skb); nlmsg_ok(nlh, rem); nlh = nlmsg_next(nlh, &rem)) {
+		if (nlh->nlmsg_flags & NLM_F_ACK)
+			num_ack++;
+		if (nlh->nlmsg_type & NL_MSG_DATA_TSTAMP)
+			num_tstamp++;
+	}
+
+	if ((num_ack != 0) || (num_tstamp != 0)) {
+		rep_skb = alloc_skb(num_ack * nlmsg_total_size(sizeof(struct nlmsgerr)) +
+							num_tstamp * nlmsg_total_size(sizeof(struct nl_tx_tstamp)),
+							GFP_KERNEL);
+		if (unlikely(rep_skb == NULL)) {
+			nl_goose_batch_error(skb, -ENOMEM);
+			return;
+		}
+	}
+
+	rem = skb->len;
+	for (nlh = nlmsg_hdr(skb); nlmsg_ok(nlh, rem); nlh = nlmsg_next(nlh, &rem)) {
+		ret = nl_goose_trans_record(nlh);
+		if (ret > 0)
+			ret = net_xmit_errno(ret);
+
+		if (rep_skb == NULL)
+			continue;
+
+		if (nlh->nlmsg_type & NL_MSG_DATA_TSTAMP) {
+			rep = nlmsg_put(rep_skb, NETLINK_CB(skb).pid, nlh->nlmsg_seq,
+							NL_MSG_TX_TSTAMP, sizeof(struct nl_tx_tstamp), 0);
+			tsmsg = (struct nl_tx_tstamp *) nlmsg_data(rep);
+			tsmsg->tstamp = ktime_to_ns(ktime_get_real());
+			tsmsg->status = ret;
+			tsmsg->reserved = 0;
+		}
+
+		if (nlh->nlmsg_flags & NLM_F_ACK) {
+			rep = nlmsg_put(rep_skb, NETLINK_CB(skb).pid, nlh->nlmsg_seq,
+							NLMSG_ERROR, sizeof(struct nlmsgerr), 0);
+			errmsg = (struct nlmsgerr *) nlmsg_data(rep);
+			errmsg->error = ret;
+			memcpy(&errmsg->msg, nlh, sizeof(struct nlmsghdr));
+		}
+	}
+
+	if (rep_skb != NULL)
+		netlink_unicast(nl_sk, rep_skb, NETLINK_CB(skb).pid, MSG_DONTWAIT);
+}
+
+/*
+ * VLAN, profile and filter messages change the frames of every
+ * process, they are taken from CAP_NET_ADMIN senders only.
+ */
+static inline int nl_goose_admin(struct sk_buff *skb)
+{
+	return cap_raised(NETLINK_CB(skb).eff_cap, CAP_NET_ADMIN);
+}
+
+/*
+ * Read data from user space, then pass data to goose_tran
+ */
+
+static void nl_goose_read_from_user (struct sk_buff *__skb)
+{
+	struct sk_buff *skb;
+	struct nlmsghdr *nlh;
+	struct nl_ctrl_header *nl_ctrl_h;
+	struct nl_data_header *nl_data_h;
+	struct net_device *trans_dev = NULL;
+	
+	skb = skb_get(__skb);
 
 	/* Sanity check */
 	if (unlikely(skb->len < NLMSG_SPACE(0)))
+		goto read_from_user_return;
+
+	nlh = nlmsg_hdr(skb);
+
+	/* Message is a batch of data records?
+	 * Whatever its records are, a batch is answered as one.
+	 */
+	if (nlh->nlmsg_flags & NLM_F_MULTI) {
+		nl_goose_trans_batch(skb);
+		goto read_from_user_return;
+	}
+
+	/* Message is reporting pid ?
+	 * Take the port of the sending socket, not nlmsg_pid: user
+	 * space lets the kernel assign ports, one process may have
+	 * several sockets.
+	 */
+	if (unlikely(nlh->nlmsg_type == NL_MSG_REPORT_TO_MODULE)) {
+		user_pid = NETLINK_CB(skb).pid;
+		printk("GOOSE: registered user_pid = %d \n", user_pid);
+		goto read_from_user_return;
+	}
+
+	/* Message is (un)subscribing an APPID ? */
+	if (unlikely((nlh->nlmsg_type == NL_MSG_SUBSCRIBE) ||
+				 (nlh->nlmsg_type == NL_MSG_UNSUBSCRIBE))) {
+		if ((nlh->nlmsg_len < sizeof(struct nl_sub_header)) ||
+			(nlh->nlmsg_len > skb->len - NLMSG_HDRLEN))
+			goto read_from_user_return;
+
+		if (nlh->nlmsg_type == NL_MSG_SUBSCRIBE)
+			goose_sub_add(NETLINK_CB(skb).pid, (struct nl_sub_header *) NLMSG_DATA(nlh));
+		else
+			goose_sub_del(NETLINK_CB(skb).pid, (struct nl_sub_header *) NLMSG_DATA(nlh));
+		goto read_from_user_return;
+	}
+
+	/* Message is setting or stopping a publication ? */
+	if (unlikely(nlh->nlmsg_type == NL_MSG_PUBLISH)) {
+		if (nlh->nlmsg_len > skb->len - NLMSG_HDRLEN)
+			goto read_from_user_return;
+
+		if (goose_pub_ctrl(NETLINK_CB(skb).pid, nlh) != 0)
+			printk("GOOSE: Can not apply publication operation %u.\n",
+				   ((struct nl_pub_header *) NLMSG_DATA(nlh))->op);
+		goto read_from_user_return;
+	}
+
+	/* Message is changing the VLAN tag of an APPID ? */
+	if (unlikely(nlh->nlmsg_type == NL_MSG_VLAN)) {
+		if ((nlh->nlmsg_len < sizeof(struct nl_vlan_header)) ||
+			(nlh->nlmsg_len > skb->len - NLMSG_HDRLEN))
+			goto read_from_user_return;
+
+		if (!nl_goose_admin(skb)) {
+			printk("GOOSE: VLAN operation of pid %u needs CAP_NET_ADMIN.\n",
+				   NETLINK_CB(skb).pid);
+			goto read_from_user_return;
+		}
+
+		if (goose_vlan_ctrl((struct nl_vlan_header *) NLMSG_DATA(nlh)) != 0)
+			printk("GOOSE: Can not apply VLAN operation %u.\n",
+				   ((struct nl_vlan_header *) NLMSG_DATA(nlh))->op);
+		goto read_from_user_return;
+	}
+
+	/* Message is changing a retransmission profile ? */
+	if (unlikely(nlh->nlmsg_type == NL_MSG_PROFILE)) {
+		if ((nlh->nlmsg_len < sizeof(struct nl_profile_header)) ||
+			(nlh->nlmsg_len > skb->len - NLMSG_HDRLEN))
+			goto read_from_user_return;
+
+		if (!nl_goose_admin(skb)) {
+			printk("GOOSE: Profile operation of pid %u needs CAP_NET_ADMIN.\n",
+				   NETLINK_CB(skb).pid);
+			goto read_from_user_return;
+		}
+
+		if (goose_profile_ctrl((struct nl_profile_header *) NLMSG_DATA(nlh)) != 0)
+			printk("GOOSE: Can not apply profile operation %u.\n",
+				   ((struct nl_profile_header *) NLMSG_DATA(nlh))->op);
+		goto read_from_user_return;
+	}
+
+	/* Message is changing a receiving filter ? */
+	if (unlikely(nlh->nlmsg_type == NL_MSG_FILTER)) {
+		if ((nlh->nlmsg_len < sizeof(struct nl_filter_header)) ||
+			(nlh->nlmsg_len > skb->len - NLMSG_HDRLEN))
+			goto read_from_user_return;
+
+		if (!nl_goose_admin(skb)) {
+			printk("GOOSE: Filter operation of pid %u needs CAP_NET_ADMIN.\n",
+				   NETLINK_CB(skb).pid);
+			goto read_from_user_return;
+		}
+
+		if (goose_filter_ctrl((struct nl_filter_header *) NLMSG_DATA(nlh)) != 0)
+			printk("GOOSE: Can not apply filter operation %u.\n",
+				   ((struct nl_filter_header *) NLMSG_DATA(nlh))->op);
+		goto read_from_user_return;
+	}
+
+	/* Message is ctrl-type? */
+	if (unlikely(nlh->nlmsg_type & NL_MSG_CTRL)) {
+		nl_ctrl_h = (struct nl_ctrl_header *) (NLMSG_DATA(nlh));
+		
+		/* Set default device */
+		if (nl_ctrl_h->def_dev[0] != 0) {
+			nl_ctrl_h->def_dev[IFNAMSIZE - 1] = 0;
+			goose_set_def_dev(nl_ctrl_h->def_dev);
+		}
+
+		/* Set GOOSE parameters of profile 0 */
+		goose_profile_update(0, &nl_ctrl_h->goose_param, GOOSE_PROFILE_KEEP, 0, 0);
+		
+		goto read_from_user_return;
+	}
+	
+	/* Then, message should be data */
+	nl_data_h = (struct nl_data_header *) NLMSG_DATA(nlh);
+
+	/* Obtain transmission device */
+	trans_dev = nl_goose_get_dev(nl_data_h);
+	
+	if (unlikely(trans_dev == NULL))
+		goto read_from_user_return;
+
+	/* Should message be broadcasted ? */
+	if (unlikely(nlh->nlmsg_type & NL_MSG_DATA_BRDCAST)) {		
+		goose_trans_skb(trans_dev, trans_dev->broadcast, skb,
+						((nlh->nlmsg_type & NL_MSG_DATA_RELB) != 0));
+		dev_put(trans_dev);
+		goto read_from_user_exit; 
+	} 
+
+	/* Then, message should be unicasted */
+	goose_trans_skb(trans_dev, nl_data_h->daddr, skb,
+					((nlh->nlmsg_type & NL_MSG_DATA_RELB) != 0));
+	dev_put(trans_dev);
+	goto read_from_user_exit;
+	
+read_from_user_return:	
+	kfree_skb(skb);
+	
+read_from_user_exit:
+	return;
+}
+
+
+/*
+ * Send data to user space
+ */
+
+static inline int nl_goose_send_to_user (struct sk_buff *skb)
+{
+	/* Nobody is registered, pid 0 would be the module itself */
+	if (unlikely(user_pid == 0)) {
+		kfree_skb(skb);
+		return 0;
+	}
+
+	if (unlikely(netlink_unicast(nl_sk, skb, user_pid, MSG_DONTWAIT) < 0))
+		GOOSE_STAT_INC(rx_drop_netlink);
+	return 0;
+}
+
+/* Netline interface: creating and registering */
+static int netlink_init(void)
+{
+	nl_sk = netlink_kernel_create(&init_net, NETLINK_GOOSE,
+								  0, nl_goose_read_from_user, NULL, THIS_MODULE);
+	
+	if (!nl_sk) {
+		if (nl_sk != NULL)
+    		sock_release(nl_sk->sk_socket);
+		return -1;
+	}
+
+	return 0;
+
+}
+
+/************************************************************
+ * GOOSE protocol
+ ************************************************************/
+
+/* Timestamps and 802.1Q tag of a received frame, as it is handed
+ * to user space
+ */
+static inline void goose_rx_tstamp(struct sk_buff *skb, struct nl_rx_tstamp *tstamp)
+{
+	tstamp->queued = ktime_to_ns(ktime_get_real());
+	tstamp->rx = ktime_to_ns(skb->tstamp);
+	if (tstamp->rx == 0)
+		tstamp->rx = tstamp->queued;
+	tstamp->vlan = vlan_tx_tag_present(skb) ?
+		(GOOSE_VLAN_PRESENT | vlan_tx_tag_get(skb)) : 0;
+	tstamp->reserved = 0;
+}
+
+/* Take the pending message of coalesced frames,
+ * called with rx_batch_lock held. Its window is over: the timer
+ * is stopped unless it is running already, then it finds nothing.
+ */
+static inline struct sk_buff *goose_rx_batch_take(void)
+{
+	struct sk_buff *skb = rx_batch_skb;
+
+	if (skb != NULL)
+		hrtimer_try_to_cancel(&rx_batch_timer.timer);
+	rx_batch_skb = NULL;
+	rx_batch_count = 0;
+	return skb;
+}
+
+/* Coalescing window expires, running in softirq context */
+static enum hrtimer_restart goose_rx_batch_timer(struct hrtimer *timer)
+{
+	struct sk_buff *skb;
+
+	spin_lock_bh(&rx_batch_lock);
+	skb = goose_rx_batch_take();
+	spin_unlock_bh(&rx_batch_lock);
+
+	if (skb != NULL)
+		nl_goose_send_to_user(skb);
+
+	return HRTIMER_NORESTART;
+}
+
+/* Append a received frame to the pending message.
+ * Return a message which is ready to be sent to user space, or NULL.
+ */
+static struct sk_buff *goose_rx_batch_add(struct sk_buff *skb, struct net_device *dev,
+										  unsigned int rec_len)
+{
+	struct sk_buff *flush_skb = NULL;
+	struct nl_rx_tstamp tstamp;
+	struct nlmsghdr *nlh;
+	unsigned char *rec;
+
+	spin_lock_bh(&rx_batch_lock);
+
+	if ((rx_batch_skb != NULL) && (skb_tailroom(rx_batch_skb) < nlmsg_total_size(rec_len)))
+		flush_skb = goose_rx_batch_take();
+
+	if (rx_batch_skb == NULL) {
+		rx_batch_skb = alloc_skb(NL_RECV_BATCH_LEN, GFP_ATOMIC);
+		if (unlikely(rx_batch_skb == NULL))
+			goto goose_rx_batch_add_end;
+		tasklet_hrtimer_start(&rx_batch_timer,
+							  ns_to_ktime((u64) rx_batch_intvl * NSEC_PER_USEC),
+							  HRTIMER_MODE_REL);
+	}
+
+	/* Same record as a single frame: tstamp | dev_name | eth header | data */
+	nlh = nlmsg_put(rx_batch_skb, 0, 0, NL_MSG_DATA_RECV, rec_len, NLM_F_MULTI);
+	rec = (unsigned char *) nlmsg_data(nlh);
+	goose_rx_tstamp(skb, &tstamp);
+	memcpy(rec, &tstamp, sizeof(struct nl_rx_tstamp));
+	rec += sizeof(struct nl_rx_tstamp);
+	memcpy(rec, dev->name, IFNAMSIZ);
+	memcpy(rec + IFNAMSIZ, skb_mac_header(skb), ETH_HLEN);
+	skb_copy_bits(skb, 0, rec + IFNAMSIZ + ETH_HLEN, skb->len);
+
+	if (++rx_batch_count >= rx_batch_num)
+		flush_skb = goose_rx_batch_take();
+
+goose_rx_batch_add_end:
+	spin_unlock_bh(&rx_batch_lock);
+	return flush_skb;
+}
+
+/* Write a received frame into the RX ring.
+ * Return 0 if the frame is consumed (written, or dropped because
+ * the ring is full), -1 if no ring is open or the frame does not
+ * fit in a slot.
+ * Ring geometry is never read back from the shared memory.
+ */
+static int goose_rx_ring_put(struct sk_buff *skb, struct net_device *dev)
+{
+	struct goose_ring_hdr *ring;
+	struct goose_ring_slot *slot;
+	unsigned char *data;
+	unsigned int prod, len = IFNAMSIZ + ETH_HLEN + skb->len;
+
+	/* Jumbo frames go by netlink */
+	if (unlikely(len > GOOSE_RING_SLOT_SIZE - sizeof(struct goose_ring_slot)))
+		return -1;
+	spin_lock(&rx_ring_lock);
+
+	ring = rx_ring;
+	if (unlikely(ring == NULL)) {
+		spin_unlock(&rx_ring_lock);
+		return -1;
+	}
+
+	prod = ring->prod;
+	if (unlikely(prod - ACCESS_ONCE(ring->cons) >= GOOSE_RX_RING_SLOTS)) {
+		ring->drops++;
+		GOOSE_STAT_INC(rx_drop_ring);
+		goto goose_rx_ring_put_end;
+	}
+
+	slot = (struct goose_ring_slot *) ((unsigned char *) ring + GOOSE_RING_HDR_SIZE +
+		(prod & (GOOSE_RX_RING_SLOTS - 1)) * GOOSE_RING_SLOT_SIZE);
+	data = (unsigned char *) (slot + 1);
+
+	/* Same layout as a netlink record: dev_name | eth header | data */
+	memcpy(data, dev->name, IFNAMSIZ);
+	memcpy(data + IFNAMSIZ, skb_mac_header(skb), ETH_HLEN);
+	skb_copy_bits(skb, 0, data + IFNAMSIZ + ETH_HLEN, skb->len);
+
+	slot->len = len;
+	goose_rx_tstamp(skb, &slot->tstamp);
+
+	/* Slot must be visible before prod */
+	smp_wmb();
+	ring->prod = prod + 1;
+
+goose_rx_ring_put_end:
+	spin_unlock(&rx_ring_lock);
+
+	if (waitqueue_active(&rx_ring_wait))
+		wake_up_interruptible(&rx_ring_wait);
+
+	return 0;
+}
+
+/* Form a netlink message of a received frame, in place.
+ * Return the message, or NULL if the frame is dropped.
+ */
+static struct sk_buff *goose_rcv_build_msg(struct sk_buff *skb, struct net_device *dev)
+{
+	struct nl_rx_tstamp tstamp;
+	struct nlmsghdr *nlh;
+
+	/* The skb may be shared with other protocol handlers */
+	skb = skb_share_check(skb, GFP_ATOMIC);
+	if (unlikely(skb == NULL))
+		return NULL;
+
+	if (unlikely(skb_cow_head(skb, NLMSG_HDRLEN + sizeof(struct nl_rx_tstamp) +
+							  IFNAMSIZ + ETH_HLEN))) {
+		kfree_skb(skb);
+		return NULL;
+	}
+
+	/* We use existing skb to form a new one:
+	 *
+	 * skb:
+	 * new skb->data                                                             old skb->data
+	 *   |                                                                            |
+	 * -------------------------------------------------------------------------------------
+	 *   | nlmsghdr | nl_rx_tstamp | IFNAMESIZ  bytes | daddr(6) | saddr(6) | type(2) | data
+	 * -------------------------------------------------------------------------------------
+	 *                             |<-- can form a struct nl_data_header -->|
+	 * 
+	 */
+	skb_push(skb, ETH_HLEN + IFNAMSIZ);
+	
+	/* Then, we write the dev_name to nl_data_header->dev_name */
+	memcpy(skb->data, dev->name, IFNAMSIZ);
+
+	goose_rx_tstamp(skb, &tstamp);
+	memcpy(skb_push(skb, sizeof(struct nl_rx_tstamp)), &tstamp, sizeof(struct nl_rx_tstamp));
+
+	nlh = (struct nlmsghdr *) skb_push(skb, NLMSG_HDRLEN);
+	nlh->nlmsg_len = skb->len;
+	nlh->nlmsg_type = NL_MSG_DATA_RECV;
+	nlh->nlmsg_flags = 0;
+	nlh->nlmsg_seq = 0;
+	nlh->nlmsg_pid = 0;
+
+	return skb;
+}
+
+/* GOOSE packet handler - recevie */
+int goose_rcv(struct sk_buff *skb, struct net_device *dev,
+			  struct packet_type *pt, struct net_device *orin_dev)
+{
+	struct sk_buff *batch_skb = NULL;
+	unsigned int rec_len;
+	int prp;
+		
+	if (unlikely(!recv_active)) {
+		GOOSE_STAT_INC(rx_drop_inactive);
+		goto goose_rcv_drop;
+	}
+
+	/* Pulling, tagging and trimming change the skb, it must be ours */
+	skb = skb_share_check(skb, GFP_ATOMIC);
+	if (unlikely(skb == NULL))
+		return 0;
+
+	/* Frames of an 802.1Q device lost their tag: the VID is the
+	 * device's, the PCP the priority of its ingress map. Unless the
+	 * NIC strips tags, goose_vlan_rcv already took the frame, with
+	 * its tag, from the real device.
+	 */
+	if (unlikely(dev->priv_flags & IFF_802_1Q_VLAN)) {
+		if (!(vlan_dev_real_dev(dev)->features & NETIF_F_HW_VLAN_RX))
+			goto goose_rcv_drop;
+
+		__vlan_hwaccel_put_tag(skb, vlan_dev_vlan_id(dev) |
+							   ((skb->priority & 0x7) << VLAN_PRIO_SHIFT));
+	}
+
+	if (unlikely(!pskb_may_pull(skb, sizeof(struct goosehdr))))
+		goto goose_rcv_drop;
+
+	goose_stats_frame(dev, ntohs(((struct goosehdr *) skb->data)->appid), skb->len, 1);
+
+	/* Redundant frames: the first copy goes on, without its trailer */
+	prp = goose_prp_rcv(skb);
+	if (unlikely(prp != 0)) {
+		if (prp < 0) {
+			GOOSE_STAT_INC(rx_drop_prp_dup);
+			goto goose_rcv_drop;
+		}
+		if (unlikely(pskb_trim(skb, skb->len - sizeof(struct prp_rct))))
+			goto goose_rcv_drop;
+	}
+	rec_len = sizeof(struct nl_rx_tstamp) + IFNAMSIZ + ETH_HLEN + skb->len;
+
+	/* ACKs of our reliable frames end here, frames using the
+	 * reserved fields otherwise go on
+	 */
+	if (unlikely((((struct goosehdr *) skb->data)->reserv3 == GOOSE_EXT_TYPE_ACK) &&
+				 (ntohs(((struct goosehdr *) skb->data)->len) == sizeof(struct goosehdr)) &&
+				 (skb->pkt_type == PACKET_HOST))) {
+		goose_ack_rcv(skb);
+		goto goose_rcv_drop;
+	}
+
+	/* Early drop of frames nobody wants */
+	if ((filter_count != 0) && goose_filter_drop(skb, dev)) {
+		GOOSE_STAT_INC(rx_drop_filter);
+		goto goose_rcv_drop;
+	}
+
+	/* Reliable frames are ACKed here, without a round trip to user space */
+	if (unlikely(rx_ack && (((struct goosehdr *) skb->data)->reserv3 == GOOSE_EXT_TYPE_ACK_REQ)) &&
+		(((struct goosehdr *) skb->data)->reserv2 != 0) && (skb->pkt_type != PACKET_OTHERHOST))
+		goose_ack_xmit(skb, dev);
+
+	/* Subscribed APPIDs go to their subscribers only */
+	if ((sub_count != 0) && (goose_sub_deliver(skb, dev) == 0))
+		return 0;
+
+	/* RX ring has priority over netlink */
+	if ((rx_ring != NULL) && (goose_rx_ring_put(skb, dev) == 0))
+		goto goose_rcv_drop;
+
+	/* Coalesce the frame with others, it is copied to the pending message */
+	if ((rx_batch_num > 1) && (rx_batch_intvl > 0)) {
+		if (likely(nlmsg_total_size(rec_len) <= NL_RECV_BATCH_LEN)) {
+			batch_skb = goose_rx_batch_add(skb, dev, rec_len);
+			if (batch_skb != NULL)
+				nl_goose_send_to_user(batch_skb);
+			goto goose_rcv_drop;
+		}
+
+		/* Too large to coalesce, keep the order of frames */
+		spin_lock_bh(&rx_batch_lock);
+		batch_skb = goose_rx_batch_take();
+		spin_unlock_bh(&rx_batch_lock);
+		if (batch_skb != NULL)
+			nl_goose_send_to_user(batch_skb);
+	}
+
+	/* Transmit skb to user space */
+	skb = goose_rcv_build_msg(skb, dev);
+	if (likely(skb != NULL))
+		nl_goose_send_to_user(skb);
+	return 0;
+
+goose_rcv_drop:
+	kfree_skb(skb);
+	return 0;
+}
+
+/* 802.1Q packet handler - GOOSE frames tagged in software are
+ * untagged here, keeping their TCI, and go on as untagged ones.
+ */
+static int goose_vlan_rcv(struct sk_buff *skb, struct net_device *dev,
+						  struct packet_type *pt, struct net_device *orin_dev)
+{
+	struct vlan_hdr *vhdr, _vhdr;
+	u16 tci;
+
+	/* Stacked tags are left to the 802.1Q devices */
+	if (dev->priv_flags & IFF_802_1Q_VLAN)
+		goto goose_vlan_rcv_drop;
+
+	/* Look before touching, the skb may be shared */
+	vhdr = skb_header_pointer(skb, 0, VLAN_HLEN, &_vhdr);
+	if ((vhdr == NULL) || (vhdr->h_vlan_encapsulated_proto != htons(ETH_P_GOOSE)))
+		goto goose_vlan_rcv_drop;
+
+	/* The header is moved, it must be ours */
+	skb = skb_share_check(skb, GFP_ATOMIC);
+	if (unlikely(skb == NULL))
+		return 0;
+	if (unlikely(!pskb_may_pull(skb, VLAN_HLEN) || skb_cow_head(skb, 0)))
+		goto goose_vlan_rcv_drop;
+
+	/*
+	 * -------------------------------------------------------------
+	 * | daddr(6) | saddr(6) | 81 00 | TCI | 88 b8 | goose header
+	 * -------------------------------------------------------------
+	 *                               |<- skb->data
+	 * Addresses are moved next to the GOOSE type, as if the frame
+	 * was never tagged.
+	 */
+	tci = ntohs(((struct vlan_hdr *) skb->data)->h_vlan_TCI);
+	skb_pull_rcsum(skb, VLAN_HLEN);
+	memmove(skb->data - ETH_HLEN, skb->data - VLAN_ETH_HLEN, 2 * ETH_ALEN);
+	skb->mac_header += VLAN_HLEN;
+	skb_reset_network_header(skb);
+	skb->protocol = htons(ETH_P_GOOSE);
+	__vlan_hwaccel_put_tag(skb, tci);
+
+	return goose_rcv(skb, dev, pt, orin_dev);
+
+goose_vlan_rcv_drop:
+	kfree_skb(skb);
+	return 0;
+}
+
+static void goose_rx_batch_init(void)
+{
+	tasklet_hrtimer_init(&rx_batch_timer, goose_rx_batch_timer,
+						 CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+}
+
+/* Drop the pending message, recv_active must be 0 */
+static void goose_rx_batch_cleanup(void)
+{
+	tasklet_hrtimer_cancel(&rx_batch_timer);
+	kfree_skb(rx_batch_skb);
+	rx_batch_skb = NULL;
+}
+
+/************************************************************
+ * GOOSE transmission pacing
+ ************************************************************/
+
+/* dev_queue_xmit with accounting, skb->data points to the
+ * link-layer header and the goose header may be in a fragment.
+ */
+static int goose_dev_xmit(struct sk_buff *skb)
+{
+	struct net_device *dev = skb->dev;
+	struct goosehdr *goose_h, _goose_h;
+	unsigned int len = skb->len;
+	unsigned short appid = 0;
+	int ret, ret_b = -1;
+
+	goose_h = skb_header_pointer(skb, skb_network_offset(skb),
+								 sizeof(struct goosehdr), &_goose_h);
+	if (likely(goose_h != NULL))
+		appid = ntohs(goose_h->appid);
+
+	/* Copy on LAN B first, LAN A may be the one which is down */
+	if (unlikely(GOOSE_SKB_CB(skb)->prp))
+		ret_b = goose_prp_xmit_b(skb);
+
+	ret = dev_queue_xmit(skb);
+
+	if (likely(ret == 0))
+		goose_stats_frame(dev, appid, len, 0);
+	else
+		GOOSE_STAT_INC(tx_fail);
+
+	/* A redundant frame is sent if one of the LANs takes it */
+	return (ret_b == 0) ? 0 : ret;
+}
+
+static inline struct hlist_head *goose_pace_bucket(unsigned short appid)
+{
+	return &pace_hash[appid & (GOOSE_PACE_HASH_SIZE - 1)];
+}
+
+/* Tokens of the time elapsed, p->lock must be held */
+static inline void goose_pacer_refill(struct goose_pacer *p)
+{
+	ktime_t now = ktime_get();
+
+	p->credit = min(p->credit + (u64) ktime_to_ns(ktime_sub(now, p->last)), p->depth);
+	p->last = now;
+}
+
+/* Free frames taken from the queue of a bucket, each one holds
+ * its device.
+ */
+static void goose_pacer_purge(struct sk_buff_head *list)
+{
+	struct sk_buff *skb;
+
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		dev_put(skb->dev);
+		kfree_skb(skb);
+	}
+}
+
+/* Pass a frame through bucket p: on to p->next if there is a token
+ * and no frame waits, into the queue otherwise. A queued frame
+ * holds its device until it is sent or dropped.
+ */
+static int goose_pacer_xmit(struct goose_pacer *p, struct sk_buff *skb)
+{
+	struct sk_buff *drop = NULL, *queued = NULL;
+	int ret = NET_XMIT_SUCCESS;
+
+	spin_lock_bh(&p->lock);
+	goose_pacer_refill(p);
+	if (likely(skb_queue_empty(&p->queue) && (p->credit >= p->cost))) {
+		p->credit -= p->cost;
+		p->sent++;
+		spin_unlock_bh(&p->lock);
+		return p->next(skb);
+	}
+
+	/* Overflow: the new frame or the oldest one goes */
+	if (skb_queue_len(&p->queue) >= ACCESS_ONCE(pace_qlen)) {
+		p->dropped++;
+		if (pace_policy == GOOSE_PACE_DROP_OLDEST) {
+			queued = __skb_dequeue(&p->queue);
+		} else {
+			drop = skb;
+			skb = NULL;
+			ret = NET_XMIT_DROP;
+		}
+	}
+
+	if (skb != NULL) {
+		dev_hold(skb->dev);
+		__skb_queue_tail(&p->queue, skb);
+		p->queued++;
+		if (!p->armed) {
+			p->armed = 1;
+			tasklet_hrtimer_start(&p->timer, ns_to_ktime(p->cost - p->credit),
+								  HRTIMER_MODE_REL);
+		}
+	}
+	spin_unlock_bh(&p->lock);
+
+	if (drop != NULL) {
+		GOOSE_STAT_INC(tx_pace_drop);
+		kfree_skb(drop);
+	}
+	if (queued != NULL) {
+		GOOSE_STAT_INC(tx_pace_drop);
+		dev_put(queued->dev);
+		kfree_skb(queued);
+	}
+	return ret;
+}
+
+/* Pacing timer, running in softirq context */
+static enum hrtimer_restart goose_pacer_timer(struct hrtimer *timer)
+{
+	struct goose_pacer *p = container_of(timer, struct goose_pacer, timer.timer);
+	enum hrtimer_restart ret = HRTIMER_NORESTART;
+	struct sk_buff_head list;
+	struct net_device *dev;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&list);
+
+	spin_lock_bh(&p->lock);
+	if (unlikely(p->dead)) {
+		p->armed = 0;
+		spin_unlock_bh(&p->lock);
+		return HRTIMER_NORESTART;
+	}
+
+	goose_pacer_refill(p);
+	while ((p->credit >= p->cost) && ((skb = __skb_dequeue(&p->queue)) != NULL)) {
+		p->credit -= p->cost;
+		p->sent++;
+		__skb_queue_tail(&list, skb);
+	}
+
+	if (skb_queue_empty(&p->queue)) {
+		p->armed = 0;
+	} else {
+		hrtimer_forward_now(timer, ns_to_ktime(p->cost - p->credit));
+		ret = HRTIMER_RESTART;
+	}
+	spin_unlock_bh(&p->lock);
+
+	/* The device is held until the frame is handed over */
+	while ((skb = __skb_dequeue(&list)) != NULL) {
+		dev = skb->dev;
+		p->next(skb);
+		dev_put(dev);
+	}
+
+	return ret;
+}
+
+/* Bucket of the device, then the device */
+static int goose_pace_dev_xmit(struct sk_buff *skb)
+{
+	struct goose_pacer *p;
+	int i, ret;
+
+	rcu_read_lock();
+	for (i = 0; i < GOOSE_PACE_DEVS; i++) {
+		p = rcu_dereference(pace_devs[i]);
+		if ((p != NULL) && (ACCESS_ONCE(p->ifindex) == skb->dev->ifindex)) {
+			ret = goose_pacer_xmit(p, skb);
+			rcu_read_unlock();
+			return ret;
+		}
+	}
+	rcu_read_unlock();
+
+	return goose_dev_xmit(skb);
+}
+
+/* dev_queue_xmit through the buckets of the APPID and of the
+ * device. Repeats (publication repeats, retransmissions) and other
+ * status traffic are paced. First sends of an event (first frame of
+ * a publication, first send of a reliable frame) and ACKs bypass
+ * the buckets, as do frames of priority pace_trip_pcp or more.
+ * A frame that is queued counts as sent.
+ */
+static int goose_dev_queue_xmit(struct sk_buff *skb)
+{
+	struct goosehdr *goose_h, _goose_h;
+	struct goose_pacer *p;
+	struct hlist_node *pos;
+	unsigned short appid;
+	int ret;
+
+	if (likely(pace_count == 0))
+		return goose_dev_xmit(skb);
+
+	if (GOOSE_SKB_CB(skb)->first || (skb->priority >= ACCESS_ONCE(pace_trip_pcp))) {
+		GOOSE_STAT_INC(tx_pace_trips);
+		return goose_dev_xmit(skb);
+	}
+
+	goose_h = skb_header_pointer(skb, skb_network_offset(skb),
+								 sizeof(struct goosehdr), &_goose_h);
+	appid = (goose_h != NULL) ? ntohs(goose_h->appid) : 0;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(p, pos, goose_pace_bucket(appid), node) {
+		if (p->appid == appid) {
+			ret = goose_pacer_xmit(p, skb);
+			rcu_read_unlock();
+			return ret;
+		}
+	}
+	rcu_read_unlock();
+
+	return goose_pace_dev_xmit(skb);
+}
+
+/* (Re)configure a bucket, burst frames may go at once */
+static void goose_pacer_set(struct goose_pacer *p, unsigned int rate, unsigned int burst)
+{
+	spin_lock_bh(&p->lock);
+	p->rate = rate;
+	p->burst = burst;
+	p->cost = NSEC_PER_SEC / rate;
+	p->depth = p->cost * burst;
+	if (p->credit > p->depth)
+		p->credit = p->depth;
+	spin_unlock_bh(&p->lock);
+}
+
+static struct goose_pacer *goose_pacer_new(unsigned int rate, unsigned int burst,
+										   int (*next)(struct sk_buff *skb))
+{
+	struct goose_pacer *p = kzalloc(sizeof(struct goose_pacer), GFP_KERNEL);
+
+	if (unlikely(p == NULL))
+		return NULL;
+
+	spin_lock_init(&p->lock);
+	skb_queue_head_init(&p->queue);
+	tasklet_hrtimer_init(&p->timer, goose_pacer_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	p->next = next;
+	goose_pacer_set(p, rate, burst);
+	p->credit = p->depth;
+	p->last = ktime_get();
+
+	return p;
+}
+
+/* Free a bucket nobody can find any more, with its queue */
+static void goose_pacer_free(struct goose_pacer *p)
+{
+	spin_lock_bh(&p->lock);
+	p->dead = 1;
+	spin_unlock_bh(&p->lock);
+
+	synchronize_rcu();
+
+	/* A timer running before dead was set may restart once */
+	tasklet_hrtimer_cancel(&p->timer);
+	tasklet_hrtimer_cancel(&p->timer);
+
+	goose_pacer_purge(&p->queue);
+	kfree(p);
+}
+
+/* Set the bucket of device name, remove it if rate is 0 */
+static int goose_pace_set_dev(const char *name, unsigned int rate, unsigned int burst)
+{
+	struct goose_pacer *p = NULL;
+	char buf[IFNAMSIZ];
+	int i, ifindex, free = -1;
+
+	/* Before pace_mutex, which the notifier takes under RTNL */
+	goose_bind_dev(buf, &ifindex, name);
+
+	mutex_lock(&pace_mutex);
+	for (i = 0; i < GOOSE_PACE_DEVS; i++) {
+		if (pace_devs[i] == NULL) {
+			free = (free < 0) ? i : free;
+		} else if (strcmp(pace_devs[i]->dev_name, buf) == 0) {
+			p = pace_devs[i];
+			break;
+		}
+	}
+
+	if (p != NULL) {
+		if (rate != 0) {
+			goose_pacer_set(p, rate, burst);
+		} else {
+			rcu_assign_pointer(pace_devs[i], NULL);
+			pace_count--;
+			goose_pacer_free(p);
+		}
+		mutex_unlock(&pace_mutex);
+		return 0;
+	}
+
+	if ((rate == 0) || (free < 0)) {
+		mutex_unlock(&pace_mutex);
+		return (rate == 0) ? -ENOENT : -ENOSPC;
+	}
+
+	p = goose_pacer_new(rate, burst, goose_dev_xmit);
+	if (unlikely(p == NULL)) {
+		mutex_unlock(&pace_mutex);
+		return -ENOMEM;
+	}
+	strlcpy(p->dev_name, buf, IFNAMSIZ);
+	p->ifindex = ifindex;
+	rcu_assign_pointer(pace_devs[free], p);
+	pace_count++;
+	mutex_unlock(&pace_mutex);
+
+	return 0;
+}
+
+/* Set the bucket of the APPID, remove it if rate is 0 */
+static int goose_pace_set_appid(unsigned short appid, unsigned int rate, unsigned int burst)
+{
+	struct goose_pacer *p;
+	struct hlist_node *pos;
+
+	mutex_lock(&pace_mutex);
+	hlist_for_each_entry(p, pos, goose_pace_bucket(appid), node) {
+		if (p->appid != appid)
+			continue;
+
+		if (rate != 0) {
+			goose_pacer_set(p, rate, burst);
+		} else {
+			hlist_del_rcu(&p->node);
+			pace_count--;
+			goose_pacer_free(p);
+		}
+		mutex_unlock(&pace_mutex);
+		return 0;
+	}
+
+	if (rate == 0) {
+		mutex_unlock(&pace_mutex);
+		return -ENOENT;
+	}
+
+	p = goose_pacer_new(rate, burst, goose_pace_dev_xmit);
+	if (unlikely(p == NULL)) {
+		mutex_unlock(&pace_mutex);
+		return -ENOMEM;
+	}
+	p->appid = appid;
+	hlist_add_head_rcu(&p->node, goose_pace_bucket(appid));
+	pace_count++;
+	mutex_unlock(&pace_mutex);
+
+	return 0;
+}
+
+/* Drop the frames of dev waiting in p */
+static void goose_pacer_flush(struct goose_pacer *p, struct net_device *dev)
+{
+	struct sk_buff_head list;
+	struct sk_buff *skb, *n;
+
+	__skb_queue_head_init(&list);
+
+	spin_lock_bh(&p->lock);
+	skb_queue_walk_safe(&p->queue, skb, n) {
+		if (skb->dev == dev) {
+			__skb_unlink(skb, &p->queue);
+			__skb_queue_tail(&list, skb);
+		}
+	}
+	spin_unlock_bh(&p->lock);
+
+	goose_pacer_purge(&list);
+}
+
+/* Netdevice events: a device going down loses its waiting frames,
+ * device buckets follow their names. Runs under RTNL.
+ */
+static void goose_pace_netdev(struct net_device *dev, unsigned long event)
+{
+	struct goose_pacer *p;
+	struct hlist_node *pos;
+	int i;
+
+	if (pace_count == 0)
+		return;
+
+	mutex_lock(&pace_mutex);
+	for (i = 0; i < GOOSE_PACE_DEVS; i++) {
+		p = pace_devs[i];
+		if (p == NULL)
+			continue;
+		if ((event == NETDEV_DOWN) || (event == NETDEV_UNREGISTER))
+			goose_pacer_flush(p, dev);
+		if (event != NETDEV_DOWN)
+			goose_netdev_follow(dev, event, p->dev_name, &p->ifindex);
+	}
+
+	if ((event == NETDEV_DOWN) || (event == NETDEV_UNREGISTER))
+		for (i = 0; i < GOOSE_PACE_HASH_SIZE; i++)
+			hlist_for_each_entry(p, pos, &pace_hash[i], node)
+				goose_pacer_flush(p, dev);
+	mutex_unlock(&pace_mutex);
+}
+
+static int goose_pacer_show(char *page, size_t size, const char *kind, const char *name,
+							struct goose_pacer *p)
+{
+	return scnprintf(page, size, "%s %s rate %u burst %u sent %lu queued %lu dropped %lu backlog %u\n",
+					 kind, name, p->rate, p->burst, p->sent, p->queued, p->dropped,
+					 skb_queue_len(&p->queue));
+}
+
+static int read_pace(char *page, char **start, off_t off, int count, int *eof, void *data)
+{
+	struct goose_pacer *p;
+	struct hlist_node *pos;
+	char appid[8];
+	int len = 0, i;
+
+	len += sprintf(page + len, "trip_pcp %u qlen %u policy %s\n", pace_trip_pcp, pace_qlen,
+				   (pace_policy == GOOSE_PACE_DROP_OLDEST) ? "drop_oldest" : "queue");
+
+	rcu_read_lock();
+	for (i = 0; i < GOOSE_PACE_DEVS; i++) {
+		p = rcu_dereference(pace_devs[i]);
+		if (p != NULL)
+			len += goose_pacer_show(page + len, PAGE_SIZE - len, "dev", p->dev_name, p);
+	}
+	for (i = 0; i < GOOSE_PACE_HASH_SIZE; i++) {
+		hlist_for_each_entry_rcu(p, pos, &pace_hash[i], node) {
+			sprintf(appid, "%u", p->appid);
+			len += goose_pacer_show(page + len, PAGE_SIZE - len, "appid", appid, p);
+		}
+	}
+	rcu_read_unlock();
+
+	*eof = 1;
+	return len;
+}
+
+/* See GOOSE_PACE_XXX for the commands */
+static ssize_t write_pace(struct file *filp, const char __user *buff, unsigned long len, void *data)
+{
+	char buf[PROC_PACE_BUFLEN], name[IFNAMSIZ];
+	unsigned int val, rate, burst = 0;
+	int ret = -EINVAL, n;
+
+	if (len > PROC_PACE_BUFLEN - 1)
+		return -1;
+	if (copy_from_user(buf, buff, len) > 0)
+		return -1;
+	buf[len] = 0;
+
+	/* burst may be left out when removing a bucket */
+	if ((n = sscanf(buf, "dev %15s %u %u", name, &rate, &burst)) >= 2) {
+		if ((rate <= NSEC_PER_SEC) && ((rate == 0) || ((n == 3) && (burst > 0))))
+			ret = goose_pace_set_dev(name, rate, burst);
+	} else if ((n = sscanf(buf, "appid %u %u %u", &val, &rate, &burst)) >= 2) {
+		if ((val < 65536) && (rate <= NSEC_PER_SEC) && ((rate == 0) || ((n == 3) && (burst > 0))))
+			ret = goose_pace_set_appid(val, rate, burst);
+	} else if (sscanf(buf, "trip_pcp %u", &val) == 1) {
+		if (val <= 8) {    /* 8: no trips */
+			ACCESS_ONCE(pace_trip_pcp) = val;
+			ret = 0;
+		}
+	} else if (sscanf(buf, "qlen %u", &val) == 1) {
+		if (val > 0) {
+			ACCESS_ONCE(pace_qlen) = val;
+			ret = 0;
+		}
+	} else if (strncmp(buf, "policy drop_oldest", 18) == 0) {
+		ACCESS_ONCE(pace_policy) = GOOSE_PACE_DROP_OLDEST;
+		ret = 0;
+	} else if (strncmp(buf, "policy queue", 12) == 0) {
+		ACCESS_ONCE(pace_policy) = GOOSE_PACE_QUEUE;
+		ret = 0;
+	}
+
+	return (ret != 0) ? ret : len;
+}
+
+/* Remove all buckets, tran_active must be 0 */
+static void goose_pace_cleanup(void)
+{
+	struct goose_pacer *p;
+	struct hlist_node *pos, *n;
+	int i;
+
+	mutex_lock(&pace_mutex);
+	for (i = 0; i < GOOSE_PACE_HASH_SIZE; i++) {
+		hlist_for_each_entry_safe(p, pos, n, &pace_hash[i], node) {
+			hlist_del_rcu(&p->node);
+			goose_pacer_free(p);
+		}
+	}
+	for (i = 0; i < GOOSE_PACE_DEVS; i++) {
+		p = pace_devs[i];
+		if (p != NULL) {
+			rcu_assign_pointer(pace_devs[i], NULL);
+			goose_pacer_free(p);
+		}
+	}
+	pace_count = 0;
+	mutex_unlock(&pace_mutex);
+}
+
+/* GOOSE Enhanced retransmission mechanism.
+ *
+ * The original skb is kept in the in-flight table and a clone of
+ * it is transmitted on every attempt:
+ *
+ *   xmit -> wait retran_intvl -> xmit -> wait (+ retran_incre) -> ...
+ *
+ * until the overall waiting time reaches delay_thre or the number of
+ * retransmissions reaches MAX_GOOSE_TRANS_NUM. Parameters are a
+ * snapshot of the profile of the APPID when the message is submitted.
+ *
+ * Reliable frames carry a sequence number in reserv2 and receivers
+ * answer each of them with an ACK (see goose_ack_xmit). The schedule
+ * stops early when the frame got its ACKs: one for a unicast frame,
+ * the acks of the profile for a multicast one. Once the destination
+ * has an RTT estimate, the first waiting time is its RTO instead of
+ * retran_intvl.
+ */
+
+static inline ktime_t goose_ms_to_ktime(unsigned int ms)
+{
+	return ktime_set(ms / MSEC_PER_SEC, (ms % MSEC_PER_SEC) * NSEC_PER_MSEC);
+}
+
+static inline int goose_retrans_xmit(struct sk_buff *skb)
+{
+	struct sk_buff *skb_cl = unlikely(GOOSE_SKB_CB(skb)->prp) ?
+		goose_prp_renew(skb) : skb_clone(skb, GFP_ATOMIC);
+
+	if (unlikely(skb_cl == NULL))
+		return -ENOMEM;
+
+	return goose_dev_queue_xmit(skb_cl);
+}
+
+static inline ktime_t goose_us_to_ktime(unsigned int us)
+{
+	return ktime_set(us / USEC_PER_SEC, (us % USEC_PER_SEC) * NSEC_PER_USEC);
+}
+
+static inline struct goose_rtt *goose_rtt_slot(const unsigned char *addr)
+{
+	return &rtt_tbl[((addr[4] << 8) | addr[5]) & (GOOSE_RTT_SLOTS - 1)];
+}
+
+/* Take an RTT sample of addr, retrans_lock must be held */
+static void goose_rtt_update(const unsigned char *addr, unsigned int rtt)
+{
+	struct goose_rtt *r = goose_rtt_slot(addr);
+	unsigned int delta;
+
+	rtt = max(rtt, 1U);
+	if ((r->srtt == 0) || (compare_ether_addr(r->addr, addr) != 0)) {
+		memcpy(r->addr, addr, ETH_ALEN);
+		r->srtt = rtt;
+		r->rttvar = rtt / 2;
+		return;
+	}
+
+	delta = (r->srtt > rtt) ? r->srtt - rtt : rtt - r->srtt;
+	r->rttvar = r->rttvar - (r->rttvar >> 2) + (delta >> 2);
+	r->srtt = r->srtt - (r->srtt >> 3) + (rtt >> 3);
+}
+
+/* RTO of addr in us, 0 if there is no estimate. retrans_lock must
+ * be held.
+ */
+static unsigned int goose_rtt_rto(const unsigned char *addr)
+{
+	struct goose_rtt *r = goose_rtt_slot(addr);
+
+	if ((r->srtt == 0) || (compare_ether_addr(r->addr, addr) != 0))
+		return 0;
+
+	return r->srtt + max(4 * r->rttvar, (unsigned int) GOOSE_ACK_RTO_MIN);
+}
+
+/* Compute the overall delay and the next waiting time */
+static inline void goose_retrans_step(struct goose_retrans_entry *ent)
+{
+	ent->total_waiting_time += ent->waiting_time;
+	ent->waiting_time += ent->retran_incre;
+	if (ent->waiting_time > ent->max_retran_intvl)
+		ent->waiting_time = ent->max_retran_intvl;
+}
+
+static void goose_retrans_release(struct goose_retrans_entry *ent)
+{
+	dev_put(ent->skb->dev);
+	kfree_skb(ent->skb);
+	ent->skb = NULL;
+
+	spin_lock_bh(&retrans_lock);
+	ent->done = 1;
+	spin_unlock_bh(&retrans_lock);
+}
+
+/* Retransmission timer, running in softirq context */
+static enum hrtimer_restart goose_retrans_timer(struct hrtimer *timer)
+{
+	struct goose_retrans_entry *ent =
+		container_of(timer, struct goose_retrans_entry, timer.timer);
+
+	if (unlikely(!tran_active))
+		goto goose_retrans_timer_release;
+
+	/* All ACKs are in, nothing more to send */
+	if (ACCESS_ONCE(ent->acked)) {
+		GOOSE_STAT_INC(retrans_acked);
+		goto goose_retrans_timer_done;
+	}
+
+	/* It is necessary to set an upper limit for number of retransmissions */
+	if ((ent->total_waiting_time >= ent->delay_thre) ||
+		(ent->trans_count++ >= MAX_GOOSE_TRANS_NUM))
+		goto goose_retrans_timer_done;
+
+	GOOSE_STAT_INC(retrans_attempts);
+	if (unlikely(goose_retrans_xmit(ent->skb) != 0))
+		goto goose_retrans_timer_release;
+
+	goose_retrans_step(ent);
+	hrtimer_forward_now(timer, goose_us_to_ktime(ent->waiting_time));
+	return HRTIMER_RESTART;
+
+goose_retrans_timer_done:
+	/* Retransmission finishes.
+	 * Increase the number of packets transmitted by Enhanced Transmission */
+	GOOSE_STAT_INC(retrans_done);
+
+goose_retrans_timer_release:
+	goose_retrans_release(ent);
+	return HRTIMER_NORESTART;
+}
+
+int goose_enhan_retrans(struct sk_buff *skb)
+{
+	struct goose_retrans_entry *ent = NULL;
+	struct goosehdr *goose_h = NULL;
+	struct goose_param_t param;
+	unsigned int acks, rto = 0;
+	int i, ret, reuse = 0;
+
+	/* The sequence number goes in place, the frame is linear and
+	 * ours on every reliable path; otherwise no ACK is asked.
+	 */
+	if (likely(!skb_cloned(skb) &&
+			   (skb_headlen(skb) >= skb_network_offset(skb) + sizeof(struct goosehdr))))
+		goose_h = (struct goosehdr *) skb_network_header(skb);
+
+	goose_profile_of_appid((goose_h != NULL) ? ntohs(goose_h->appid) : 0, &param, &acks);
+
+	spin_lock_bh(&retrans_lock);
+	for (i = 0; i < MAX_GOOSE_INFLIGHT; i++) {
+		if (!retrans_tbl[i].in_use || retrans_tbl[i].done) {
+			ent = &retrans_tbl[i];
+			reuse = ent->in_use;
+			ent->in_use = 1;
+			ent->done = 0;
+			break;
+		}
+	}
+
+	if (likely(ent != NULL)) {
+		ent->seq = 0;
+		ent->appid = 0;
+		if (likely(goose_h != NULL)) {
+			if (++retrans_seq == 0)
+				retrans_seq = 1;
+			ent->seq = goose_h->reserv2 = retrans_seq;
+			goose_h->reserv3 = GOOSE_EXT_TYPE_ACK_REQ;
+			ent->appid = goose_h->appid;
+		}
+		memcpy(ent->daddr, eth_hdr(skb)->h_dest, ETH_ALEN);
+		ent->acks = is_multicast_ether_addr(ent->daddr) ? acks : 1;
+		ent->ack_count = 0;
+		ent->acked = 0;
+		ent->trans_count = 0;
+		ent->sent = ktime_get();    /* an ACK may come before xmit returns */
+		rto = (ent->acks != 0) ? goose_rtt_rto(ent->daddr) : 0;
+	}
+	spin_unlock_bh(&retrans_lock);
+
+	/* Too many reliable messages in flight, transmit it only once */
+	if (unlikely(ent == NULL)) {
+		DEBUG_print("in-flight table is full, no retransmission.\n");
+		return goose_dev_queue_xmit(skb);
+	}
+
+	/* The timer of the last schedule may still be returning */
+	if (reuse)
+		tasklet_hrtimer_cancel(&ent->timer);
+
+	/* skb->dev must stay until the schedule finishes */
+	dev_hold(skb->dev);
+	ent->skb = skb;
+	ent->waiting_time = param.intvl_init * USEC_PER_MSEC;
+	ent->total_waiting_time = 0;
+	ent->delay_thre = param.thresh * USEC_PER_MSEC;
+	ent->retran_incre = param.intvl_incre * USEC_PER_MSEC;
+	ent->max_retran_intvl = param.intvl_max * USEC_PER_MSEC;
+
+	/* An ACK is expected after one RTO */
+	if (rto != 0)
+		ent->waiting_time = min(rto, max(ent->max_retran_intvl, ent->waiting_time));
+
+	ret = goose_retrans_xmit(skb);
+	if (unlikely(ret != 0)) {
+		goose_retrans_release(ent);
+		return ret;
+	}
+
+	/* Retransmissions are repeats, they are paced */
+	GOOSE_SKB_CB(skb)->first = 0;
+
+	goose_retrans_step(ent);
+	tasklet_hrtimer_start(&ent->timer, goose_us_to_ktime(ent->waiting_time),
+						  HRTIMER_MODE_REL);
+	return 0;
+}
+
+/* ACK of a reliable frame, skb->data points to its goose header.
+ * Each receiver is counted once: it ACKs retransmitted and
+ * redundant copies again. Frames that were not retransmitted give
+ * an RTT sample.
+ */
+static void goose_ack_rcv(struct sk_buff *skb)
+{
+	struct goosehdr *goose_h = (struct goosehdr *) skb->data;
+	const unsigned char *saddr = eth_hdr(skb)->h_source;
+	struct goose_retrans_entry *ent;
+	unsigned int i, j;
+
+	GOOSE_STAT_INC(ack_rx);
+	if ((goose_h->reserv2 == 0) || (skb->pkt_type != PACKET_HOST))
+		return;
+
+	spin_lock_bh(&retrans_lock);
+	for (i = 0; i < MAX_GOOSE_INFLIGHT; i++) {
+		ent = &retrans_tbl[i];
+		if (!ent->in_use || ent->done ||
+			(ent->seq != goose_h->reserv2) || (ent->appid != goose_h->appid))
+			continue;
+
+		for (j = 0; j < ent->ack_count; j++)
+			if (compare_ether_addr(ent->ackers[j], saddr) == 0)
+				break;
+		if ((j < ent->ack_count) || (ent->ack_count == GOOSE_ACK_MAX_SRC))
+			break;
+		memcpy(ent->ackers[ent->ack_count++], saddr, ETH_ALEN);
+
+		if (ACCESS_ONCE(ent->trans_count) == 0)
+			goose_rtt_update(ent->daddr, (unsigned int) ktime_us_delta(ktime_get(), ent->sent));
+		if ((ent->acks != 0) && (ent->ack_count >= ent->acks))
+			ent->acked = 1;
+		break;
+	}
+	spin_unlock_bh(&retrans_lock);
+}
+
+/* ACK a reliable frame to its sender, on the device it came from,
+ * with the tag and priority of its APPID.
+ */
+static void goose_ack_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+	struct goosehdr *goose_h = (struct goosehdr *) skb->data;
+	struct sk_buff *ack;
+
+	ack = alloc_skb(GOOSE_LL_SPACE(dev) + sizeof(struct goosehdr), GFP_ATOMIC);
+	if (unlikely(ack == NULL))
 		return;
+	skb_reserve(ack, GOOSE_LL_SPACE(dev));
+	skb_reset_network_header(ack);
+
+	memcpy(skb_put(ack, sizeof(struct goosehdr)), goose_h, sizeof(struct goosehdr));
+	goose_h = (struct goosehdr *) ack->data;
+	goose_h->len = htons(sizeof(struct goosehdr));
+	goose_h->reserv1 = 0;
+	goose_h->reserv3 = GOOSE_EXT_TYPE_ACK;
+	goose_h->reserv4 = 0;
+
+	if (goose_xmit_frame(dev, eth_hdr(skb)->h_source, ack, 0, 1) == 0)
+		GOOSE_STAT_INC(ack_tx);
+}
+
+static void goose_retrans_init(void)
+{
+	int i;
+
+	for (i = 0; i < MAX_GOOSE_INFLIGHT; i++)
+		tasklet_hrtimer_init(&retrans_tbl[i].timer, goose_retrans_timer,
+							 CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+}
+
+/* Stop all pending retransmissions, tran_active must be 0 and
+ * no sender may be left.
+ */
+static void goose_retrans_cleanup(void)
+{
+	int i;
+
+	for (i = 0; i < MAX_GOOSE_INFLIGHT; i++) {
+		tasklet_hrtimer_cancel(&retrans_tbl[i].timer);
+		if (retrans_tbl[i].in_use && !retrans_tbl[i].done)
+			goose_retrans_release(&retrans_tbl[i]);
+		retrans_tbl[i].in_use = 0;
+		retrans_tbl[i].done = 0;
+	}
+}
+
+/* GOOSE transmission function.
+ * In order to provide more efficiency, we manipulate the netlink skb
+ * to form the new skb to transmit.
+ */
+
+int goose_trans_skb(struct net_device *dev, unsigned char *daddr,
+					struct sk_buff *__skb, int reliablity)
+{
+	struct sk_buff *skb = __skb;
+	unsigned int skb_pull_len = NLMSG_LENGTH(0) + sizeof(struct nl_data_header);
+
+	if (unlikely((dev == NULL) || (!tran_active)))
+		goto goose_trans_skb_fail;
+	
+	/* We use existing skb to form a new one:
+	 *
+	 * skb:
+	 * old skb->data                      new skb->data
+	 *   |                                  |
+	 * -----------------------------------------------------------
+	 *   | NLMSG_LENGTH(0) | nl_data_header | goose header | APDU
+	 * -----------------------------------------------------------
+	 *   | <==      skb_pull_len        ==> |
+	 * 
+	 */		
+	skb_pull(skb, skb_pull_len);
+	skb_reset_network_header(skb);
+
+	/* But after pulling, if we have still no enough space for link-layer header,
+	   we have to reconstruct a new skb */
+	if (skb_headroom(skb) < GOOSE_LL_SPACE(dev)) {
+		skb = skb_copy_expand(__skb, GOOSE_LL_SPACE(dev), 16, GFP_ATOMIC);
+		kfree_skb(__skb);
+		GOOSE_STAT_INC(tx_realloc);
+	}
+
+	return goose_xmit_frame(dev, daddr, skb, reliablity, reliablity);
+
+goose_trans_skb_fail:
+	kfree_skb(skb);
+	return -1;
+}
+
+/* Fill link-layer header and transmit a frame, skb->data points
+ * to the goose header and there is enough headroom for the
+ * link-layer header. first is set for the first send of an event
+ * (see goose_dev_queue_xmit).
+ */
+
+int goose_xmit_frame(struct net_device *dev, unsigned char *daddr,
+					 struct sk_buff *skb, int reliablity, int first)
+{
+	struct goosehdr *goose_h, _goose_h;
+	int tagged, prp;
+	u16 tci;
+
+	if (unlikely((skb == NULL) || (!tran_active)))
+		goto goose_xmit_frame_fail;
+
+	goose_h = skb_header_pointer(skb, 0, sizeof(struct goosehdr), &_goose_h);
+	if (unlikely(goose_h == NULL))
+		goto goose_xmit_frame_fail;
+
+	/* Specify protocol type and frame information */
+	skb->dev = dev;
+	skb->protocol = ETH_P_GOOSE;
+	skb->pkt_type = PACKET_OUTGOING;
+	skb->csum = 0;
+	skb->ip_summed = 0;
+
+	/* PCP of the APPID is the priority, for the qdisc or the
+	 * priority to TX queue map (mqprio, taprio) of the device.
+	 */
+	tagged = goose_vlan_get(ntohs(goose_h->appid), &tci);
+	skb->priority = tci >> VLAN_PRIO_SHIFT;
+
+	/* Frames larger than the device takes are never sent */
+	prp = goose_prp_lan_a(dev);
+	if (unlikely(skb->len + (prp ? sizeof(struct prp_rct) : 0) > dev->mtu)) {
+		GOOSE_STAT_INC(tx_drop_mtu);
+		goto goose_xmit_frame_fail;
+	}
+
+	/* Frames of LAN A get a trailer, and go to LAN B as well */
+	GOOSE_SKB_CB(skb)->prp = 0;
+	GOOSE_SKB_CB(skb)->first = first;
+	if (unlikely(prp)) {
+		skb = goose_prp_put_rct(skb);
+		if (unlikely(skb == NULL))
+			return -1;
+		GOOSE_SKB_CB(skb)->prp = 1;
+	}
+	
+	if (unlikely(dev_hard_header(skb, dev, ETH_P_GOOSE, daddr, dev->dev_addr, skb->len) < 0))
+		goto goose_xmit_frame_fail;
+	skb_reset_mac_header(skb);
+
+	/* Tag by the NIC if it can, in the headroom otherwise */
+	if (tagged) {
+		if (dev->features & NETIF_F_HW_VLAN_TX) {
+			skb = __vlan_hwaccel_put_tag(skb, tci);
+		} else {
+			skb = __vlan_put_tag(skb, tci);
+			if (unlikely(skb == NULL))
+				return -1;
+		}
+	}
+
+	/* If the message should be transmitted by GOOSE Enhanced Retransmission Mechanism,
+	   call goose_enhan_retrans, otherwise transmit it directly.*/
+	return reliablity ? goose_enhan_retrans(skb):goose_dev_queue_xmit(skb);
+	
+goose_xmit_frame_fail:
+	kfree_skb(skb);
+	return -1;
+}
+
+/************************************************************
+ * GOOSE publications
+ ************************************************************/
+
+static inline struct hlist_head *goose_pub_bucket(unsigned short appid)
+{
+	return &pub_hash[appid & (GOOSE_PUB_HASH_SIZE - 1)];
+}
+
+/* BER length at p, return the size of the length field, 0 if it
+ * is not a short or 1-2 byte long form.
+ */
+static int goose_ber_get_len(unsigned char *p, unsigned int avail, unsigned int *len)
+{
+	if ((avail >= 1) && (p[0] < 0x80)) {
+		*len = p[0];
+		return 1;
+	}
+	if ((avail >= 2) && (p[0] == 0x81)) {
+		*len = p[1];
+		return 2;
+	}
+	if ((avail >= 3) && (p[0] == 0x82)) {
+		*len = (p[1] << 8) | p[2];
+		return 3;
+	}
+	return 0;
+}
+
+static inline int goose_ber_len_size(unsigned int len)
+{
+	return (len < 0x80) ? 1 : ((len < 0x100) ? 2 : 3);
+}
+
+static void goose_ber_put_len(unsigned char *p, unsigned int len)
+{
+	if (len < 0x80) {
+		p[0] = len;
+	} else if (len < 0x100) {
+		p[0] = 0x81;
+		p[1] = len;
+	} else {
+		p[0] = 0x82;
+		p[1] = len >> 8;
+		p[2] = len & 0xff;
+	}
+}
+
+/* Find sqNum ([6] INTEGER, tag 0x86) among the fields of the
+ * goosePdu ([APPLICATION 1], tag 0x61) and read its value.
+ * Return the offset of its tag in pub->frame, or 0.
+ */
+static unsigned int goose_pub_find_sqnum(struct goose_pub *pub)
+{
+	unsigned char *f = pub->frame;
+	unsigned int pos = sizeof(struct goosehdr), end, len, i;
+	int n;
+
+	if ((pos >= pub->len) || (f[pos] != 0x61))
+		return 0;
+	n = goose_ber_get_len(f + pos + 1, pub->len - pos - 1, &len);
+	if ((n == 0) || (pos + 1 + n + len > pub->len))
+		return 0;
+	pos += 1 + n;
+	end = pos + len;
+
+	while (pos + 2 <= end) {
+		n = goose_ber_get_len(f + pos + 1, end - pos - 1, &len);
+		if ((n == 0) || (pos + 1 + n + len > end))
+			return 0;
+
+		if (f[pos] == 0x86) {
+			if ((n != 1) || (len == 0) || (len > 5))
+				return 0;
+			pub->sqnum = 0;
+			for (i = 0; i < len; i++)
+				pub->sqnum = (pub->sqnum << 8) | f[pos + 2 + i];
+			return pos;
+		}
+		pos += 1 + n + len;
+	}
+
+	return 0;
+}
+
+/* Write pub->sqnum in the frame. The INTEGER keeps its minimal
+ * encoding, the fields behind it move when its size changes.
+ */
+static void goose_pub_put_sqnum(struct goose_pub *pub)
+{
+	unsigned char *f = pub->frame, val[5];
+	unsigned int hdr = sizeof(struct goosehdr), pdu_len, tail;
+	int n = 0, old_n, delta, ls_old, ls_new, i;
+
+	/* Minimal two's complement of a positive value */
+	for (i = 24; i >= 0; i -= 8)
+		if ((n != 0) || ((pub->sqnum >> i) & 0xff) || (i == 0)) {
+			if ((n == 0) && ((pub->sqnum >> i) & 0x80))
+				val[n++] = 0;
+			val[n++] = (pub->sqnum >> i) & 0xff;
+		}
+
+	old_n = f[pub->sq_off + 1];
+	delta = n - old_n;
+
+	if (unlikely(delta != 0)) {
+		ls_old = goose_ber_get_len(f + hdr + 1, pub->len - hdr - 1, &pdu_len);
+		ls_new = goose_ber_len_size(pdu_len + delta);
+		if (pub->len + delta + (ls_new - ls_old) > pub->size)
+			return;
+
+		/* Fields after sqNum */
+		tail = pub->sq_off + 2 + old_n;
+		memmove(f + tail + delta, f + tail, pub->len - tail);
+		f[pub->sq_off + 1] = n;
+		pub->len += delta;
+
+		/* Length of the goosePdu */
+		if (ls_new != ls_old) {
+			memmove(f + hdr + 1 + ls_new, f + hdr + 1 + ls_old, pub->len - hdr - 1 - ls_old);
+			pub->len += ls_new - ls_old;
+			pub->sq_off += ls_new - ls_old;
+		}
+		goose_ber_put_len(f + hdr + 1, pdu_len + delta);
+		((struct goosehdr *) f)->len = htons(pub->len);
+	}
+
+	memcpy(f + pub->sq_off + 2, val, n);
+}
+
+/* Copy the current frame of a publication into an skb for its
+ * device, which is held in *dev; daddr receives the destination.
+ */
+static struct sk_buff *goose_pub_copy(struct goose_pub *pub, struct net_device **dev,
+									  unsigned char *daddr)
+{
+	struct sk_buff *skb;
+
+	*dev = goose_dev_get(pub->ifindex);
+	if (unlikely(*dev == NULL))
+		return NULL;
+
+	spin_lock_bh(&pub->lock);
+	skb = alloc_skb(GOOSE_LL_SPACE(*dev) + pub->len, GFP_ATOMIC);
+	if (likely(skb != NULL)) {
+		skb_reserve(skb, GOOSE_LL_SPACE(*dev));
+		memcpy(skb_put(skb, pub->len), pub->frame, pub->len);
+		skb_reset_network_header(skb);
+	}
+	memcpy(daddr, pub->daddr, ETH_ALEN);
+	spin_unlock_bh(&pub->lock);
+
+	if (unlikely(skb == NULL))
+		dev_put(*dev);
+	return skb;
+}
+
+/* Send the current frame of a publication */
+static int goose_pub_xmit(struct goose_pub *pub)
+{
+	struct net_device *dev;
+	struct sk_buff *skb;
+	unsigned char daddr[ETH_ALEN];
+
+	skb = goose_pub_copy(pub, &dev, daddr);
+	if (unlikely(skb == NULL))
+		return -ENOMEM;
+
+	goose_xmit_frame(dev, daddr, skb, 0, 0);
+	dev_put(dev);
+	return 0;
+}
+
+/* Repetition timer, running in softirq context */
+static enum hrtimer_restart goose_pub_timer(struct hrtimer *timer)
+{
+	struct goose_pub *pub = container_of(timer, struct goose_pub, timer.timer);
+	unsigned int intvl, max_intvl = max_t(unsigned int, tran_intvl, 1);
+
+	spin_lock_bh(&pub->lock);
+	if (unlikely(pub->stopped)) {
+		spin_unlock_bh(&pub->lock);
+		return HRTIMER_NORESTART;
+	}
+
+	/* sqNum rolls over to 1, 0 is the first frame after a change */
+	if (pub->sq_off != 0) {
+		pub->sqnum = (pub->sqnum == 0xffffffff) ? 1 : pub->sqnum + 1;
+		goose_pub_put_sqnum(pub);
+	}
+
+	pub->intvl = min(pub->intvl * 2, max_intvl);
+	intvl = pub->intvl;
+	spin_unlock_bh(&pub->lock);
+
+	if (likely(tran_active)) {
+		GOOSE_STAT_INC(pub_repeats);
+		goose_pub_xmit(pub);
+	}
+
+	hrtimer_forward_now(timer, goose_ms_to_ktime(intvl));
+	return HRTIMER_RESTART;
+}
+
+static struct goose_pub *goose_pub_find(unsigned short appid, int ifindex)
+{
+	struct goose_pub *pub;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry(pub, pos, goose_pub_bucket(appid), node)
+		if ((pub->appid == appid) && (pub->ifindex == ifindex))
+			return pub;
+	return NULL;
+}
+
+/* Stop the timer of an unhashed publication and free it,
+ * in process context.
+ */
+static void goose_pub_free(struct goose_pub *pub)
+{
+	spin_lock_bh(&pub->lock);
+	pub->stopped = 1;
+	spin_unlock_bh(&pub->lock);
+
+	/* A repetition running during the first cancel may restart
+	 * the timer, the second one sees pub->stopped.
+	 */
+	tasklet_hrtimer_cancel(&pub->timer);
+	tasklet_hrtimer_cancel(&pub->timer);
+	kfree(pub);
+}
+
+static void goose_pub_reap(struct work_struct *work)
+{
+	struct goose_pub *pub, *n;
+	LIST_HEAD(reap);
+
+	spin_lock_bh(&pub_lock);
+	list_splice_init(&pub_reap_list, &reap);
+	spin_unlock_bh(&pub_lock);
+
+	list_for_each_entry_safe(pub, n, &reap, reap)
+		goose_pub_free(pub);
+}
+
+/* Remove all publications of pid, in atomic context */
+static void goose_pub_del(u32 pid)
+{
+	struct goose_pub *pub;
+	struct hlist_node *pos, *n;
+	int i, found = 0;
+
+	spin_lock_bh(&pub_lock);
+	for (i = 0; i < GOOSE_PUB_HASH_SIZE; i++) {
+		hlist_for_each_entry_safe(pub, pos, n, &pub_hash[i], node) {
+			if (pub->pid != pid)
+				continue;
+			hlist_del(&pub->node);
+			list_add_tail(&pub->reap, &pub_reap_list);
+			pub_count--;
+			found = 1;
+		}
+	}
+	spin_unlock_bh(&pub_lock);
+
+	if (found)
+		schedule_work(&pub_reap_work);
+}
+
+/* Set or stop a publication of pid, see struct nl_pub_header.
+ * nlmsg_len is the payload length, as for all single messages.
+ */
+static int goose_pub_ctrl(u32 pid, struct nlmsghdr *nlh)
+{
+	struct nl_pub_header *nl_pub_h = (struct nl_pub_header *) NLMSG_DATA(nlh);
+	struct nl_data_header *nl_data_h = (struct nl_data_header *) (nl_pub_h + 1);
+	struct goosehdr *goose_h = (struct goosehdr *) (nl_data_h + 1);
+	struct goose_pub *pub, *new_pub = NULL;
+	struct net_device *dev;
+	struct sk_buff *skb = NULL;
+	unsigned char daddr[ETH_ALEN];
+	unsigned int len, size, hdr_len = sizeof(struct nl_pub_header) + sizeof(struct nl_data_header);
+	unsigned short appid;
+	int ifindex;
 
-	nlh = nlmsg_hdr(skb);
+	if (nlh->nlmsg_len < hdr_len + sizeof(struct goosehdr))
+		return -EINVAL;
+	len = nlh->nlmsg_len - hdr_len;
+	if (len > GOOSE_MAX_FRAME_LEN)
+		return -EMSGSIZE;
 
-	/* Message is reporting pid ? */
-	if (unlikely(nlh->nlmsg_type == NL_MSG_REPORT_TO_MODULE)) {
-		user_pid = nlh->nlmsg_pid;
-		printk("GOOSE: registered user_pid = %d \n", user_pid);
-		goto read_from_user_return;
+	dev = nl_goose_get_dev(nl_data_h);
+	if (dev == NULL)
+		return -ENODEV;
+	ifindex = dev->ifindex;
+	size = dev->mtu;
+	dev_put(dev);
+	if (len > size)
+		return -EMSGSIZE;
+	size = max_t(unsigned int, size, ETH_DATA_LEN);
+	if (size > GOOSE_MAX_FRAME_LEN)
+		size = GOOSE_MAX_FRAME_LEN;
+	appid = ntohs(goose_h->appid);
+
+	if (nl_pub_h->op == GOOSE_PUB_STOP) {
+		spin_lock_bh(&pub_lock);
+		pub = goose_pub_find(appid, ifindex);
+		if ((pub != NULL) && (pub->pid == pid)) {
+			hlist_del(&pub->node);
+			pub_count--;
+		} else {
+			pub = NULL;
+		}
+		spin_unlock_bh(&pub_lock);
+
+		if (pub == NULL)
+			return -ENOENT;
+		goose_pub_free(pub);
+		return 0;
 	}
 
-	/* Message is ctrl-type? */
-	if (unlikely(nlh->nlmsg_type & NL_MSG_CTRL)) {
-		nl_ctrl_h = (struct nl_ctrl_header *) (NLMSG_DATA(nlh));
-		
-		/* Set default device */
-		if (nl_ctrl_h->def_dev[0] != 0) {
-			def_dev = dev_get_by_name(&init_net, nl_ctrl_h->def_dev);			
-			if (unlikely(def_dev == NULL))
-				printk("GOOSE: Can not find %s, choose another device.\n",  nl_ctrl_h->def_dev);
-			else
-				printk("GOOSE: Change default network device to %s.\n",  nl_ctrl_h->def_dev);		   
-		}
-
-		/* Set GOOSE parameters */
-		delay_thre       = nl_ctrl_h->goose_param.thresh;
-		retran_intvl     = nl_ctrl_h->goose_param.intvl_init;
-		max_retran_intvl = nl_ctrl_h->goose_param.intvl_max;
-		retran_incre     = nl_ctrl_h->goose_param.intvl_incre;
-		
-		goto read_from_user_return;
+	if (nl_pub_h->op != GOOSE_PUB_SET)
+		return -EINVAL;
+
+	new_pub = kzalloc(sizeof(struct goose_pub) + size, GFP_KERNEL);
+	if (new_pub == NULL)
+		return -ENOMEM;
+
+	spin_lock_bh(&pub_lock);
+	pub = goose_pub_find(appid, ifindex);
+	if (pub == NULL) {
+		if (pub_count >= MAX_GOOSE_PUB) {
+			spin_unlock_bh(&pub_lock);
+			kfree(new_pub);
+			return -ENOSPC;
+		}
+		pub = new_pub;
+		new_pub = NULL;
+		spin_lock_init(&pub->lock);
+		tasklet_hrtimer_init(&pub->timer, goose_pub_timer,
+							 CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		pub->pid = pid;
+		pub->appid = appid;
+		pub->ifindex = ifindex;
+		pub->size = size;
+		hlist_add_head(&pub->node, goose_pub_bucket(appid));
+		pub_count++;
+	} else if (pub->pid != pid) {
+		spin_unlock_bh(&pub_lock);
+		kfree(new_pub);
+		return -EBUSY;
+	} else if (len > pub->size) {
+		/* The MTU grew since, stop and set it again */
+		spin_unlock_bh(&pub_lock);
+		kfree(new_pub);
+		return -EMSGSIZE;
 	}
-	
-	/* Then, message should be data */
-	nl_data_h = (struct nl_data_header *) NLMSG_DATA(nlh);
-	data = (unsigned char *) (NLMSG_DATA(nlh) + sizeof(struct nl_data_header));
-	data_len = nlh->nlmsg_len - sizeof(struct nl_data_header);
 
-	/* Obtain transmission device */
-	trans_dev = (nl_data_h->dev_name[0] != 0) ?
-		dev_get_by_name(&init_net, nl_data_h->dev_name)
-		: def_dev;
-	
-	if (unlikely(trans_dev == NULL))
-		goto read_from_user_return;
+	/* State change: new frame, schedule from t1 */
+	spin_lock(&pub->lock);
+	memcpy(pub->frame, goose_h, len);
+	pub->len = len;
+	((struct goosehdr *) pub->frame)->len = htons(len);
+	memcpy(pub->daddr, nl_data_h->daddr, ETH_ALEN);
+	pub->t1 = (nl_pub_h->t1 != 0) ? nl_pub_h->t1 : DEF_PUB_T1;
+	pub->intvl = pub->t1;
+	pub->sq_off = goose_pub_find_sqnum(pub);
+	spin_unlock(&pub->lock);
 
-	/* Should message be broadcasted ? */
-	if (unlikely(nlh->nlmsg_type & NL_MSG_DATA_BRDCAST)) {		
-		goose_trans_skb(trans_dev, trans_dev->broadcast, skb,
-						((nlh->nlmsg_type & NL_MSG_DATA_RELB) != 0));
-		goto read_from_user_exit; 
-	} 
+	tasklet_hrtimer_start(&pub->timer, goose_ms_to_ktime(pub->t1), HRTIMER_MODE_REL);
 
-	/* Then, message should be unicasted */
-	goose_trans_skb(trans_dev, nl_data_h->daddr, skb,
-					((nlh->nlmsg_type & NL_MSG_DATA_RELB) != 0));
-	goto read_from_user_exit;
-	
-read_from_user_return:	
-	kfree_skb(skb);
-	
-read_from_user_exit:
-	return;
-}
+	/* Copy the frame while pub can not be stopped, send it
+	 * once pub_lock is released.
+	 */
+	if (tran_active)
+		skb = goose_pub_copy(pub, &dev, daddr);
+	spin_unlock_bh(&pub_lock);
 
+	if (skb != NULL) {
+		goose_xmit_frame(dev, daddr, skb, 0, 1);
+		dev_put(dev);
+	}
 
-/*
- * Send data to user space
- */
+	kfree(new_pub);
+	return 0;
+}
 
-static inline int nl_goose_send_to_user (struct sk_buff *skb)
+/* Stop all publications, once no message or notifier can come */
+static void goose_pub_cleanup(void)
 {
-	netlink_unicast(nl_sk, skb, user_pid, MSG_DONTWAIT);
-	return 0;
+	struct goose_pub *pub;
+	struct hlist_node *pos, *n;
+	LIST_HEAD(reap);
+	int i;
+
+	spin_lock_bh(&pub_lock);
+	for (i = 0; i < GOOSE_PUB_HASH_SIZE; i++) {
+		hlist_for_each_entry_safe(pub, pos, n, &pub_hash[i], node) {
+			hlist_del(&pub->node);
+			list_add_tail(&pub->reap, &pub_reap_list);
+		}
+	}
+	pub_count = 0;
+	spin_unlock_bh(&pub_lock);
+
+	cancel_work_sync(&pub_reap_work);
+	goose_pub_reap(NULL);
 }
 
-/* Netline interface: creating and registering */
-static int netlink_init(void)
+/************************************************************
+ * Shared memory RX ring device: /dev/goose_rx
+ ************************************************************/
+
+/* Only one consumer is allowed */
+static int goose_rx_ring_open(struct inode *inode, struct file *filp)
 {
-	nl_sk = netlink_kernel_create(&init_net, NETLINK_GOOSE,
-								  0, nl_goose_read_from_user, NULL, THIS_MODULE);
-	
-	if (!nl_sk) {
-		if (nl_sk != NULL)
-    		sock_release(nl_sk->sk_socket);
-		return -1;
+	struct goose_ring_hdr *ring;
+
+	if (atomic_cmpxchg(&rx_ring_users, 0, 1) != 0)
+		return -EBUSY;
+
+	ring = (struct goose_ring_hdr *) vmalloc_user(GOOSE_RX_RING_SIZE);
+	if (ring == NULL) {
+		atomic_set(&rx_ring_users, 0);
+		return -ENOMEM;
 	}
 
+	ring->slot_num = GOOSE_RX_RING_SLOTS;
+	ring->slot_size = GOOSE_RING_SLOT_SIZE;
+	filp->private_data = ring;
+
+	spin_lock_bh(&rx_ring_lock);
+	rx_ring = ring;
+	spin_unlock_bh(&rx_ring_lock);
+
+	printk("GOOSE: RX ring is open.\n");
 	return 0;
+}
+
+/* Called when the last mapping and file reference are gone */
+static int goose_rx_ring_release(struct inode *inode, struct file *filp)
+{
+	spin_lock_bh(&rx_ring_lock);
+	rx_ring = NULL;
+	spin_unlock_bh(&rx_ring_lock);
 
+	vfree(filp->private_data);
+	atomic_set(&rx_ring_users, 0);
+
+	printk("GOOSE: RX ring is closed.\n");
+	return 0;
 }
 
-/************************************************************
- * GOOSE protocol
- ************************************************************/
+static int goose_rx_ring_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	return remap_vmalloc_range(vma, filp->private_data, vma->vm_pgoff);
+}
 
-/* GOOSE packet handler - recevie */
-int goose_rcv(struct sk_buff *skb, struct net_device *dev,
-			  struct packet_type *pt, struct net_device *orin_dev)
+static unsigned int goose_rx_ring_poll(struct file *filp, poll_table *wait)
 {
-	int ret = -1;
-		
-	if (unlikely(!recv_active))
-		goto goose_rcv_end;
+	struct goose_ring_hdr *ring = (struct goose_ring_hdr *) filp->private_data;
 
-	/* We use existing skb to form a new one:
-	 *
-	 * skb:
-	 * new skb->data                                   old skb->data
-	 *   |                                                  |
-	 * -----------------------------------------------------------
-	 *   | IFNAMESIZ  bytes | daddr(6) | saddr(6) | type(2) | data
-	 * -----------------------------------------------------------
-	 *   |<-- can form a struct nl_data_header -->|
-	 * 
-	 */
-	skb_push(skb, 14 + IFNAMSIZ);
-	
-	/* Then, we write the dev_name to nl_data_header->dev_name */
-	strcpy(skb->data, dev->name);
+	poll_wait(filp, &rx_ring_wait, wait);
 
-	/* Transmit skb to user space */
-	ret = nl_goose_send_to_user(skb);	
+	if (ACCESS_ONCE(ring->prod) != ACCESS_ONCE(ring->cons))
+		return POLLIN | POLLRDNORM;
 
-goose_rcv_end:
-	if (unlikely(ret != 0))
-		kfree_skb(skb);
-	
 	return 0;
 }
 
-/* GOOSE Enhanced retransmission mechanism.
- */
+static const struct file_operations goose_rx_ring_fops = {
+	.owner   = THIS_MODULE,
+	.open    = goose_rx_ring_open,
+	.release = goose_rx_ring_release,
+	.mmap    = goose_rx_ring_mmap,
+	.poll    = goose_rx_ring_poll,
+};
+
+static struct miscdevice goose_rx_ring_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name  = GOOSE_RX_RING_DEV,
+	.fops  = &goose_rx_ring_fops,
+};
+
+/************************************************************
+ * Shared memory TX ring device: /dev/goose_tx
+ ************************************************************/
 
-int goose_enhan_retrans(struct sk_buff *__skb)
+static inline struct goose_tx_slot *goose_tx_slot(unsigned int idx)
+{
+	return (struct goose_tx_slot *) ((unsigned char *) tx_ring + GOOSE_RING_HDR_SIZE +
+									 idx * GOOSE_RING_SLOT_SIZE);
+}
+
+/* Transmit one slot.
+ * The frame is copied into the skb: veth, packet taps and clones
+ * of reliable frames may keep it after the skb is freed or
+ * orphaned, while user space refills the slot.
+ */
+static int goose_tx_ring_xmit(unsigned int idx)
 {
-	struct sk_buff *skb_cp, *skb = __skb;
-	unsigned int waiting_time = retran_intvl; /* ms */
-	unsigned int total_waiting_time = 0; /* ms */
-	unsigned trans_count = 0;
+	struct goose_tx_slot *slot = goose_tx_slot(idx);
+	unsigned char *data = (unsigned char *) (slot + 1);
+	unsigned int len = slot->len;
+	unsigned short msg_type = slot->msg_type;
+	int ifindex = slot->ifindex;
+	int reliablity = ((msg_type & NL_MSG_DATA_RELB) != 0);
+	struct net_device *dev;
+	struct sk_buff *skb;
 	int ret;
 
-goose_enhan_retrans_redo:
-	
-	/* Make a skb copy for retransmission */
-	skb_cp = skb_copy(skb, GFP_ATOMIC);	
-	ret = dev_queue_xmit(skb);
-	skb = skb_cp;
-	
-	if (unlikely(ret != 0))
-		goto goose_enhan_retrans_exit;		
+	if (unlikely((len < sizeof(struct goosehdr)) || (len > GOOSE_TX_SLOT_DATALEN)))
+		return -EINVAL;
 
-    /* Compute the overall delay */
-	total_waiting_time += waiting_time;
-	waiting_time += retran_incre;
-	if (waiting_time > max_retran_intvl)
-		waiting_time = max_retran_intvl;
+	dev = goose_dev_get(ifindex);
+	if (unlikely(dev == NULL))
+		return -ENODEV;
 
-    /* Sleep for a while */
-	msleep_interruptible (waiting_time);	
+	skb = alloc_skb(GOOSE_LL_SPACE(dev) + len, GFP_KERNEL);
+	if (unlikely(skb == NULL)) {
+		ret = -ENOMEM;
+		goto goose_tx_ring_xmit_end;
+	}
+	skb_reserve(skb, GOOSE_LL_SPACE(dev));
+	memcpy(skb_put(skb, len), data, len);
+	skb_reset_network_header(skb);
 
-    /* It is necessary to set an upper limit for number of retransmissions */
-	if (unlikely((total_waiting_time < delay_thre) && (trans_count++ < MAX_GOOSE_TRANS_NUM)))
-		goto goose_enhan_retrans_redo;
-		
-    /* Retransmission finishes.
-	 * Increase the number of packets transmitted by Enhanced Transmission */
-	num_pkt_trans ++;
-	
-goose_enhan_retrans_exit:
-	kfree_skb(skb);
+	ret = goose_xmit_frame(dev, (msg_type & NL_MSG_DATA_BRDCAST) ?
+						   dev->broadcast : slot->daddr, skb, reliablity, reliablity);
+	if (ret > 0)
+		ret = net_xmit_errno(ret);
+
+goose_tx_ring_xmit_end:
+	dev_put(dev);
 	return ret;
 }
 
-/* GOOSE transmission function.
- * In order to provide more efficiency, we manipulate the netlink skb
- * to form the new skb to transmit.
+/* Doorbell: transmit all requested slots, in order.
+ * Return value is the number of slots taken.
  */
+static long goose_tx_ring_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+	struct goose_tx_slot *slot;
+	unsigned int idx;
+	long num = 0;
 
-int goose_trans_skb(struct net_device *dev, unsigned char *daddr,
-					struct sk_buff *__skb, int reliablity)
+	if (cmd != GOOSE_IOC_TX_KICK)
+		return -ENOTTY;
+
+	mutex_lock(&tx_ring_mutex);
+
+	while (num < GOOSE_TX_RING_SLOTS) {
+		idx = tx_ring_head & (GOOSE_TX_RING_SLOTS - 1);
+		slot = goose_tx_slot(idx);
+
+		if (ACCESS_ONCE(slot->flags) != GOOSE_TX_SLOT_REQUEST)
+			break;
+
+		/* Read the slot only after its flags */
+		smp_rmb();
+		slot->flags = GOOSE_TX_SLOT_SENDING;
+
+		slot->status = goose_tx_ring_xmit(idx);
+
+		/* Status must be visible before the slot is given back */
+		smp_wmb();
+		slot->flags = GOOSE_TX_SLOT_AVAILABLE;
+
+		tx_ring_head++;
+		num++;
+	}
+
+	mutex_unlock(&tx_ring_mutex);
+	return num;
+}
+
+/* Only one producer is allowed */
+static int goose_tx_ring_open(struct inode *inode, struct file *filp)
 {
-	struct sk_buff *skb = __skb;
-	unsigned int skb_pull_len = NLMSG_LENGTH(0) + sizeof(struct nl_data_header);
+	struct goose_ring_hdr *ring;
 
-	if (unlikely((dev == NULL) || (!tran_active)))
-		goto goose_trans_skb_fail;
-	
-	/* We use existing skb to form a new one:
-	 *
-	 * skb:
-	 * old skb->data                      new skb->data
-	 *   |                                  |
-	 * -----------------------------------------------------------
-	 *   | NLMSG_LENGTH(0) | nl_data_header | goose header | APDU
-	 * -----------------------------------------------------------
-	 *   | <==      skb_pull_len        ==> |
-	 * 
-	 */		
-	skb_pull(skb, skb_pull_len);
-	skb_reset_network_header(skb);
+	if (atomic_cmpxchg(&tx_ring_users, 0, 1) != 0)
+		return -EBUSY;
 
-	/* But after pulling, if we have still no enough space for link-layer header,
-	   we have to reconstruct a new skb */
-	if ((skb->head - skb->network_header) < LL_RESERVED_SPACE(dev)) {
-		skb = skb_copy_expand(__skb, LL_RESERVED_SPACE(dev), 16, GFP_ATOMIC);
-		kfree_skb(__skb);
+	ring = (struct goose_ring_hdr *) vmalloc_user(GOOSE_TX_RING_SIZE);
+	if (ring == NULL) {
+		atomic_set(&tx_ring_users, 0);
+		return -ENOMEM;
 	}
 
-	/* Specify protocol type and frame information */
-	skb->dev = dev;
-	skb->protocol = ETH_P_GOOSE;
-	skb->pkt_type = PACKET_OUTGOING;
-	skb->csum = 0;
-	skb->ip_summed = 0;
+	ring->slot_num = GOOSE_TX_RING_SLOTS;
+	ring->slot_size = GOOSE_RING_SLOT_SIZE;
+	filp->private_data = ring;
 
-	/* Set the highest priority */
-	skb->priority = 0;
-	
-	if (unlikely(dev_hard_header(skb, dev, ETH_P_GOOSE, daddr, dev->dev_addr, skb->len) < 0))
-		goto goose_trans_skb_fail;
+	tx_ring_head = 0;
+	tx_ring = ring;
 
-	/* If the message should be transmitted by GOOSE Enhanced Retransmission Mechanism,
-	   call goose_enhan_retrans, otherwise transmit it directly.*/
-	return reliablity ? goose_enhan_retrans(skb):dev_queue_xmit(skb);
-	
-goose_trans_skb_fail:
-	kfree_skb(skb);
-	return -1;
+	printk("GOOSE: TX ring is open.\n");
+	return 0;
+}
+
+/* Called when the last mapping and file reference are gone,
+ * no kick is running and no frame refers to the ring memory.
+ */
+static int goose_tx_ring_release(struct inode *inode, struct file *filp)
+{
+	tx_ring = NULL;
+	vfree(filp->private_data);
+	atomic_set(&tx_ring_users, 0);
+
+	printk("GOOSE: TX ring is closed.\n");
+	return 0;
 }
 
+static int goose_tx_ring_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	return remap_vmalloc_range(vma, filp->private_data, vma->vm_pgoff);
+}
+
+static const struct file_operations goose_tx_ring_fops = {
+	.owner          = THIS_MODULE,
+	.open           = goose_tx_ring_open,
+	.release        = goose_tx_ring_release,
+	.mmap           = goose_tx_ring_mmap,
+	.unlocked_ioctl = goose_tx_ring_ioctl,
+};
+
+static struct miscdevice goose_tx_ring_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name  = GOOSE_TX_RING_DEV,
+	.fops  = &goose_tx_ring_fops,
+};
+
 /************************************************************
  * GOOSE daemon program.
  ************************************************************/
@@ -475,6 +4146,47 @@ static int daemon(void* arg)
 	return 0;
 }
 
+/* Remove the proc_fs entries that were created */
+static void proc_fs_cleanup(void)
+{
+	if (proc_def_dev  != NULL)
+		remove_proc_entry(PROC_FNAME_DEF_DEV,  proc_dir);
+	if (proc_tran_intvl != NULL)
+		remove_proc_entry(PROC_FNAME_TRAN_INTVL, proc_dir);
+	if (proc_delay_thre != NULL)
+		remove_proc_entry(PROC_FNAME_DELAY_THRE, proc_dir);
+	if (proc_retran_intvl != NULL)
+		remove_proc_entry(PROC_FNAME_RETRAN_INTVL, proc_dir);
+	if (proc_retran_incre != NULL)
+		remove_proc_entry(PROC_FNAME_RETRAN_INCRE, proc_dir);
+	if (proc_max_retran_intvl != NULL)
+		remove_proc_entry(PROC_FNAME_MAX_RETRAN_INTVL, proc_dir);	
+	if (proc_rx_batch_num != NULL)
+		remove_proc_entry(PROC_FNAME_RX_BATCH_NUM, proc_dir);
+	if (proc_rx_batch_intvl != NULL)
+		remove_proc_entry(PROC_FNAME_RX_BATCH_INTVL, proc_dir);
+	if (proc_filter != NULL)
+		remove_proc_entry(PROC_FNAME_FILTER, proc_dir);
+	if (proc_stats != NULL)
+		remove_proc_entry(PROC_FNAME_STATS, proc_dir);
+	if (proc_vlan_tag != NULL)
+		remove_proc_entry(PROC_FNAME_VLAN_TAG, proc_dir);
+	if (proc_vlan_id != NULL)
+		remove_proc_entry(PROC_FNAME_VLAN_ID, proc_dir);
+	if (proc_vlan_pcp != NULL)
+		remove_proc_entry(PROC_FNAME_VLAN_PCP, proc_dir);
+	if (proc_prp_lan_a != NULL)
+		remove_proc_entry(PROC_FNAME_PRP_LAN_A, proc_dir);
+	if (proc_prp_lan_b != NULL)
+		remove_proc_entry(PROC_FNAME_PRP_LAN_B, proc_dir);
+	if (proc_profiles != NULL)
+		remove_proc_entry(PROC_FNAME_PROFILES, proc_dir);
+	if (proc_pace != NULL)
+		remove_proc_entry(PROC_FNAME_PACE, proc_dir);
+	if (proc_dir != NULL)
+		remove_proc_entry(PROC_DNAME, NULL);
+}
+
 /************************************************************
  * Module init procedure.
  ************************************************************/
@@ -486,28 +4198,80 @@ static int __init goose_init(void)
 	printk("GOOSE: initiating proc file systems.\n");
 	if (proc_fs_init() != 0) {
 		printk("GOOSE: Fatal error in initializing proc_fs!\n");
-		return -1;
+		goto goose_init_proc_fail;
 	}
 	
+	/* initialize GOOSE Enhanced Retransmission */
+	goose_retrans_init();
+
+	/* initialize coalescing of received frames */
+	goose_rx_batch_init();
+
+	/* initialize duplicate discard of redundant frames */
+	goose_prp_init();
+
 	printk("GOOSE: initiating netlink interface.\n");
 	if (netlink_init() != 0) {
 		printk("GOOSE: Fatal error in initializing netlink!\n");
-		return -1;
+		goto goose_init_proc_fail;
 	}
 
+	/* Follow netlink sockets of subscribers */
+	netlink_register_notifier(&goose_netlink_notifier);
+
+	/* Fill the device registry with the devices that are up */
+	register_netdevice_notifier(&goose_netdev_notifier);
+
 	/* initialize default dev*/
-	def_dev = dev_get_by_name(&init_net, buf_proc_def_dev);
-	
-	if (def_dev == NULL) {
-		printk("GOOSE: Can not find %s, choose another device.\n", buf_proc_def_dev);
+	goose_set_def_dev(buf_proc_def_dev);
+
+	printk("GOOSE: initiating RX ring device.\n");
+	if (misc_register(&goose_rx_ring_dev) != 0) {
+		printk("GOOSE: Fatal error in initializing RX ring device!\n");
+		goto goose_init_nl_fail;
+	}
+
+	printk("GOOSE: initiating TX ring device.\n");
+	if (misc_register(&goose_tx_ring_dev) != 0) {
+		printk("GOOSE: Fatal error in initializing TX ring device!\n");
+		goto goose_init_rx_ring_fail;
 	}
 
+	/* Let the stack timestamp received frames */
+	if (rx_tstamp)
+		net_enable_timestamp();
+
 	/* register GOOSE protocol */
 	dev_add_pack(&goose_packet_type);
+	dev_add_pack(&goose_vlan_packet_type);
 	
 	/* kernel_thread(daemon, NULL, 0); */
 
 	return 0;
+
+	/* Undo in the order of goose_exit, netlink input may have
+	 * set up anything already.
+	 */
+goose_init_rx_ring_fail:
+	misc_deregister(&goose_rx_ring_dev);
+
+goose_init_nl_fail:
+	tran_active = 0;
+	recv_active = 0;
+	sock_release(nl_sk->sk_socket);
+	goose_retrans_cleanup();
+	goose_profile_cleanup();
+	goose_pace_cleanup();
+	goose_filter_cleanup();
+	goose_vlan_cleanup();
+	netlink_unregister_notifier(&goose_netlink_notifier);
+	goose_sub_cleanup();
+	goose_pub_cleanup();
+	unregister_netdevice_notifier(&goose_netdev_notifier);
+
+goose_init_proc_fail:
+	proc_fs_cleanup();
+	return -1;
 }
 
 /************************************************************
@@ -519,26 +4283,50 @@ static void __exit goose_exit(void)
 	recv_active = 0;
 	
 	/* Unregister GOOSE protocol */
+	dev_remove_pack(&goose_vlan_packet_type);
 	dev_remove_pack(&goose_packet_type);
-	
-	/* Delete all proc_fs */
-	if (proc_def_dev  != NULL)
-		remove_proc_entry(PROC_FNAME_DEF_DEV,  proc_dir);
-	if (proc_tran_intvl != NULL)
-		remove_proc_entry(PROC_FNAME_TRAN_INTVL, proc_dir);
-	if (proc_delay_thre != NULL)
-		remove_proc_entry(PROC_FNAME_DELAY_THRE, proc_dir);
-	if (proc_retran_intvl != NULL)
-		remove_proc_entry(PROC_FNAME_RETRAN_INTVL, proc_dir);
-	if (proc_retran_incre != NULL)
-		remove_proc_entry(PROC_FNAME_RETRAN_INCRE, proc_dir);
-	if (proc_max_retran_intvl != NULL)
-		remove_proc_entry(PROC_FNAME_MAX_RETRAN_INTVL, proc_dir);	
-	if (proc_dir != NULL)
-		remove_proc_entry(PROC_DNAME, NULL);
 
+	if (rx_tstamp)
+		net_disable_timestamp();
+
+	/* Drop frames waiting for coalescing, they go out on nl_sk */
+	goose_rx_batch_cleanup();
+
+	/* No more netlink input, so no new reliable message */
 	if (nl_sk != NULL)
     	sock_release(nl_sk->sk_socket);
+
+	/* Stop pending retransmissions */
+	goose_retrans_cleanup();
+
+	/* Reset retransmission profiles */
+	goose_profile_cleanup();
+
+	/* Remove pacing buckets, with the frames they hold */
+	goose_pace_cleanup();
+
+	/* Remove all receiving filters */
+	goose_filter_cleanup();
+
+	/* Remove all VLAN tags of APPIDs */
+	goose_vlan_cleanup();
+
+	/* Remove all subscriptions */
+	netlink_unregister_notifier(&goose_netlink_notifier);
+	goose_sub_cleanup();
+
+	/* Remove RX/TX ring devices */
+	misc_deregister(&goose_rx_ring_dev);
+	misc_deregister(&goose_tx_ring_dev);
+	
+	/* Delete all proc_fs */
+	proc_fs_cleanup();
+
+	/* Stop all publications */
+	goose_pub_cleanup();
+
+	/* No transmission is left to look a device up */
+	unregister_netdevice_notifier(&goose_netdev_notifier);
 		
 	if (dmn_task != NULL)
 		send_sig_info(SIGTERM, (struct siginfo *)1, dmn_task);
@@ -11,7 +11,17 @@
 
 /* Netlink interface, the GOOSE module uses 20 */
 #define NETLINK_GOOSE            20
-#define NL_MAX_DATALEN_ACCEPTED  1000
+
+/* Largest GOOSE frame (goose header + APDU) handled by the module,
+ * the MTU of jumbo frames. A frame larger than the MTU of its
+ * device is refused when it is sent.
+ */
+#define GOOSE_MAX_FRAME_LEN      9000
+
+/* Largest payload of a message from user space:
+ * nl_pub_header, nl_data_header and a frame.
+ */
+#define NL_MAX_DATALEN_ACCEPTED  (64 + GOOSE_MAX_FRAME_LEN)
 
 /* The netlink frame between kernel and user
  *
@@ -22,6 +32,19 @@
  * | nl_data_header | goose_header | APDU ... |
  * --------------------------------------------
  *
+ * GOOSE Data batch (every nlmsghdr has NLM_F_MULTI set and a
+ * standard nlmsg_len, records are NLMSG_ALIGN'ed):
+ * -------------------------------------------------------------------
+ * | nlmsghdr | nl_data_header | goose_header | APDU | nlmsghdr | ... |
+ * -------------------------------------------------------------------
+ * Records with NLM_F_ACK get a struct nlmsgerr (NLMSG_ERROR) back,
+ * records with NL_MSG_DATA_TSTAMP get a struct nl_tx_tstamp
+ * (NL_MSG_TX_TSTAMP) back, all of them in one message to the
+ * sending socket, nlmsg_seq is the one of the record. Only data
+ * records may be batched, others get -EINVAL. If the report can
+ * not be allocated, no record is sent and the reply is a single
+ * nlmsgerr with nlmsg_seq NL_BATCH_SEQ_ALL.
+ *
  * GOOSE Control information
  * ------------------
  * | nl_ctrl_header |
@@ -29,12 +52,16 @@
  *
  * Kernel => User:
  *
- * GOOSE Data:
- * ----------------------------------------------------
- * | nl_data_header | 88 b8 | goose_header | APDU ... |
- * ----------------------------------------------------
- *                      ||
- *              (GOOSE protocol type)
+ * GOOSE Data (nlmsg_type is NL_MSG_DATA_RECV):
+ * ----------------------------------------------------------------------------
+ * | nlmsghdr | nl_rx_tstamp | nl_data_header | 88 b8 | goose_header | APDU ... |
+ * ----------------------------------------------------------------------------
+ *                                              ||
+ *                                      (GOOSE protocol type)
+ *
+ * When coalescing is enabled (rx_batch_num > 1), one message
+ * carries up to rx_batch_num such records, each with NLM_F_MULTI
+ * set and NLMSG_ALIGN'ed, in at most NL_RECV_BATCH_LEN bytes.
  *
  */
 
@@ -51,8 +78,68 @@
 #define NL_MSG_DATA_BRDCAST      0x0002
 #define NL_MSG_DATA_UNICAST      0x0004
 #define NL_MSG_DATA_RELB         0x0008
+#define NL_MSG_DATA_TSTAMP       0x0800   /* report TX time, batches only */
 #define NL_MSG_REPORT_TO_MODULE  0xffff
 
+/* Bits a data record may carry */
+#define NL_MSG_DATA_TYPES        (NL_MSG_DATA_BRDCAST | NL_MSG_DATA_UNICAST | \
+								  NL_MSG_DATA_RELB | NL_MSG_DATA_TSTAMP)
+
+/* Subscription messages carry a nl_sub_header.
+ * Frames of a subscribed APPID go to all its subscribers,
+ * other frames go to the process registered by
+ * NL_MSG_REPORT_TO_MODULE.
+ */
+#define NL_MSG_SUBSCRIBE         0x0100
+#define NL_MSG_UNSUBSCRIBE       0x0200
+
+/* Filter messages carry a nl_filter_header */
+#define NL_MSG_FILTER            0x0400
+
+/* Publication messages carry a nl_pub_header */
+#define NL_MSG_PUBLISH           0x1000
+
+/* VLAN messages carry a nl_vlan_header */
+#define NL_MSG_VLAN              0x2000
+
+/* Reliability profile messages carry a nl_profile_header */
+#define NL_MSG_PROFILE           0x4000
+
+/* Message types sent from kernel to user space */
+#define NL_MSG_DATA_RECV         0x0010
+#define NL_MSG_TX_TSTAMP         0x0020
+
+/* nlmsg_seq of a reply about a whole batch */
+#define NL_BATCH_SEQ_ALL         0xffffffff
+
+/* Maximum size of a message carrying coalesced frames */
+#define NL_RECV_BATCH_LEN        4096
+
+/* Timestamps of a received frame, in ns (CLOCK_REALTIME).
+ * rx is taken by the network stack when the frame reaches the
+ * host (the module's arrival time if the stack has none), queued
+ * when the module hands the frame to user space.
+ * vlan is GOOSE_VLAN_PRESENT | TCI if the frame was 802.1Q tagged,
+ * 0 otherwise.
+ */
+struct nl_rx_tstamp {
+	unsigned long long rx;
+	unsigned long long queued;
+	unsigned int vlan;
+	unsigned int reserved;
+};
+
+#define GOOSE_VLAN_PRESENT       0x10000
+#define GOOSE_VLAN_VID(vlan)     ((vlan) & 0x0fff)
+#define GOOSE_VLAN_PCP(vlan)     (((vlan) >> 13) & 0x7)
+
+/* Transmission report of a record sent with NL_MSG_DATA_TSTAMP */
+struct nl_tx_tstamp {
+	unsigned long long tstamp;   /* in ns, frame handed to the device */
+	int status;                  /* 0, or negative errno */
+	unsigned int reserved;
+};
+
 /* User space control header
  * If message type is NL_MSG_CTRL,
  * the send should transmit a nl_ctrl_header.
@@ -74,12 +161,112 @@ struct nl_ctrl_header {
 	char                  def_dev[IFNAMSIZE];
 };
 
+/* User space subscription header
+ * If message type is NL_MSG_(UN)SUBSCRIBE, the sender should
+ * transmit a nl_sub_header. The subscriber is the sending socket.
+ */
+struct nl_sub_header {
+	unsigned short appid;
+	unsigned char daddr[6];   /* destination MAC to match, all zero for any */
+};
+
+/* User space VLAN header
+ * If message type is NL_MSG_VLAN, the sender should transmit a
+ * nl_vlan_header. GOOSE_VLAN_SET gives frames of the APPID an
+ * 802.1Q tag of vid and pcp, GOOSE_VLAN_DEL gives them back the
+ * default of /proc/goose/vlan_{tag,id,pcp}. The PCP of a frame,
+ * tagged or not, is its skb->priority, which the qdisc or the
+ * mqprio/taprio map of the device turns into a TX queue.
+ * The sender needs CAP_NET_ADMIN.
+ */
+#define GOOSE_VLAN_SET           1
+#define GOOSE_VLAN_DEL           2
+
+struct nl_vlan_header {
+	unsigned short op;          /* GOOSE_VLAN_XXX */
+	unsigned short appid;
+	unsigned short vid;         /* 0 for priority tagged frames */
+	unsigned char pcp;          /* 0 - 7 */
+	unsigned char reserved;
+};
+
+/* User space reliability profile header
+ * If message type is NL_MSG_PROFILE, the sender should transmit a
+ * nl_profile_header. GOOSE_PROFILE_SET gives profile id the
+ * retransmission schedule of goose_param, GOOSE_PROFILE_MAP makes
+ * reliable frames of the APPID follow profile id, which must be set.
+ * acks is the number of receivers whose ACKs stop retransmissions
+ * of a multicast frame, 0 to always run the full schedule (unicast
+ * frames stop on the ACK of their destination).
+ * Profile 0 is the one of APPIDs mapped to no other, that NL_MSG_CTRL
+ * and /proc/goose/{delay_thre,retran_intvl,...} set. All profiles are
+ * shown and may be changed in /proc/goose/profiles.
+ * The sender needs CAP_NET_ADMIN.
+ */
+#define GOOSE_PROFILE_SET        1
+#define GOOSE_PROFILE_MAP        2
+
+#define GOOSE_PROFILES           16
+
+struct nl_profile_header {
+	unsigned short op;          /* GOOSE_PROFILE_XXX */
+	unsigned short appid;       /* GOOSE_PROFILE_MAP */
+	unsigned int id;            /* 0 - GOOSE_PROFILES - 1 */
+	struct goose_param_t goose_param;  /* GOOSE_PROFILE_SET */
+	unsigned int acks;          /* GOOSE_PROFILE_SET, 0 - GOOSE_ACK_MAX_SRC */
+};
+
+/* Size of the VLAN hash table */
+#define GOOSE_VLAN_HASH_BITS     8
+#define GOOSE_VLAN_HASH_SIZE     (1 << GOOSE_VLAN_HASH_BITS)
+
+/* Size of the subscription hash table */
+#define GOOSE_SUB_HASH_BITS      8
+#define GOOSE_SUB_HASH_SIZE      (1 << GOOSE_SUB_HASH_BITS)
+
+/* User space filter header
+ * If message type is NL_MSG_FILTER, the sender should transmit a
+ * nl_filter_header. A device with a filter (or any device, when
+ * there is a filter for all devices) only accepts frames whose
+ * APPID is in the filter and, if the filter has MAC addresses,
+ * whose destination is one of them. Other frames are dropped
+ * before any processing. The sender needs CAP_NET_ADMIN.
+ */
+#define GOOSE_FILTER_ADD_APPID   1   /* add appid_first .. appid_last */
+#define GOOSE_FILTER_DEL_APPID   2   /* remove appid_first .. appid_last */
+#define GOOSE_FILTER_ADD_MAC     3   /* add daddr */
+#define GOOSE_FILTER_DEL_MAC     4   /* remove daddr */
+#define GOOSE_FILTER_CLEAR       5   /* remove the filter */
+
+#define GOOSE_FILTER_MAX_MAC     16
+
+struct nl_filter_header {
+	char dev_name[IFNAMSIZE];   /* empty for all devices */
+	unsigned short op;          /* GOOSE_FILTER_XXX */
+	unsigned short appid_first;
+	unsigned short appid_last;
+	unsigned char daddr[6];
+};
+
 /* User space data header
  * If message type is NL_MSG_DATA_XXX,
  * the send should transmit a nl_data_header, followed by data.
+ *
+ * The transmission device is either given by name, or, when
+ * dev_name[0] is 0, by dev_handle: its ifindex, which the kernel
+ * resolves without a name lookup. A zero handle stands for the
+ * default device, so an all-zero header still means the default.
+ * Received frames always carry the device name.
  */
 struct nl_data_header {
-	char dev_name[IFNAMSIZE]; /* network device name, e.g. "eth0" */		
+	union {
+		char dev_name[IFNAMSIZE]; /* network device name, e.g. "eth0" */
+		struct {
+			char dev_no_name;        /* 0 when dev_handle is used */
+			unsigned char dev_pad[3];
+			unsigned int dev_handle; /* ifindex, 0 for the default device */
+		};
+	};
 	unsigned char daddr[6];   /* 6-byte destination MAC address, If the
 							   * message type is NL_MSG_DATA_BRDCAST, kernel
 							   * will ignore daddr. */
@@ -87,9 +274,127 @@ struct nl_data_header {
 };
 
 
+/* User space publication header
+ * If message type is NL_MSG_PUBLISH, the sender should transmit
+ * -----------------------------------------------------------
+ * | nl_pub_header | nl_data_header | goose_header | APDU ... |
+ * -----------------------------------------------------------
+ * GOOSE_PUB_SET sends the frame to nl_data_header->daddr at once,
+ * then the module repeats it (IEC 61850-8-1 retransmission):
+ *
+ *   change -> t1 -> 2 * t1 -> 4 * t1 -> ... -> tran_intvl -> tran_intvl ...
+ *
+ * increasing sqNum of the goosePdu before each repetition. Another
+ * GOOSE_PUB_SET of the same APPID and device is a state change: it
+ * replaces the frame and restarts the schedule. The publication
+ * ends with GOOSE_PUB_STOP (APDU not needed) or when the sending
+ * socket is closed.
+ */
+#define GOOSE_PUB_SET            1
+#define GOOSE_PUB_STOP           2
+
+struct nl_pub_header {
+	unsigned short op;          /* GOOSE_PUB_XXX */
+	unsigned short t1;          /* ms, 0 for DEF_PUB_T1 */
+};
+
+/* Maximum number of publications, and size of their hash table */
+#define MAX_GOOSE_PUB            4096
+#define GOOSE_PUB_HASH_BITS      8
+#define GOOSE_PUB_HASH_SIZE      (1 << GOOSE_PUB_HASH_BITS)
+
+/* Shared memory RX ring
+ * When /dev/goose_rx is open, received frames are written into a
+ * ring which is mapped to user space, instead of sent by netlink:
+ * ---------------------------------------------------------
+ * | goose_ring_hdr | slot 0 | slot 1 | ... | slot N - 1 |
+ * ---------------------------------------------------------
+ * |<- HDR_SIZE  -->|
+ *
+ * Slot:
+ * ---------------------------------------------------------------------
+ * | goose_ring_slot | nl_data_header | 88 b8 | goose_header | APDU ... |
+ * ---------------------------------------------------------------------
+ *
+ * prod and cons are free running, slot of an index is
+ * (index % slot_num). The kernel advances prod after a slot is
+ * written, user space advances cons after a slot is consumed.
+ * Frames arriving when the ring is full are dropped, frames larger
+ * than a slot go by netlink.
+ */
+#define GOOSE_RX_RING_DEV        "goose_rx"
+#define GOOSE_RING_HDR_SIZE      4096
+#define GOOSE_RING_SLOT_SIZE     2048
+#define GOOSE_RX_RING_SLOTS      256   /* power of 2 */
+#define GOOSE_RX_RING_SIZE       (GOOSE_RING_HDR_SIZE + \
+								  GOOSE_RX_RING_SLOTS * GOOSE_RING_SLOT_SIZE)
+
+struct goose_ring_hdr {
+	unsigned int slot_num;
+	unsigned int slot_size;
+	unsigned int drops;        /* frames dropped, ring is full */
+	unsigned int prod __attribute__((aligned(64)));
+	unsigned int cons __attribute__((aligned(64)));
+};
+
+struct goose_ring_slot {
+	unsigned int len;          /* length of data following the slot header */
+	unsigned int reserved;
+	struct nl_rx_tstamp tstamp;
+};
+
+/* Shared memory TX ring
+ * Same geometry as the RX ring, on /dev/goose_tx. prod and cons of
+ * goose_ring_hdr are not used, each slot carries its owner instead:
+ *
+ * Slot:
+ * ---------------------------------------------
+ * | goose_tx_slot | goose_header | APDU ...   |
+ * ---------------------------------------------
+ *
+ * User space fills slots in order, marks them GOOSE_TX_SLOT_REQUEST,
+ * then kicks the kernel with GOOSE_IOC_TX_KICK. The kernel transmits
+ * the requested slots in order and gives each one back as
+ * GOOSE_TX_SLOT_AVAILABLE with its status, once the frame is copied
+ * and handed to the device, before the kick returns.
+ */
+#define GOOSE_TX_RING_DEV        "goose_tx"
+#define GOOSE_TX_RING_SLOTS      256   /* power of 2 */
+#define GOOSE_TX_RING_SIZE       (GOOSE_RING_HDR_SIZE + \
+								  GOOSE_TX_RING_SLOTS * GOOSE_RING_SLOT_SIZE)
+#define GOOSE_TX_SLOT_DATALEN    (GOOSE_RING_SLOT_SIZE - sizeof(struct goose_tx_slot))
+
+#define GOOSE_TX_SLOT_AVAILABLE  0
+#define GOOSE_TX_SLOT_REQUEST    1
+#define GOOSE_TX_SLOT_SENDING    2
+
+#define GOOSE_IOC_TX_KICK        _IO('g', 1)
+
+struct goose_tx_slot {
+	unsigned int flags;        /* owner, GOOSE_TX_SLOT_XXX */
+	int status;                /* result of transmission, 0 or -errno */
+	int ifindex;               /* transmission device, 0 for default */
+	unsigned int len;          /* length of goose_header + APDU */
+	unsigned short msg_type;   /* NL_MSG_DATA_XXX */
+	unsigned char daddr[6];    /* ignored for NL_MSG_DATA_BRDCAST */
+};
+
 /* Maximum number of retransmissions for GOOSE enhanced retransmission*/
 #define MAX_GOOSE_TRANS_NUM      32
 
+/* Maximum number of reliable messages being retransmitted
+ * at the same time. Messages beyond this limit are sent once.
+ */
+#define MAX_GOOSE_INFLIGHT       128
+
+/* ACKs of reliable frames (see proto_goose.h): receivers counted
+ * per frame, destinations with an RTT estimate (power of 2), and
+ * the lower bound of the RTO added to the smoothed RTT.
+ */
+#define GOOSE_ACK_MAX_SRC        8
+#define GOOSE_RTT_SLOTS          64
+#define GOOSE_ACK_RTO_MIN        200   /* us */
+
 /* Proc_fs name, buffer size, and defaults */
 #define PROC_DNAME                       "goose"
 #define PROC_FNAME_DEF_DEV               "def_dev"
@@ -99,6 +404,17 @@ struct nl_data_header {
 #define PROC_FNAME_RETRAN_INTVL          "retran_intvl"
 #define PROC_FNAME_RETRAN_INCRE          "retran_incre"
 #define PROC_FNAME_MAX_RETRAN_INTVL      "max_retran_intvl"
+#define PROC_FNAME_RX_BATCH_NUM          "rx_batch_num"
+#define PROC_FNAME_RX_BATCH_INTVL        "rx_batch_intvl"
+#define PROC_FNAME_FILTER                "filter"
+#define PROC_FNAME_STATS                 "stats"
+#define PROC_FNAME_VLAN_TAG              "vlan_tag"
+#define PROC_FNAME_VLAN_ID               "vlan_id"
+#define PROC_FNAME_VLAN_PCP              "vlan_pcp"
+#define PROC_FNAME_PRP_LAN_A             "prp_lan_a"
+#define PROC_FNAME_PRP_LAN_B             "prp_lan_b"
+#define PROC_FNAME_PROFILES              "profiles"
+#define PROC_FNAME_PACE                  "pace"
 
 #define PROC_PKT_SIZE_BUFLEN             8
 #define PROC_DEF_DEV_BUFLEN              16
@@ -107,9 +423,15 @@ struct nl_data_header {
 #define PROC_RETRAN_INTVL_BUFLEN         16
 #define PROC_RETRAN_INCRE_BUFLEN         16
 #define PROC_MAX_RETRAN_INTVL_BUFLEN     16
+#define PROC_RX_BATCH_NUM_BUFLEN         16
+#define PROC_RX_BATCH_INTVL_BUFLEN       16
+#define PROC_VLAN_BUFLEN                 16
+#define PROC_PROFILES_BUFLEN             64
+#define PROC_PACE_BUFLEN                 64
 
 /* Default values:
- *  size in (byte), time in (ms).
+ *  size in (byte), time in (ms), except rx_batch_intvl in (us).
+ *  rx_batch_num of 1 disables coalescing of received frames.
  */
 #define DEFBUF_PROC_DEF_DEV    "eth0"
 #define DEF_TRAN_INTVL         5000
@@ -117,6 +439,63 @@ struct nl_data_header {
 #define DEF_RETRAN_INTVL       10
 #define DEF_RETRAN_INCRE       0
 #define DEF_MAX_RETRAN_INTVL   10
+#define DEF_RX_BATCH_NUM       1
+#define DEF_RX_BATCH_INTVL     200
+#define DEF_PUB_T1             4
+
+/* Frames of APPIDs with no nl_vlan_header go untagged unless
+ * vlan_tag is 1, with priority vlan_pcp either way.
+ */
+#define DEF_VLAN_TAG           0
+#define DEF_VLAN_ID            0
+#define DEF_VLAN_PCP           4
+
+/* Redundant transmission (PRP)
+ * When prp_lan_a and prp_lan_b name two devices, every frame sent
+ * on LAN A gets a prp_rct and a copy of it goes out on LAN B.
+ * Receivers keep the first copy of each (source, seq): a sliding
+ * window of GOOSE_PRP_WINDOW sequence numbers for each of up to
+ * GOOSE_PRP_NODES sources, forgotten after GOOSE_PRP_NODE_TIMEOUT.
+ * Writing "none" to prp_lan_a or prp_lan_b stops duplication.
+ */
+#define GOOSE_PRP_WINDOW         64
+#define GOOSE_PRP_NODES          256   /* power of 2 */
+#define GOOSE_PRP_NODE_TIMEOUT   400   /* ms */
+
+/* TX pacing
+ * Token buckets of rate frames/s and burst frames, for devices
+ * (GOOSE_PACE_DEVS at most, followed by name) and APPIDs, set in
+ * /proc/goose/pace:
+ *   dev <name> <rate> [<burst>]  rate 0 removes the bucket
+ *   appid <appid> <rate> [<burst>]
+ *   trip_pcp <pcp>               frames of PCP pcp - 7 bypass buckets
+ *   qlen <frames>                bound of the queue of a bucket
+ *   policy queue|drop_oldest
+ * Publication repeats, retransmissions and frames sent without
+ * reliability are paced. Trips, i.e. the first frame of a
+ * publication and the first send of a reliable frame, bypass the
+ * buckets, as do ACKs and frames of PCP trip_pcp or more.
+ * A paced frame goes through the bucket of its APPID, then the one
+ * of its device. With no token left, it waits in the queue of the bucket;
+ * when the queue is full, the new frame is dropped (queue) or the
+ * oldest one (drop_oldest).
+ */
+#define GOOSE_PACE_DEVS          8
+#define GOOSE_PACE_HASH_BITS     6
+#define GOOSE_PACE_HASH_SIZE     (1 << GOOSE_PACE_HASH_BITS)
+
+#define GOOSE_PACE_QUEUE         0
+#define GOOSE_PACE_DROP_OLDEST   1
+
+#define DEF_PACE_TRIP_PCP        5
+#define DEF_PACE_QLEN            64
+#define DEF_PACE_POLICY          GOOSE_PACE_QUEUE
+
+/* Slots of per-device and per-APPID statistics. Devices or
+ * APPIDs sharing a slot with another one are counted as "other".
+ */
+#define GOOSE_STATS_DEV_SLOTS    32    /* power of 2 */
+#define GOOSE_STATS_APPID_SLOTS  256   /* power of 2 */
 
 /* Deamon loop idle time*/
 #define DAEMON_LOOP_IDLE_TIME  300
@@ -16,12 +16,18 @@
 
 /* In our reliability extention,
  *  reserv1 is used for security type in IEC 62351.
- *  reserv2 is used for sequence number
+ *  reserv2 is used for sequence number, 0 if no ACK is asked
  *  reserv3 is used for marking sequence type:
- *    TYPE_ACK - ack or TYPE_FRAME - transmssion.
+ *    TYPE_ACK - ack, TYPE_FRAME - transmssion or TYPE_ACK_REQ -
+ *    transmission asking receivers for an ACK of seq.
+ * An ACK is the goose header of the frame (APPID and seq), with
+ * len of the header alone and TYPE_ACK, unicast to its sender.
+ * Other frames may use the reserved fields (e.g. IEC 62351-6), so
+ * only unicast frames of that exact form are taken for ACKs.
  */
 #define GOOSE_EXT_TYPE_ACK 0x01
 #define GOOSE_EXT_TYPE_FRAME 0x00
+#define GOOSE_EXT_TYPE_ACK_REQ 0x02
 
 /* GOOSE header */
 struct goosehdr {
@@ -32,5 +38,24 @@ struct goosehdr {
 	unsigned char reserv3;  /* Seq type */
 	unsigned char reserv4;  /* Not used */
 };
+
+/* IEC 62439-3 PRP redundancy control trailer, the last 6 bytes
+ * of a frame sent on both LANs. All fields are in network order:
+ *  seq      - sequence number of the sending node
+ *  lan_size - LAN identifier (4 bits), LSDU size (12 bits): bytes
+ *             following the Ethernet type, including the trailer
+ *  suffix   - PRP_SUFFIX
+ * Frames are padded before the trailer to the Ethernet minimum.
+ */
+#define PRP_SUFFIX 0x88fb
+#define PRP_LAN_A  0xa
+#define PRP_LAN_B  0xb
+#define PRP_MIN_LSDU 46
+
+struct prp_rct {
+	unsigned short seq;
+	unsigned short lan_size;
+	unsigned short suffix;
+};
 	
 #endif  /* _IEC61850_PROTO_GOOSE_H */
@@ -0,0 +1,520 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <net/if.h>
+
+#include "nl_if_goose.h"
+
+/* GOOSE latency/throughput benchmark
+ *
+ * Publisher threads send frames of their own APPID (appid + thread
+ * index) at a given rate; each APDU starts with a bench_stamp. The
+ * subscriber side subscribes these APPIDs and measures one-way
+ * latency (send time to dequeue time), frames/s and loss from the
+ * sequence numbers. Both sides must share the clock, i.e. run on
+ * one host, e.g. over the veth pair of gs_bench_veth.sh.
+ *
+ * Modes:
+ *   loop - publishers and subscriber in one process (default)
+ *   pub  - publishers only
+ *   sub  - subscriber only, start it before the publishers
+ *
+ * Frames sent during the warm-up are not measured.
+ * gs_bench_scale.sh runs the publishers with 1 to N threads,
+ * gs_bench_vlan.sh compares latencies of two PCPs under bulk load.
+ */
+
+#define BENCH_MAX_THREADS  64
+#define BENCH_MAX_BATCH    1024
+#define BENCH_MAGIC        0x47534231   /* "GSB1" */
+#define BENCH_RECV_BATCH   64
+#define BENCH_GRACE_MS     200          /* subscriber keeps receiving after the end */
+
+/* Head of every APDU sent by the benchmark */
+struct bench_stamp {
+	unsigned int magic;
+	unsigned int thread;
+	unsigned long long seq;
+	unsigned long long tstamp;          /* send time in ns, CLOCK_REALTIME */
+};
+
+/* Log-linear histogram in the HdrHistogram way: values below
+ * HIST_SUB are exact, larger ones keep HIST_SUB_BITS - 1
+ * significant bits (< 1% error).
+ */
+#define HIST_SUB_BITS      7
+#define HIST_SUB           (1 << HIST_SUB_BITS)
+#define HIST_LEN           (64 * HIST_SUB / 2)
+
+struct hist {
+	unsigned long long count[HIST_LEN];
+	unsigned long long total, sum, min, max;
+};
+
+static inline unsigned int hist_index(unsigned long long v)
+{
+	unsigned int shift;
+
+	if (v < HIST_SUB)
+		return v;
+	shift = (63 - __builtin_clzll(v)) - HIST_SUB_BITS + 1;
+	return shift * (HIST_SUB / 2) + (unsigned int) (v >> shift);
+}
+
+/* Highest value of a bucket */
+static inline unsigned long long hist_value(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < HIST_SUB)
+		return idx;
+	shift = idx / (HIST_SUB / 2) - 1;
+	return (((unsigned long long) (idx - shift * (HIST_SUB / 2)) + 1) << shift) - 1;
+}
+
+static void hist_record(struct hist *h, unsigned long long v)
+{
+	h->count[hist_index(v)]++;
+	if ((h->total == 0) || (v < h->min))
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	h->total++;
+	h->sum += v;
+}
+
+static unsigned long long hist_percentile(struct hist *h, double pct)
+{
+	unsigned long long want, seen = 0;
+	unsigned int i;
+
+	if (h->total == 0)
+		return 0;
+
+	want = (unsigned long long) (pct / 100.0 * h->total + 0.5);
+	if (want == 0)
+		want = 1;
+
+	for (i = 0; i < HIST_LEN; i++) {
+		seen += h->count[i];
+		if (seen >= want)
+			return (hist_value(i) < h->max) ? hist_value(i) : h->max;
+	}
+
+	return h->max;
+}
+
+/* Benchmark settings */
+static struct {
+	int pub, sub;
+	char *dev;
+	unsigned int rate;                  /* frames/s per publisher, 0 - as fast as possible */
+	unsigned int size;                  /* APDU bytes */
+	unsigned int threads;
+	unsigned int batch;                 /* frames per system call */
+	int reliable;
+	int ring;                           /* publish through the TX ring */
+	int backend;                        /* NL_IF_BACKEND_XXX, others than netlink on dev */
+	unsigned int duration, warmup;      /* s */
+	unsigned short appid;
+	char *format;
+	unsigned char daddr[6];
+	int vlan;                           /* tag the APPIDs with vid and pcp */
+	unsigned int vid, pcp;
+} cfg = {
+	.pub = 1, .sub = 1, .dev = "gs0",
+	.rate = 1000, .size = 100, .threads = 1, .batch = 1,
+	.duration = 10, .warmup = 2, .appid = 0x1000, .format = "json",
+	.daddr = {0x01, 0x0c, 0xcd, 0x01, 0x00, 0x01}   /* GOOSE multicast */
+};
+
+static struct nl_interface nl_if;
+static unsigned long long measure_start, measure_end;   /* CLOCK_REALTIME */
+
+/* Per publisher */
+struct pub_stat {
+	pthread_t tid;
+	unsigned int idx;
+	unsigned long long sent;            /* frames sent in the measurement */
+	unsigned long long errors;
+};
+
+/* Per stream, seen by the subscriber */
+struct sub_stat {
+	unsigned long long first, last;     /* seq of the measurement */
+	unsigned long long recv, dup;
+	unsigned long long tagged;          /* frames received with an 802.1Q tag */
+	int started;
+};
+
+static struct pub_stat pubs[BENCH_MAX_THREADS];
+static struct sub_stat subs[BENCH_MAX_THREADS];
+static struct hist lat;
+
+static inline unsigned long long now_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *publisher(void *arg)
+{
+	struct pub_stat *ps = (struct pub_stat *) arg;
+	struct goose_batch_rec recs[BENCH_MAX_BATCH];
+	struct nl_data_header nl_data_h;
+	struct goosehdr goose_h[BENCH_MAX_BATCH];
+	unsigned char *apdu;
+	struct bench_stamp stamp;
+	struct goose_tx_ring tx_ring;
+	struct nl_tx_ctx tx_ctx;
+	unsigned long long seq = 0, next, period = 0, t;
+	unsigned short msg_type = NL_MSG_DATA_UNICAST | (cfg.reliable ? NL_MSG_DATA_RELB : 0);
+	struct timespec ts;
+	unsigned int i;
+	int ifindex = if_nametoindex(cfg.dev);
+
+	apdu = (unsigned char *) malloc(cfg.batch * cfg.size);
+	memset(apdu, 0xa5, cfg.batch * cfg.size);
+
+	memset(&nl_data_h, 0, sizeof(struct nl_data_header));
+	goose_set_dev(&nl_data_h, cfg.dev);
+	memcpy(nl_data_h.daddr, cfg.daddr, 6);
+
+	for (i = 0; i < cfg.batch; i++) {
+		memset(&goose_h[i], 0, sizeof(struct goosehdr));
+		goose_h[i].appid = htons(cfg.appid + ps->idx);
+		recs[i].nl_data_h = &nl_data_h;
+		recs[i].goose_h = &goose_h[i];
+		recs[i].apdu = apdu + i * cfg.size;
+		recs[i].apdu_len = cfg.size;
+		recs[i].msg_type = msg_type;
+	}
+
+	if (cfg.ring && (goose_tx_ring_open(&tx_ring) != 0)) {
+		ps->errors++;
+		free(apdu);
+		return NULL;
+	}
+
+	/* Batches go through a send context of the thread,
+	 * single frames are sent on nl_if without a lock.
+	 * AF_PACKET batches go through the TX ring of nl_if.
+	 */
+	if (!cfg.ring && (cfg.backend == NL_IF_BACKEND_NETLINK) && (cfg.batch > 1) && (nl_tx_ctx_init(&tx_ctx) != 0)) {
+		ps->errors++;
+		free(apdu);
+		return NULL;
+	}
+
+	if (cfg.rate != 0)
+		period = 1000000000ULL * cfg.batch / cfg.rate;
+	next = now_ns(CLOCK_MONOTONIC);
+
+	stamp.magic = BENCH_MAGIC;
+	stamp.thread = ps->idx;
+
+	while (1) {
+		t = now_ns(CLOCK_REALTIME);
+		if (t >= measure_end)
+			break;
+
+		for (i = 0; i < cfg.batch; i++) {
+			stamp.seq = seq++;
+			stamp.tstamp = now_ns(CLOCK_REALTIME);
+			memcpy(recs[i].apdu, &stamp, sizeof(struct bench_stamp));
+		}
+
+		if (cfg.ring) {
+			for (i = 0; i < cfg.batch; i++)
+				while (goose_tx_ring_put(&tx_ring, ifindex, cfg.daddr, recs[i].goose_h,
+										 recs[i].apdu, cfg.size, msg_type) != 0) {
+					goose_tx_ring_kick(&tx_ring);
+					goose_tx_ring_complete(&tx_ring, NULL, GOOSE_TX_RING_SLOTS);
+				}
+			goose_tx_ring_kick(&tx_ring);
+			goose_tx_ring_complete(&tx_ring, NULL, GOOSE_TX_RING_SLOTS);
+		} else if (cfg.batch == 1) {
+			if (send_goose_data(&nl_if, &nl_data_h, recs[0].goose_h, recs[0].apdu,
+								cfg.size, msg_type) < 0)
+				ps->errors++;
+		} else if (cfg.backend != NL_IF_BACKEND_NETLINK) {
+			if (send_goose_batch(&nl_if, recs, cfg.batch, NULL) != (int) cfg.batch)
+				ps->errors++;
+		} else if (send_goose_batch_ctx(&tx_ctx, recs, cfg.batch, NULL) != (int) cfg.batch) {
+			ps->errors++;
+		}
+
+		if (t >= measure_start)
+			ps->sent += cfg.batch;
+
+		/* Keep the rate, do not catch up after a long stall */
+		if (period != 0) {
+			next += period;
+			t = now_ns(CLOCK_MONOTONIC);
+			if (next > t) {
+				ts.tv_sec = next / 1000000000ULL;
+				ts.tv_nsec = next % 1000000000ULL;
+				clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+			} else if (t - next > 100 * period) {
+				next = t;
+			}
+		}
+	}
+
+	if (cfg.ring)
+		goose_tx_ring_close(&tx_ring);
+	else if ((cfg.backend == NL_IF_BACKEND_NETLINK) && (cfg.batch > 1))
+		nl_tx_ctx_close(&tx_ctx);
+	free(apdu);
+	return NULL;
+}
+
+static void subscriber_frame(struct goose_frame *frame)
+{
+	struct bench_stamp stamp;
+	struct sub_stat *ss;
+
+	if (frame->apdu_len < sizeof(struct bench_stamp))
+		return;
+	memcpy(&stamp, frame->apdu, sizeof(struct bench_stamp));
+	if ((stamp.magic != BENCH_MAGIC) || (stamp.thread >= cfg.threads) ||
+		(stamp.tstamp < measure_start) || (stamp.tstamp >= measure_end))
+		return;
+
+	ss = &subs[stamp.thread];
+	if (!ss->started) {
+		ss->started = 1;
+		ss->first = stamp.seq;
+		ss->last = stamp.seq;
+	} else if (stamp.seq <= ss->last) {
+		/* Retransmission, or reordered */
+		ss->dup++;
+		return;
+	} else {
+		ss->last = stamp.seq;
+	}
+
+	ss->recv++;
+	if (frame->vlan & GOOSE_VLAN_PRESENT)
+		ss->tagged++;
+	if (frame->tstamp.dequeued > stamp.tstamp)
+		hist_record(&lat, frame->tstamp.dequeued - stamp.tstamp);
+	else
+		hist_record(&lat, 0);
+}
+
+static void subscriber(void)
+{
+	struct goose_frame frames[BENCH_RECV_BATCH];
+	int i, num;
+
+	/* Publishers stop at measure_end, late frames still count */
+	while (now_ns(CLOCK_REALTIME) < measure_end + BENCH_GRACE_MS * 1000000ULL) {
+		num = recv_goose_batch(&nl_if, frames, BENCH_RECV_BATCH);
+		for (i = 0; i < num; i++)
+			subscriber_frame(&frames[i]);
+	}
+}
+
+static void report(double seconds)
+{
+	unsigned long long sent = 0, recv = 0, dup = 0, lost = 0, errors = 0, tagged = 0;
+	unsigned int i;
+	double loss;
+	char vlan[16] = "none";
+
+	for (i = 0; i < cfg.threads; i++) {
+		sent += pubs[i].sent;
+		errors += pubs[i].errors;
+		recv += subs[i].recv;
+		dup += subs[i].dup;
+		tagged += subs[i].tagged;
+		if (subs[i].started)
+			lost += (subs[i].last - subs[i].first + 1) - subs[i].recv;
+	}
+	loss = (recv + lost) ? (double) lost / (recv + lost) : 0;
+	if (cfg.vlan)
+		snprintf(vlan, sizeof(vlan), "%u:%u", cfg.vid, cfg.pcp);
+
+	if (strcmp(cfg.format, "csv") == 0) {
+		printf("mode,dev,threads,rate,size,batch,reliable,ring,vlan,duration,"
+			   "tx_frames,tx_fps,tx_errors,rx_frames,rx_fps,rx_dup,rx_tagged,lost,loss,"
+			   "lat_min_ns,lat_p50_ns,lat_p99_ns,lat_p999_ns,lat_max_ns,lat_mean_ns\n");
+		printf("%s,%s,%u,%u,%u,%u,%d,%d,%s,%u,%llu,%.0f,%llu,%llu,%.0f,%llu,%llu,%llu,%.6f,"
+			   "%llu,%llu,%llu,%llu,%llu,%.0f\n",
+			   (cfg.pub && cfg.sub) ? "loop" : (cfg.pub ? "pub" : "sub"),
+			   cfg.dev, cfg.threads, cfg.rate, cfg.size, cfg.batch, cfg.reliable,
+			   cfg.ring, vlan, cfg.duration, sent, sent / seconds, errors,
+			   recv, recv / seconds, dup, tagged, lost, loss,
+			   lat.min, hist_percentile(&lat, 50), hist_percentile(&lat, 99),
+			   hist_percentile(&lat, 99.9), lat.max,
+			   lat.total ? (double) lat.sum / lat.total : 0);
+		return;
+	}
+
+	printf("{\n");
+	printf("  \"mode\": \"%s\",\n", (cfg.pub && cfg.sub) ? "loop" : (cfg.pub ? "pub" : "sub"));
+	printf("  \"dev\": \"%s\",\n", cfg.dev);
+	printf("  \"threads\": %u,\n", cfg.threads);
+	printf("  \"rate\": %u,\n", cfg.rate);
+	printf("  \"size\": %u,\n", cfg.size);
+	printf("  \"batch\": %u,\n", cfg.batch);
+	printf("  \"reliable\": %s,\n", cfg.reliable ? "true" : "false");
+	printf("  \"ring\": %s,\n", cfg.ring ? "true" : "false");
+	printf("  \"vlan\": \"%s\",\n", vlan);
+	printf("  \"duration\": %u,\n", cfg.duration);
+	printf("  \"warmup\": %u,\n", cfg.warmup);
+	printf("  \"tx\": {\"frames\": %llu, \"fps\": %.0f, \"errors\": %llu},\n",
+		   sent, sent / seconds, errors);
+	printf("  \"rx\": {\"frames\": %llu, \"fps\": %.0f, \"dup\": %llu, "
+		   "\"tagged\": %llu, \"lost\": %llu, \"loss\": %.6f},\n",
+		   recv, recv / seconds, dup, tagged, lost, loss);
+	printf("  \"latency_ns\": {\"min\": %llu, \"p50\": %llu, \"p99\": %llu, "
+		   "\"p999\": %llu, \"max\": %llu, \"mean\": %.0f}\n",
+		   lat.min, hist_percentile(&lat, 50), hist_percentile(&lat, 99),
+		   hist_percentile(&lat, 99.9), lat.max,
+		   lat.total ? (double) lat.sum / lat.total : 0);
+	printf("}\n");
+}
+
+static void usage(char *prog)
+{
+	printf("Usage: %s [options]\n"
+		   "  -m loop|pub|sub   mode (loop)\n"
+		   "  -i dev            device to publish on (gs0)\n"
+		   "  -P                AF_PACKET on dev instead of the module, the\n"
+		   "                    subscriber receives on dev too\n"
+		   "  -X                AF_XDP on queue 0 of dev instead of the module\n"
+		   "  -r rate           frames/s per publisher, 0 for max (1000)\n"
+		   "  -s size           APDU bytes (100)\n"
+		   "  -t threads        publishers (1)\n"
+		   "  -b batch          frames per system call (1)\n"
+		   "  -R                reliable, GOOSE enhanced retransmission\n"
+		   "  -T                publish through the TX ring\n"
+		   "  -q vid:pcp        802.1Q tag of the published APPIDs\n"
+		   "  -d seconds        measured duration (10)\n"
+		   "  -w seconds        warm-up (2)\n"
+		   "  -a appid          APPID of the first publisher (0x1000)\n"
+		   "  -o json|csv       output format (json)\n", prog);
+}
+
+int main(int argc, char* argv[])
+{
+	struct timeval tv = {0, 100000};
+	unsigned int i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "m:i:PXr:s:t:b:RTq:d:w:a:o:h")) != -1) {
+		switch (opt) {
+		case 'm':
+			cfg.pub = (strcmp(optarg, "sub") != 0);
+			cfg.sub = (strcmp(optarg, "pub") != 0);
+			break;
+		case 'i': cfg.dev = optarg; break;
+		case 'P': cfg.backend = NL_IF_BACKEND_PACKET; break;
+		case 'X': cfg.backend = NL_IF_BACKEND_XDP; break;
+		case 'r': cfg.rate = strtoul(optarg, NULL, 0); break;
+		case 's': cfg.size = strtoul(optarg, NULL, 0); break;
+		case 't': cfg.threads = strtoul(optarg, NULL, 0); break;
+		case 'b': cfg.batch = strtoul(optarg, NULL, 0); break;
+		case 'R': cfg.reliable = 1; break;
+		case 'T': cfg.ring = 1; break;
+		case 'q':
+			cfg.vlan = (sscanf(optarg, "%u:%u", &cfg.vid, &cfg.pcp) == 2) &&
+				(cfg.vid < 4095) && (cfg.pcp < 8);
+			if (!cfg.vlan) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'd': cfg.duration = strtoul(optarg, NULL, 0); break;
+		case 'w': cfg.warmup = strtoul(optarg, NULL, 0); break;
+		case 'a': cfg.appid = strtoul(optarg, NULL, 0); break;
+		case 'o': cfg.format = optarg; break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if ((cfg.backend != NL_IF_BACKEND_NETLINK) && (cfg.ring || cfg.reliable || cfg.vlan)) {
+		printf("The TX ring, retransmission and tags need the module!\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((cfg.threads == 0) || (cfg.threads > BENCH_MAX_THREADS) ||
+		(cfg.batch == 0) || (cfg.batch > BENCH_MAX_BATCH) || (cfg.duration == 0) ||
+		(cfg.size < sizeof(struct bench_stamp)) ||
+		(cfg.size > GOOSE_MAX_APDU_LEN) ||
+		(cfg.ring && ((cfg.threads != 1) ||
+					  (cfg.size + sizeof(struct goosehdr) > GOOSE_TX_SLOT_DATALEN)))) {
+		printf("Invalid threads, batch, duration or size "
+			   "(the TX ring takes one publisher and frames of a slot)!\n");
+		return EXIT_FAILURE;
+	}
+
+	if (cfg.pub && (goose_dev_mtu(cfg.dev) > 0) &&
+		(cfg.size + sizeof(struct goosehdr) > (unsigned int) goose_dev_mtu(cfg.dev))) {
+		printf("Frames of %u bytes do not fit the MTU of %s!\n",
+			   cfg.size + (unsigned int) sizeof(struct goosehdr), cfg.dev);
+		return EXIT_FAILURE;
+	}
+
+	/* Initiate netlink interface */
+	if (((cfg.backend == NL_IF_BACKEND_PACKET) ? nl_if_init_packet(&nl_if, cfg.dev) :
+		 (cfg.backend == NL_IF_BACKEND_XDP) ?
+		 nl_if_init_xdp(&nl_if, cfg.dev, 0, GOOSE_XDP_MODE_AUTO) : nl_if_init(&nl_if)) != 0) {
+		printf("Initiating netlink interface fails!\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Wake up the subscriber now and then to see the end */
+	setsockopt(nl_if.sock_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	if (cfg.sub)
+		for (i = 0; i < cfg.threads; i++)
+			goose_subscribe(&nl_if, cfg.appid + i, NULL);
+
+	if (cfg.pub && cfg.vlan)
+		for (i = 0; i < cfg.threads; i++)
+			goose_set_vlan(&nl_if, cfg.appid + i, cfg.vid, cfg.pcp);
+
+	measure_start = now_ns(CLOCK_REALTIME) + cfg.warmup * 1000000000ULL;
+	measure_end = measure_start + cfg.duration * 1000000000ULL;
+
+	if (cfg.pub)
+		for (i = 0; i < cfg.threads; i++) {
+			pubs[i].idx = i;
+			if (pthread_create(&pubs[i].tid, NULL, publisher, &pubs[i]) != 0) {
+				printf("Creating publisher %u fails!\n", i);
+				return EXIT_FAILURE;
+			}
+		}
+
+	if (cfg.sub)
+		subscriber();
+
+	if (cfg.pub)
+		for (i = 0; i < cfg.threads; i++)
+			pthread_join(pubs[i].tid, NULL);
+
+	if (cfg.sub)
+		for (i = 0; i < cfg.threads; i++)
+			goose_unsubscribe(&nl_if, cfg.appid + i, NULL);
+
+	if (cfg.pub && cfg.vlan)
+		for (i = 0; i < cfg.threads; i++)
+			goose_clear_vlan(&nl_if, cfg.appid + i);
+
+	report(cfg.duration);
+
+	/* Close netlink interface */
+	nl_if_close(&nl_if);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,40 @@
+#!/bin/sh
+# ACK-driven reliable GOOSE on the veth pair of gs_bench_veth.sh.
+# gs_bench publishes reliable frames (-R) on gs0, the module ACKs
+# them as they come in on gs1 (rx_ack is turned on for the run) and
+# sends the ACKs back to gs0. The
+# first run keeps the full retransmission schedule (acks 0 in the
+# default profile), the second stops it on the first ACK; compare
+# retrans_attempts and the latency of both.
+#
+# Needs the GOOSE module and iproute2.
+# Usage: gs_bench_ack.sh [seconds] [rate]
+
+DUR=${1:-10}
+RATE=${2:-1000}
+DIR=$(dirname "$0")
+PROFILE=$(head -n 1 /proc/goose/profiles | awk '{ print $3, $5, $7, $9 }')
+RX_ACK=/sys/module/goose/parameters/rx_ack
+RX_ACK_OLD=$(cat $RX_ACK)
+
+cleanup()
+{
+	echo "set 0 $PROFILE 0" > /proc/goose/profiles
+	echo $RX_ACK_OLD > $RX_ACK
+	"$DIR"/gs_bench_veth.sh down
+}
+
+"$DIR"/gs_bench_veth.sh up > /dev/null || exit 1
+trap cleanup EXIT INT TERM
+echo 1 > $RX_ACK || exit 1
+
+for acks in 0 1; do
+	echo "set 0 $PROFILE $acks" > /proc/goose/profiles
+	echo "# acks $acks"
+	grep -E "^(retrans|ack)_" /proc/goose/stats > /tmp/gs_ack.$$
+	"$DIR"/gs_bench -i gs0 -r $RATE -d $DUR -w 1 -R -o csv | tail -n 1
+	sleep 1
+	grep -E "^(retrans|ack)_" /proc/goose/stats | paste /tmp/gs_ack.$$ - |
+		awk '{ print $1, $4 - $2 }'
+	rm -f /tmp/gs_ack.$$
+done
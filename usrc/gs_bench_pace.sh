@@ -0,0 +1,49 @@
+#!/bin/sh
+# TX pacing on the veth pair of gs_bench_veth.sh. gs0 gets a token
+# bucket of rate frames/s and burst frames. A storm publisher (APPID
+# 0x2000) sends as fast as it can, while a trip publisher sends 1000
+# reliable frames/s, whose first sends go around the bucket. Both
+# have PCP 1, below trip_pcp, so only the class of the frames tells
+# them apart. The storm should be held near the rate, and the trip
+# latency should be the same as without the storm.
+#
+# Needs the GOOSE module and iproute2.
+# Usage: gs_bench_pace.sh [seconds] [rate] [burst] [vid]
+
+DUR=${1:-10}
+RATE=${2:-2000}
+BURST=${3:-16}
+VID=${4:-100}
+DIR=$(dirname "$0")
+DEV0=gs0
+
+cleanup()
+{
+	kill $STORM 2>/dev/null
+	echo "dev $DEV0 0" > /proc/goose/pace
+	"$DIR"/gs_bench_veth.sh down
+}
+
+"$DIR"/gs_bench_veth.sh up > /dev/null || exit 1
+trap cleanup EXIT INT TERM
+
+echo "dev $DEV0 $RATE $BURST" > /proc/goose/pace || exit 1
+
+echo "trip, alone:"
+"$DIR"/gs_bench -i $DEV0 -r 1000 -d $DUR -w 1 -R -q $VID:1 -o csv || exit 1
+
+"$DIR"/gs_bench -i $DEV0 -r 0 -b 32 -a 0x2000 -d $((DUR + 4)) -w 1 \
+	-q $VID:1 -o csv > /tmp/gs_bench_storm.$$ &
+STORM=$!
+sleep 2
+
+echo "trip, with storm:"
+"$DIR"/gs_bench -i $DEV0 -r 1000 -d $DUR -w 1 -R -q $VID:1 -o csv | tail -n 1
+wait $STORM
+STORM=
+echo "storm, paced at $RATE fps:"
+tail -n 1 /tmp/gs_bench_storm.$$
+rm -f /tmp/gs_bench_storm.$$
+
+cat /proc/goose/pace
+grep pace /proc/goose/stats
@@ -0,0 +1,29 @@
+#!/bin/sh
+# gs_bench on the AF_PACKET backend (-P), no kernel module, on the
+# veth pair of gs_bench_veth.sh. An AF_PACKET socket only sees its
+# own device, so the subscriber runs in the peer namespace on gs1
+# and the publisher on gs0; each prints its own side.
+#
+# Usage: gs_bench_packet.sh [seconds] [rate] [batch]
+
+DUR=${1:-10}
+RATE=${2:-10000}
+BATCH=${3:-1}
+DIR=$(dirname "$0")
+NS=gs_peer
+
+cleanup()
+{
+	kill $SUB 2>/dev/null
+	"$DIR"/gs_bench_veth.sh down
+}
+
+"$DIR"/gs_bench_veth.sh up > /dev/null || exit 1
+trap cleanup EXIT INT TERM
+
+ip netns exec $NS "$DIR"/gs_bench -P -m sub -i gs1 -d $DUR -w 1 -o csv &
+SUB=$!
+sleep 0.5
+
+"$DIR"/gs_bench -P -m pub -i gs0 -r $RATE -b $BATCH -d $DUR -w 1 -o csv | tail -n 1
+wait $SUB
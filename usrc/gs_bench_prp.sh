@@ -0,0 +1,45 @@
+#!/bin/sh
+# Redundant transmission over two veth pairs, LAN A and LAN B:
+#
+#   gsa0 (host namespace)  <=====>  gsa1 (namespace gs_peer)
+#   gsb0 (host namespace)  <=====>  gsb1 (namespace gs_peer)
+#
+# gs_bench publishes on gsa0, the module sends every frame on both
+# LANs and keeps the first copy on receive. LAN A is taken down in
+# the middle of the run: with redundancy there should be neither
+# loss nor duplicates; "lost" counts the frames missed at failover.
+#
+# Needs the GOOSE module and iproute2.
+# Usage: gs_bench_prp.sh [seconds] [rate]
+
+DUR=${1:-10}
+RATE=${2:-1000}
+DIR=$(dirname "$0")
+NS=gs_peer
+
+cleanup()
+{
+	echo none > /proc/goose/prp_lan_a
+	echo none > /proc/goose/prp_lan_b
+	ip link del gsa0 2>/dev/null
+	ip link del gsb0 2>/dev/null
+	ip netns del $NS 2>/dev/null
+}
+
+ip netns add $NS || exit 1
+trap cleanup EXIT INT TERM
+
+for lan in a b; do
+	ip link add gs${lan}0 type veth peer name gs${lan}1 || exit 1
+	ip link set gs${lan}1 netns $NS
+	ip link set gs${lan}0 allmulticast on up
+	ip netns exec $NS ip link set gs${lan}1 allmulticast on up
+done
+
+echo gsa0 > /proc/goose/prp_lan_a
+echo gsb0 > /proc/goose/prp_lan_b
+
+( sleep $((1 + DUR / 2)); ip link set gsa0 down ) &
+
+"$DIR"/gs_bench -i gsa0 -r $RATE -d $DUR -w 1 -o csv
+grep prp /proc/goose/stats
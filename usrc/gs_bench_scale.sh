@@ -0,0 +1,20 @@
+#!/bin/sh
+# Send throughput of gs_bench publishers from 1 to N threads, one CSV
+# row per run. Publishers send as fast as they can (-r 0); extra
+# gs_bench options are passed on, e.g. -b 32 for batches.
+#
+# Usage: gs_bench_scale.sh [max_threads] [gs_bench options]
+
+MAX=${1:-8}
+[ $# -gt 0 ] && shift
+BENCH=$(dirname "$0")/gs_bench
+
+t=1
+while [ $t -le $MAX ]; do
+	if [ $t -eq 1 ]; then
+		$BENCH -m pub -r 0 -t $t -d 5 -w 1 -o csv "$@" || exit 1
+	else
+		$BENCH -m pub -r 0 -t $t -d 5 -w 1 -o csv "$@" | tail -n 1
+	fi
+	t=$((t * 2))
+done
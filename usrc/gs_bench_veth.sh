@@ -0,0 +1,37 @@
+#!/bin/sh
+# Set up a veth pair for gs_bench, so that it runs without a NIC:
+#
+#   gs0 (host namespace)  <=====>  gs1 (namespace gs_peer)
+#
+# Publish on gs0; frames come in on gs1. The GOOSE module and its
+# netlink socket live in the host namespace, so gs_bench runs there,
+# while the packet handler sees frames of every namespace.
+#
+# Usage: gs_bench_veth.sh [up|down]
+
+NS=gs_peer
+DEV0=gs0
+DEV1=gs1
+
+case "${1:-up}" in
+up)
+	ip netns add $NS || exit 1
+	ip link add $DEV0 type veth peer name $DEV1 || exit 1
+	ip link set $DEV1 netns $NS
+	ip link set $DEV0 mtu 1500 up
+	ip netns exec $NS ip link set $DEV1 mtu 1500 up
+	ip netns exec $NS ip link set lo up
+	# Accept the GOOSE multicast addresses
+	ip link set $DEV0 allmulticast on
+	ip netns exec $NS ip link set $DEV1 allmulticast on
+	echo "$DEV0 is ready, e.g.: ./gs_bench -i $DEV0 -r 10000 -d 10 -o json"
+	;;
+down)
+	ip link del $DEV0 2>/dev/null
+	ip netns del $NS 2>/dev/null
+	;;
+*)
+	echo "Usage: $0 [up|down]"
+	exit 1
+	;;
+esac
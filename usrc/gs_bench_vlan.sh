@@ -0,0 +1,51 @@
+#!/bin/sh
+# Latency isolation of GOOSE under bulk traffic, on the veth pair of
+# gs_bench_veth.sh. gs0 gets a bottleneck (tbf) with a prio qdisc
+# inside: priorities 4 - 7 go to band 0, all others to band 1. iperf3
+# floods gs0 with UDP while gs_bench publishes tagged frames, once
+# with PCP 0 (same band as the bulk traffic) and once with PCP 4.
+# The latency of the second run should not depend on the bulk load.
+#
+# On a multi-queue NIC, mqprio or taprio gives the same split with
+# a TX queue of its own, e.g.:
+#   tc qdisc add dev eth0 root mqprio num_tc 2 \
+#      map 1 1 1 1 0 0 0 0 1 1 1 1 1 1 1 1 queues 1@0 3@1 hw 0
+#
+# Needs the GOOSE module, iproute2 and iperf3.
+# Usage: gs_bench_vlan.sh [seconds] [link rate] [bulk rate] [vid]
+
+DUR=${1:-10}
+LINK=${2:-200mbit}
+BULK=${3:-400M}
+VID=${4:-100}
+DIR=$(dirname "$0")
+NS=gs_peer
+DEV0=gs0
+DEV1=gs1
+
+cleanup()
+{
+	kill $IPERF_S $IPERF_C 2>/dev/null
+	"$DIR"/gs_bench_veth.sh down
+}
+
+"$DIR"/gs_bench_veth.sh up > /dev/null || exit 1
+trap cleanup EXIT INT TERM
+
+ip addr add 10.88.0.1/24 dev $DEV0
+ip netns exec $NS ip addr add 10.88.0.2/24 dev $DEV1
+
+tc qdisc add dev $DEV0 root handle 1: tbf rate $LINK burst 32kb latency 100ms || exit 1
+tc qdisc add dev $DEV0 parent 1:1 handle 10: prio bands 2 \
+	priomap 1 1 1 1 0 0 0 0 1 1 1 1 1 1 1 1 || exit 1
+
+ip netns exec $NS iperf3 -s > /dev/null 2>&1 &
+IPERF_S=$!
+sleep 1
+iperf3 -c 10.88.0.2 -u -b $BULK -t $((2 * (DUR + 3))) > /dev/null 2>&1 &
+IPERF_C=$!
+sleep 1
+
+"$DIR"/gs_bench -i $DEV0 -r 1000 -d $DUR -w 1 -q $VID:0 -o csv || exit 1
+"$DIR"/gs_bench -i $DEV0 -r 1000 -d $DUR -w 1 -q $VID:4 -o csv | tail -n 1
+tc -s qdisc show dev $DEV0
@@ -0,0 +1,41 @@
+#!/bin/sh
+# gs_bench on the AF_XDP backend (-X) against the AF_PACKET one (-P)
+# and, if the module is loaded, the netlink path, on the veth pair of
+# gs_bench_veth.sh. The subscriber runs in the peer namespace on gs1
+# and the publisher on gs0; each prints its own side. veth takes the
+# XDP program in driver mode, other devices fall back to generic mode.
+#
+# Needs iproute2, Linux 5.9 or later for AF_XDP.
+# Usage: gs_bench_xdp.sh [seconds] [rate] [batch]
+
+DUR=${1:-10}
+RATE=${2:-10000}
+BATCH=${3:-1}
+DIR=$(dirname "$0")
+NS=gs_peer
+
+cleanup()
+{
+	kill $SUB 2>/dev/null
+	"$DIR"/gs_bench_veth.sh down
+}
+
+run()
+{
+	echo "# $1"
+	ip netns exec $NS "$DIR"/gs_bench $2 -m sub -i gs1 -d $DUR -w 1 -o csv &
+	SUB=$!
+	sleep 0.5
+	"$DIR"/gs_bench $2 -m pub -i gs0 -r $RATE -b $BATCH -d $DUR -w 1 -o csv | tail -n 1
+	wait $SUB
+}
+
+"$DIR"/gs_bench_veth.sh up > /dev/null || exit 1
+trap cleanup EXIT INT TERM
+
+run af_xdp -X
+run af_packet -P
+if [ -d /proc/goose ]; then
+	echo "# netlink"
+	"$DIR"/gs_bench -i gs0 -r $RATE -b $BATCH -d $DUR -w 1 -o csv
+fi
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "nl_if_goose.h"
+
+/* GOOSE APDU encoder/decoder micro benchmark
+ * Usage: gs_codec_bench [iterations]
+ * For synthetic datasets of several sizes, reports ns per frame of:
+ *   encode  - set all members and goose_enc_change()
+ *   repeat  - goose_enc_repeat()
+ *   decode  - goose_dec_frame() of a changed frame (full BER walk)
+ *   same    - goose_dec_frame() of a heartbeat (fast path)
+ */
+
+static inline unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Members cycle through the usual types of a GOOSE dataset */
+static const unsigned char member_types[] = {
+	GOOSE_DATA_BOOLEAN, GOOSE_DATA_BITSTRING, GOOSE_DATA_FLOAT,
+	GOOSE_DATA_INTEGER, GOOSE_DATA_UTCTIME
+};
+
+static void set_members(struct goose_encoder *enc, unsigned int num, unsigned int round)
+{
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		switch (enc->type[i]) {
+		case GOOSE_DATA_BOOLEAN:
+			goose_enc_set_bool(enc, i, round & 1);
+			break;
+		case GOOSE_DATA_BITSTRING:
+			goose_enc_set_bitstring(enc, i, round);
+			break;
+		case GOOSE_DATA_FLOAT:
+			goose_enc_set_float(enc, i, (float) round * 0.5f);
+			break;
+		case GOOSE_DATA_INTEGER:
+			goose_enc_set_int(enc, i, round & 0x3f);
+			break;
+		case GOOSE_DATA_UTCTIME:
+			goose_enc_set_utctime(enc, i, 1000000000ULL * round);
+			break;
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	static struct goose_encoder enc;
+	static struct goose_decoder dec;
+	static struct goose_enc_member members[GOOSE_ENC_MAX_MEMBERS];
+	static const unsigned int sizes[] = {4, 16, 64, 100};
+	unsigned int iters = (argc > 1) ? atoi(argv[1]) : 1000000;
+	unsigned long long t0, t_enc, t_rep, t_dec, t_same;
+	unsigned int s, i, num;
+	volatile unsigned int sink = 0;
+
+	struct goose_dataset ds = {
+		.gocb_ref = "IED1LD0/LLN0$GO$gcb01",
+		.dat_set = "IED1LD0/LLN0$DS01",
+		.go_id = "IED1_GOOSE01",
+		.time_allowed_to_live = 2000,
+		.conf_rev = 1,
+		.time_quality = 0x0a,
+		.members = members
+	};
+
+	if (iters == 0)
+		iters = 1;
+
+	printf("members,apdu_len,encode_ns,repeat_ns,decode_ns,same_ns\n");
+
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		num = sizes[s];
+		for (i = 0; i < num; i++) {
+			members[i].type = member_types[i % sizeof(member_types)];
+			members[i].size = (members[i].type == GOOSE_DATA_BITSTRING) ? 13 : 0;
+		}
+		ds.num = num;
+
+		if (goose_enc_init(&enc, &ds) != 0) {
+			printf("%u,too large\n", num);
+			continue;
+		}
+		goose_dec_init(&dec);
+
+		t0 = now_ns();
+		for (i = 0; i < iters; i++) {
+			set_members(&enc, num, i);
+			goose_enc_change(&enc, t0 + i);
+		}
+		t_enc = now_ns() - t0;
+
+		t0 = now_ns();
+		for (i = 0; i < iters; i++)
+			goose_enc_repeat(&enc);
+		t_rep = now_ns() - t0;
+
+		/* Every frame changes: alternate two states */
+		t0 = now_ns();
+		for (i = 0; i < iters; i++) {
+			enc.apdu[enc.off[0] + 2] ^= 0xff;
+			sink += goose_dec_frame(&dec, enc.apdu, enc.len);
+		}
+		t_dec = now_ns() - t0;
+
+		/* Heartbeats: only sqNum moves, and stays in one byte */
+		goose_dec_frame(&dec, enc.apdu, enc.len);
+		t0 = now_ns();
+		for (i = 0; i < iters; i++) {
+			enc.apdu[enc.off_sqnum + 2 + enc.apdu[enc.off_sqnum + 1] - 1] = i & 0x7f;
+			sink += goose_dec_frame(&dec, enc.apdu, enc.len);
+		}
+		t_same = now_ns() - t0;
+
+		printf("%u,%u,%.1f,%.1f,%.1f,%.1f\n", num, enc.len,
+			   (double) t_enc / iters, (double) t_rep / iters,
+			   (double) t_dec / iters, (double) t_same / iters);
+	}
+
+	return (sink == 0xffffffff) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nl_if_goose.h"
+
+/* GOOSE dispatcher benchmark
+ * Feeds synthetic frames of several streams (APPIDs) to a
+ * dispatcher with 1, 2, 4, ... workers and reports handler
+ * throughput. The handler spins for a given time, like protection
+ * logic would, and checks that the frames of each stream come in
+ * order (order_errors must be 0).
+ *
+ * Usage: gs_disp_bench [-w max_workers] [-s streams] [-n frames]
+ *                      [-c handler_ns] [-p]
+ *   -p pins worker i to CPU i + 1, the feeding thread to CPU 0
+ */
+
+#define BENCH_APPID       0x1000
+#define BENCH_MAX_STREAMS 4096
+
+static unsigned long long handler_ns = 2000;
+static unsigned long long last_seq[BENCH_MAX_STREAMS];
+static unsigned long order_errors;
+
+static inline unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* last_seq of a stream is only touched by the worker owning it */
+static void handler(struct goose_frame *frame, void *arg)
+{
+	unsigned int stream = frame->goose_h.appid - BENCH_APPID;
+	unsigned long long seq, end = now_ns() + handler_ns;
+
+	memcpy(&seq, frame->apdu, sizeof(seq));
+	if (seq != last_seq[stream] + 1)
+		__atomic_add_fetch(&order_errors, 1, __ATOMIC_RELAXED);
+	last_seq[stream] = seq;
+
+	while (now_ns() < end)
+		;
+}
+
+int main(int argc, char* argv[])
+{
+	static struct goose_dispatcher disp;
+	static int cpus[GOOSE_DISP_MAX_WORKERS];
+	struct goose_frame frame;
+	unsigned char apdu[64];
+	unsigned long long seq[BENCH_MAX_STREAMS], t0, t;
+	unsigned long steals, i;
+	unsigned int max_workers = 4, streams = 64, frames = 200000, workers, s;
+	int opt, pin = 0, ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((opt = getopt(argc, argv, "w:s:n:c:ph")) != -1) {
+		switch (opt) {
+		case 'w': max_workers = strtoul(optarg, NULL, 0); break;
+		case 's': streams = strtoul(optarg, NULL, 0); break;
+		case 'n': frames = strtoul(optarg, NULL, 0); break;
+		case 'c': handler_ns = strtoull(optarg, NULL, 0); break;
+		case 'p': pin = 1; break;
+		default:
+			printf("Usage: %s [-w max_workers] [-s streams] [-n frames] "
+				   "[-c handler_ns] [-p]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if ((max_workers == 0) || (max_workers > GOOSE_DISP_MAX_WORKERS) ||
+		(streams == 0) || (streams > BENCH_MAX_STREAMS)) {
+		printf("Invalid workers or streams!\n");
+		return EXIT_FAILURE;
+	}
+
+	if (pin) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(0, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+	}
+
+	memset(&frame, 0, sizeof(struct goose_frame));
+	memset(apdu, 0, sizeof(apdu));
+	frame.apdu = apdu;
+	frame.apdu_len = sizeof(apdu);
+
+	printf("workers,streams,frames,handler_ns,seconds,fps,order_errors,steals,ring_full\n");
+
+	for (workers = 1; workers <= max_workers; workers *= 2) {
+		for (i = 0; i < workers; i++)
+			cpus[i] = pin ? (int) ((i + 1) % ncpu) : -1;
+
+		memset(seq, 0, sizeof(seq));
+		memset(last_seq, 0, sizeof(last_seq));
+		order_errors = 0;
+
+		if (goose_disp_start(&disp, NULL, workers, cpus, -1, handler, NULL) != 0) {
+			printf("Starting the dispatcher fails!\n");
+			return EXIT_FAILURE;
+		}
+
+		t0 = now_ns();
+		for (i = 0; i < frames; i++) {
+			s = i % streams;
+			frame.goose_h.appid = BENCH_APPID + s;
+			seq[s]++;
+			memcpy(apdu, &seq[s], sizeof(seq[s]));
+			goose_disp_push(&disp, &frame);
+		}
+		goose_disp_stop(&disp);
+		t = now_ns() - t0;
+
+		for (i = 0, steals = 0; i < workers; i++)
+			steals += disp.workers[i].steals;
+
+		printf("%u,%u,%u,%llu,%.3f,%.0f,%lu,%lu,%lu\n", workers, streams, frames,
+			   handler_ns, t / 1e9, frames / (t / 1e9), order_errors, steals,
+			   disp.ring_full);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -38,6 +38,8 @@ int main(int argc, char* argv[])
 	const unsigned short my_appid = 18;
 	unsigned char apdu [NL_MAX_DATALEN_ACCEPTED];
 	struct timeval start_time, end_time, diff_time;
+	struct goose_rx_tstamp rx_ts;
+	unsigned long long tx_ts = 0;
 	
 	/* Set testing control information */
 	struct nl_ctrl_header nl_ctrl_h = {
@@ -80,15 +82,24 @@ int main(int argc, char* argv[])
 	send_goose_ctrl(&nl_if, &nl_ctrl_h);
 
 	/* Transmit APDU */
-	send_goose_data(&nl_if, &nl_data_h, &goose_h, data, strlen((char*)data), NL_MSG_DATA_UNICAST);   
+	if (send_goose_data_ts(&nl_if, &nl_data_h, &goose_h, data, strlen((char*)data),
+						   NL_MSG_DATA_UNICAST, &tx_ts) != 0)
+		printf("Transmission fails!\n");
 
 	/* Receive response */
-	recv_raw(&nl_if, &nl_data_h, &goose_h, apdu);
+	recv_raw_ts(&nl_if, &nl_data_h, &goose_h, apdu, &rx_ts);
 	
 	gettimeofday (&end_time, NULL);
 	timeval_subtract(&diff_time, &end_time, &start_time);
 	
-	printf("Round Trip Time = %ld us\n", diff_time.tv_usec);
+	printf("Round Trip Time = %ld us\n",
+		   diff_time.tv_sec * 1000000L + diff_time.tv_usec);
+
+	/* Where the time goes, in ns */
+	if (tx_ts != 0)
+		printf("  sent   -> received: %lld\n", (long long) (rx_ts.rx - tx_ts));
+	printf("  received -> queued: %lld\n", (long long) (rx_ts.queued - rx_ts.rx));
+	printf("  queued -> dequeued: %lld\n", (long long) (rx_ts.dequeued - rx_ts.queued));
 
 	/* Close netlink interface */
 	nl_if_close(&nl_if);
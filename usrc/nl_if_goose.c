@@ -2,30 +2,206 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <semaphore.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <linux/futex.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#if defined(__has_include)
+#if __has_include(<linux/if_xdp.h>)
+#include <linux/if_xdp.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#endif
+#endif
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #include "nl_if_goose.h"
 
+struct nl_if_rec;
+
+/* Backend of an interface: the kernel module by netlink, or AF_PACKET */
+struct nl_if_ops {
+	int backend;               /* NL_IF_BACKEND_XXX */
+	int (*send_parts)(struct nl_interface *nl_if, unsigned short msg_type,
+					  const struct iovec *parts, unsigned int num);
+	int (*send_batch)(struct nl_interface *nl_if, struct goose_batch_rec *recs,
+					  unsigned int num, int *status);
+	int (*next_record)(struct nl_interface *nl_if, int refill, struct nl_if_rec *rec);
+	void (*close)(struct nl_interface *nl_if);
+	/* Backends sending Ethernet frames themselves, see nl_if_raw_XXX */
+	int (*put)(struct nl_interface *nl_if, const unsigned char *daddr,
+			   const struct iovec *parts, unsigned int num,
+			   unsigned int skip, unsigned int len);
+	int (*kick)(struct nl_interface *nl_if, int wait);
+	void (*subscribe)(struct nl_interface *nl_if, unsigned short appid, int on);
+};
+
+static const struct nl_if_ops nl_if_netlink_ops;
+
+static int nl_if_init_xdp_env(struct nl_interface *nl_if, const char *spec);
+
+/* Send context constructor
+ * nl_pid 0 lets the kernel assign a unique port to the socket.
+ */
+int nl_tx_ctx_init(struct nl_tx_ctx *ctx)
+{
+	struct sockaddr_nl addr;
+	socklen_t addr_len = sizeof(struct sockaddr_nl);
+
+	ctx->fd = socket(PF_NETLINK, SOCK_RAW, NETLINK_GOOSE);
+	if (ctx->fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(struct sockaddr_nl));
+	addr.nl_family = AF_NETLINK;
+	if ((bind(ctx->fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_nl)) != 0) ||
+		(getsockname(ctx->fd, (struct sockaddr*)&addr, &addr_len) != 0)) {
+		close(ctx->fd);
+		return -1;
+	}
+	ctx->pid = addr.nl_pid;
+
+	ctx->iov.iov_base = malloc(NL_MAX_BATCH_LEN);
+	if (ctx->iov.iov_base == NULL) {
+		close(ctx->fd);
+		return -1;
+	}
+	ctx->iov.iov_len = NL_MAX_BATCH_LEN;
+
+	memset(&ctx->dest_addr, 0, sizeof(struct sockaddr_nl));
+	ctx->dest_addr.nl_family = AF_NETLINK;     /* to kernel */
+
+	memset(&ctx->msg, 0, sizeof(struct msghdr));
+	ctx->msg.msg_name = (void *)&ctx->dest_addr;
+	ctx->msg.msg_namelen = sizeof(ctx->dest_addr);
+	ctx->msg.msg_iov = &ctx->iov;
+	ctx->msg.msg_iovlen = 1;
+	ctx->stale = 0;
+
+	return 0;
+}
+
+/* Send context destructor */
+int nl_tx_ctx_close(struct nl_tx_ctx *ctx)
+{
+	free(ctx->iov.iov_base);
+	return close(ctx->fd);
+}
+
+/* MTU of a device, or -1 */
+int goose_dev_mtu(const char *dev_name)
+{
+	struct ifreq ifr;
+	int fd, ret;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&ifr, 0, sizeof(struct ifreq));
+	strncpy(ifr.ifr_name, dev_name, IFNAMSIZ - 1);
+	ret = ioctl(fd, SIOCGIFMTU, &ifr);
+	close(fd);
+
+	return (ret == 0) ? ifr.ifr_mtu : -1;
+}
+
+/* Address a device by handle: its ifindex, resolved once here so
+ * the kernel does no name lookup per message. NULL or "" selects
+ * the default device. Return -1 if there is no such device.
+ */
+int goose_set_dev(struct nl_data_header *nl_data_h, const char *dev_name)
+{
+	unsigned int ifindex = 0;
+
+	if ((dev_name != NULL) && (dev_name[0] != 0)) {
+		ifindex = if_nametoindex(dev_name);
+		if (ifindex == 0)
+			return -1;
+	}
+
+	memset(nl_data_h->dev_name, 0, IFNAMSIZE);
+	nl_data_h->dev_handle = ifindex;
+	return 0;
+}
+
+/* Largest MTU of the devices which may carry GOOSE, i.e. all but
+ * loopback devices, bounded by GOOSE_MAX_FRAME_LEN.
+ */
+static unsigned int nl_if_max_mtu(void)
+{
+	struct if_nameindex *ifs, *i;
+	struct ifreq ifr;
+	unsigned int mtu = ETHERMTU;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return mtu;
+
+	ifs = if_nameindex();
+	for (i = ifs; (i != NULL) && (i->if_index != 0); i++) {
+		memset(&ifr, 0, sizeof(struct ifreq));
+		strncpy(ifr.ifr_name, i->if_name, IFNAMSIZ - 1);
+		if ((ioctl(fd, SIOCGIFFLAGS, &ifr) != 0) || (ifr.ifr_flags & IFF_LOOPBACK))
+			continue;
+		if ((ioctl(fd, SIOCGIFMTU, &ifr) == 0) && (ifr.ifr_mtu > (int) mtu))
+			mtu = ifr.ifr_mtu;
+	}
+	if (ifs != NULL)
+		if_freenameindex(ifs);
+	close(fd);
+
+	return (mtu < GOOSE_MAX_FRAME_LEN) ? mtu : GOOSE_MAX_FRAME_LEN;
+}
+
 /* Netlink interface constructor
  * Allocate memoeries for interaction with kernel.
- * Currently, we only support one process with two
- * way communications in a machine.
+ * The socket gets its port from the kernel, so that a process
+ * may have several interfaces.
  */
 int nl_if_init (struct nl_interface *nl_if)
 {
-	struct nlmsghdr *nlh_in, *nlh_out;
-	int ret;
+	unsigned char *buf_in;
+	socklen_t addr_len = sizeof(struct sockaddr_nl);
+	const char *backend = getenv(NL_IF_BACKEND_ENV);
+	int i, ret;
+
+	if ((backend != NULL) && (strncmp(backend, "packet:", 7) == 0))
+		return nl_if_init_packet(nl_if, backend + 7);
+	if ((backend != NULL) && (strncmp(backend, "xdp:", 4) == 0))
+		return nl_if_init_xdp_env(nl_if, backend + 4);
+
+	nl_if->ops = &nl_if_netlink_ops;
+	nl_if->pkt = NULL;
+	nl_if->xdp = NULL;
 
 	/* Use Netlink socket with NETLINK_GOOSE */
 	nl_if->sock_fd = socket(PF_NETLINK, SOCK_RAW, NETLINK_GOOSE);
 	
-	memset(&nl_if->msg_in, 0, sizeof(struct msghdr));
-	memset(&nl_if->msg_out, 0, sizeof(struct msghdr));	
+	memset(nl_if->msg_in, 0, sizeof(nl_if->msg_in));
 	memset(&nl_if->src_addr, 0, sizeof(struct sockaddr_nl));
 	memset(&nl_if->dest_addr, 0, sizeof(struct sockaddr_nl));
 	
 	nl_if->src_addr.nl_family = AF_NETLINK;
-	nl_if->src_addr.nl_pid = getpid(); /* myself */
+	nl_if->src_addr.nl_pid = 0;        /* assigned by the kernel */
 	nl_if->src_addr.nl_groups = 0;     /* unicast */
 
 	nl_if->dest_addr.nl_family = AF_NETLINK;
@@ -33,24 +209,48 @@ int nl_if_init (struct nl_interface *nl_if)
 	nl_if->dest_addr.nl_groups = 0;    /* unicast */
 	
 	ret = bind(nl_if->sock_fd, (struct sockaddr*)&nl_if->src_addr, sizeof(struct sockaddr_nl));
+	if (ret == 0)
+		ret = getsockname(nl_if->sock_fd, (struct sockaddr*)&nl_if->src_addr, &addr_len);
+	if (ret != 0) {
+		close(nl_if->sock_fd);
+		return ret;
+	}
+
+	/* Batches of nl_if use their own socket, so that the status
+	 * replies never mix with received GOOSE frames.
+	 */
+	if (nl_tx_ctx_init(&nl_if->tx) != 0) {
+		close(nl_if->sock_fd);
+		return -1;
+	}
 
-	/* Alloc transmit/receiving buffers */
-	nlh_in  = (struct nlmsghdr *) malloc(NLMSG_SPACE(NL_MAX_DATALEN_ACCEPTED));
-	nlh_out = (struct nlmsghdr *) malloc(NLMSG_SPACE(NL_MAX_DATALEN_ACCEPTED));	
+	/* Alloc receiving buffers, for a coalesced message or a
+	 * frame of the largest MTU
+	 */
+	nl_if->in_buf_len = NLMSG_SPACE(sizeof(struct nl_rx_tstamp) + sizeof(struct nl_data_header)
+									+ 2 + nl_if_max_mtu());
+	if (nl_if->in_buf_len < NL_RECV_BATCH_LEN)
+		nl_if->in_buf_len = NL_RECV_BATCH_LEN;
+	buf_in  = (unsigned char *) malloc(NL_RECV_MMSG_NUM * nl_if->in_buf_len);
+	if (buf_in == NULL) {
+		nl_tx_ctx_close(&nl_if->tx);
+		close(nl_if->sock_fd);
+		return -1;
+	}
 	
-	nl_if->iov_in.iov_base = (void *)nlh_in;
-	nl_if->iov_in.iov_len = NLMSG_SPACE(NL_MAX_DATALEN_ACCEPTED);
-	nl_if->msg_in.msg_name = (void *)&nl_if->dest_addr;
-	nl_if->msg_in.msg_namelen = sizeof(nl_if->dest_addr);
-	nl_if->msg_in.msg_iov = &nl_if->iov_in;
-	nl_if->msg_in.msg_iovlen = 1;
-
-	nl_if->iov_out.iov_base = (void *)nlh_out;
-	nl_if->iov_out.iov_len = NLMSG_SPACE(NL_MAX_DATALEN_ACCEPTED);
-	nl_if->msg_out.msg_name = (void *)&nl_if->dest_addr;
-	nl_if->msg_out.msg_namelen = sizeof(nl_if->dest_addr);
-	nl_if->msg_out.msg_iov = &nl_if->iov_out;
-	nl_if->msg_out.msg_iovlen = 1;
+	for (i = 0; i < NL_RECV_MMSG_NUM; i++) {
+		nl_if->iov_in[i].iov_base = (void *)(buf_in + i * nl_if->in_buf_len);
+		nl_if->iov_in[i].iov_len = nl_if->in_buf_len;
+		nl_if->msg_in[i].msg_hdr.msg_iov = &nl_if->iov_in[i];
+		nl_if->msg_in[i].msg_hdr.msg_iovlen = 1;
+	}
+	nl_if->in_num = 0;
+	nl_if->in_idx = 0;
+	nl_if->in_nlh = NULL;
+	nl_if->in_rem = 0;
+	nl_if->in_tstamp = 0;
+	nl_if->in_trunc = 0;
+	nl_if->in_bad = 0;
 
 	/* Init semaphores */
 	sem_init(&nl_if->access_in,  0, 1);
@@ -64,6 +264,13 @@ int nl_if_init (struct nl_interface *nl_if)
 	return ret;
 }
 
+static void nl_if_nl_close(struct nl_interface *nl_if)
+{
+	free(nl_if->iov_in[0].iov_base);
+	close(nl_if->sock_fd);
+	nl_tx_ctx_close(&nl_if->tx);
+}
+
 /* Netlink interface destructor
  * Garbage clean.
  */
@@ -72,9 +279,7 @@ int nl_if_close (struct nl_interface *nl_if)
 	sem_wait(&nl_if->access_in);
 	sem_wait(&nl_if->access_out);
 	
-	free(nl_if->iov_in.iov_base);
-	free(nl_if->iov_out.iov_base);
-	close(nl_if->sock_fd);
+	nl_if->ops->close(nl_if);
 
 	sem_post(&nl_if->access_in);
 	sem_post(&nl_if->access_out);
@@ -82,6 +287,53 @@ int nl_if_close (struct nl_interface *nl_if)
 	return 0;
 }
 
+/* NL_IF_BACKEND_XXX of nl_if */
+int nl_if_backend(struct nl_interface *nl_if)
+{
+	return nl_if->ops->backend;
+}
+
+/* Most parts of a single message */
+#define NL_SEND_MAX_PARTS 4
+
+/* Send a single message, its payload gathered from parts.
+ * The netlink header lives on the stack and sendmsg() copies the
+ * parts, so there is no shared buffer and no lock.
+ */
+static int nl_if_send_parts(struct nl_interface *nl_if, unsigned short msg_type,
+							const struct iovec *parts, unsigned int num)
+{
+	static unsigned char pad[NLMSG_ALIGNTO];
+	struct iovec iov[NL_SEND_MAX_PARTS + 2];
+	struct nlmsghdr nlh;
+	struct msghdr msg;
+	unsigned int i, data_len = 0;
+
+	for (i = 0; i < num; i++) {
+		iov[i + 1] = parts[i];
+		data_len += parts[i].iov_len;
+	}
+
+	memset(&nlh, 0, sizeof(struct nlmsghdr));
+	nlh.nlmsg_type = msg_type;
+	nlh.nlmsg_len = data_len;
+	nlh.nlmsg_pid = nl_if->src_addr.nl_pid;
+	nlh.nlmsg_flags = 0;
+
+	iov[0].iov_base = &nlh;
+	iov[0].iov_len = NLMSG_HDRLEN;
+	iov[num + 1].iov_base = pad;
+	iov[num + 1].iov_len = NLMSG_ALIGN(data_len) - data_len;
+
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_name = (void *)&nl_if->dest_addr;
+	msg.msg_namelen = sizeof(nl_if->dest_addr);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = num + 2;
+
+	return sendmsg(nl_if->sock_fd, &msg, 0);
+}
+
 /* The API for raw data communication, independent of GOOSE.
  * Here, we use msg_type in netlink for control information
  * marking.
@@ -89,143 +341,3279 @@ int nl_if_close (struct nl_interface *nl_if)
 int send_raw(struct nl_interface *nl_if, unsigned char *data,
 			 unsigned int data_len, unsigned short msg_type)
 {
+	struct iovec part = {
+		.iov_base = data,
+		.iov_len  = data_len
+	};
+
+	return nl_if->ops->send_parts(nl_if, msg_type, &part, 1);
+}
+ 
+/* Current time in ns, same clock as the kernel timestamps */
+static inline unsigned long long nl_if_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Length of a received record without APDU:
+ * | nl_data_header | type(2) | goosehdr |
+ */
+#define GOOSE_RECORD_HDRLEN (sizeof(struct nl_data_header) + 2 + sizeof(struct goosehdr))
+
+/* Refill modes of nl_if_next_record(...) */
+#define NL_IF_NO_REFILL   0   /* only what is already pulled */
+#define NL_IF_REFILL      1   /* wait for the socket */
+#define NL_IF_REFILL_NB   2   /* pull what the socket has, no wait */
+
+/* A received record, whichever backend it comes from:
+ * -------------------------------------------------
+ * | nl_data_header | type(2) | goosehdr | apdu ... |
+ * -------------------------------------------------
+ * data is in the receiving buffers (or ring) of the interface.
+ */
+struct nl_if_rec {
+	unsigned char *data;
+	unsigned int len;
+	struct nl_rx_tstamp tstamp;
+};
+
+/* Record of a netlink message: | nlmsghdr | nl_rx_tstamp | frame | */
+static inline void nl_if_nlh_rec(struct nlmsghdr *nlh, struct nl_if_rec *rec)
+{
+	memcpy(&rec->tstamp, NLMSG_DATA(nlh), sizeof(struct nl_rx_tstamp));
+	rec->data = (unsigned char *) NLMSG_DATA(nlh) + sizeof(struct nl_rx_tstamp);
+	rec->len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(struct nl_rx_tstamp));
+}
+
+/* Start parsing received message idx, a truncated one is skipped */
+static inline void nl_if_load_msg(struct nl_interface *nl_if, unsigned int idx)
+{
+	nl_if->in_idx = idx;
+	nl_if->in_nlh = (struct nlmsghdr *) nl_if->iov_in[idx].iov_base;
+	nl_if->in_rem = nl_if->msg_in[idx].msg_len;
+	if (nl_if->msg_in[idx].msg_hdr.msg_flags & MSG_TRUNC) {
+		nl_if->in_trunc++;
+		nl_if->in_rem = 0;
+	}
+}
+
+/* Get the next received GOOSE record.
+ * When all received messages are parsed and refill is set, pull up
+ * to NL_RECV_MMSG_NUM messages with one recvmmsg().
+ * Return -1 if nothing is pending or on error, errno is EAGAIN
+ * if NL_IF_REFILL_NB finds the socket empty.
+ */
+static int nl_if_next_record(struct nl_interface *nl_if, int refill,
+							 struct nl_if_rec *rec)
+{
+	struct nlmsghdr *nlh;
 	int ret;
 
-	struct nlmsghdr *nlh = (struct nlmsghdr *) nl_if->iov_out.iov_base;
+	while (1) {
+		/* Records of the current message */
+		while ((nl_if->in_nlh != NULL) && NLMSG_OK(nl_if->in_nlh, nl_if->in_rem)) {
+			nlh = nl_if->in_nlh;
+			nl_if->in_nlh = NLMSG_NEXT(nl_if->in_nlh, nl_if->in_rem);
+			if ((nlh->nlmsg_type == NL_MSG_DATA_RECV) &&
+				(nlh->nlmsg_len >= NLMSG_LENGTH(sizeof(struct nl_rx_tstamp) +
+												GOOSE_RECORD_HDRLEN))) {
+				nl_if_nlh_rec(nlh, rec);
+				return 0;
+			}
+		}
 
-	sem_wait(&nl_if->access_out);
+		/* Then, the next message */
+		if (nl_if->in_idx + 1 < nl_if->in_num) {
+			nl_if_load_msg(nl_if, nl_if->in_idx + 1);
+			continue;
+		}
 
-	nlh->nlmsg_type = msg_type;
-	nlh->nlmsg_len = data_len;
-	nlh->nlmsg_pid = getpid();
-	nlh->nlmsg_flags = 0;
-	nl_if->iov_out.iov_len = NLMSG_SPACE(data_len);
+		if (!refill)
+			return -1;
 
-	memcpy(NLMSG_DATA(nlh), data, data_len);
-	ret = sendmsg(nl_if->sock_fd, &nl_if->msg_out, 0);
+		/* A blocking system call, unless NL_IF_REFILL_NB */
+		ret = recvmmsg(nl_if->sock_fd, nl_if->msg_in, NL_RECV_MMSG_NUM,
+					   (refill == NL_IF_REFILL_NB) ? MSG_DONTWAIT : MSG_WAITFORONE,
+					   NULL);
+		nl_if->in_tstamp = nl_if_now();
+		nl_if->in_num = (ret > 0) ? ret : 0;
+		nl_if->in_idx = 0;
+		nl_if->in_nlh = NULL;
+		if (ret <= 0)
+			return -1;
 
-	sem_post(&nl_if->access_out);
-	
-	return ret;
+		nl_if_load_msg(nl_if, 0);
+	}
 }
- 
+
+/* Parse a received frame in place:
+ * -------------------------------------------------
+ * | nl_data_header | type(2) | goosehdr | apdu ... |
+ * -------------------------------------------------
+ * len is what was received of the frame. The length in the goose
+ * header must fit in it (Ethernet padding may follow the APDU).
+ * Return -1 if the frame is too short, or its length is broken.
+ */
+static int nl_if_parse_view(unsigned char *data, unsigned int len,
+							struct goose_view *view)
+{
+	unsigned int goose_len;
+
+	if (len < GOOSE_RECORD_HDRLEN)
+		return -1;
+
+	view->nl_data_h = (const struct nl_data_header *) data;
+	view->goose_h = (const struct goosehdr *) (data + sizeof(struct nl_data_header) + 2);
+
+	goose_len = ntohs(view->goose_h->len);
+	if ((goose_len < sizeof(struct goosehdr)) || (goose_len > GOOSE_MAX_FRAME_LEN) ||
+		(goose_len - sizeof(struct goosehdr) > len - GOOSE_RECORD_HDRLEN))
+		return -1;
+
+	view->appid = ntohs(view->goose_h->appid);
+	view->apdu = (const unsigned char *) (view->goose_h + 1);
+	view->apdu_len = goose_len - sizeof(struct goosehdr);
+
+	return 0;
+}
+
+/* Parse a received frame into a frame descriptor, headers in host order */
+static int nl_if_parse_frame(unsigned char *data, unsigned int len,
+							 struct goose_frame *frame)
+{
+	struct goose_view view;
+
+	if (nl_if_parse_view(data, len, &view) != 0)
+		return -1;
+
+	memcpy(&frame->nl_data_h, view.nl_data_h, sizeof(struct nl_data_header));
+	memcpy(&frame->goose_h, view.goose_h, sizeof(struct goosehdr));
+	frame->goose_h.len = ntohs(frame->goose_h.len);
+	frame->goose_h.appid = view.appid;
+	frame->apdu = (unsigned char *) view.apdu;
+	frame->apdu_len = view.apdu_len;
+
+	return 0;
+}
+
+/* Parse a received record */
+static inline void nl_if_record_tstamp(struct nl_if_rec *rec, unsigned long long dequeued,
+									   struct goose_rx_tstamp *tstamp, unsigned int *vlan)
+{
+	tstamp->rx = rec->tstamp.rx;
+	tstamp->queued = rec->tstamp.queued;
+	tstamp->dequeued = dequeued;
+	*vlan = rec->tstamp.vlan;
+}
+
+static inline int nl_if_parse_record(struct nl_if_rec *rec, unsigned long long dequeued,
+									 struct goose_frame *frame)
+{
+	if (nl_if_parse_frame(rec->data, rec->len, frame) != 0)
+		return -1;
+
+	nl_if_record_tstamp(rec, dequeued, &frame->tstamp, &frame->vlan);
+	return 0;
+}
+
+/* Next well-formed frame of nl_if, broken ones are counted and skipped.
+ * Return 0, or -1 if there is none.
+ */
+static int nl_if_next_frame(struct nl_interface *nl_if, int refill,
+							struct goose_frame *frame)
+{
+	struct nl_if_rec rec;
+
+	while (nl_if->ops->next_record(nl_if, refill, &rec) == 0) {
+		if (nl_if_parse_record(&rec, nl_if->in_tstamp, frame) == 0)
+			return 0;
+		nl_if->in_bad++;
+	}
+
+	return -1;
+}
+
 /* The API for GOOSE receiving
  * Received data have the following structure according
  * to the kernel module arrangement for netlink frame:
- * ----------------------------------------------
- * | nl_data_header | type(2) | goosehdr | apdu |
- * ----------------------------------------------
+ * ------------------------------------------------------------------------
+ * | nlmsghdr | nl_rx_tstamp | nl_data_header | type(2) | goosehdr | apdu |
+ * ------------------------------------------------------------------------
  *
- * Return value is APDU length.
+ * apdu must hold GOOSE_MAX_APDU_LEN bytes.
+ * Return value is APDU length, or -1.
  */
 
 int recv_raw(struct nl_interface *nl_if, struct nl_data_header *nl_data_h,
 			 struct goosehdr *goose_h, unsigned char *apdu)
 {
-	unsigned char *nlh = (unsigned char *) nl_if->iov_in.iov_base;
-	unsigned short apdu_len;
+	return recv_raw_ts(nl_if, nl_data_h, goose_h, apdu, NULL);
+}
+
+/* Same as recv_raw(...), tstamp (if not NULL) receives the
+ * timestamps of the frame.
+ */
+int recv_raw_ts(struct nl_interface *nl_if, struct nl_data_header *nl_data_h,
+				struct goosehdr *goose_h, unsigned char *apdu,
+				struct goose_rx_tstamp *tstamp)
+{
+	struct goose_frame frame;
 
 	sem_wait(&nl_if->access_in);
 	
-	/* A blocking system call */
-	recvmsg(nl_if->sock_fd, &nl_if->msg_in, 0);
+	if (nl_if_next_frame(nl_if, NL_IF_REFILL, &frame) != 0) {
+		sem_post(&nl_if->access_in);
+		return -1;
+	}
 
-	/* Get data, then allocate memory to header and data spaces */
-	memcpy(nl_data_h, nlh, sizeof(struct nl_data_header));
+	memcpy(nl_data_h, &frame.nl_data_h, sizeof(struct nl_data_header));
+	memcpy(goose_h, &frame.goose_h, sizeof(struct goosehdr));
+	memcpy(apdu, frame.apdu, frame.apdu_len);
+	if (tstamp != NULL)
+		*tstamp = frame.tstamp;
 
-	nlh += sizeof(struct nl_data_header) + 2;
-	memcpy(goose_h, nlh, sizeof(struct goosehdr));
+	sem_post(&nl_if->access_in);
 
-	goose_h->len = ntohs(goose_h->len);
-	goose_h->appid = ntohs(goose_h->appid);
+	return frame.apdu_len;
+}
 
-	apdu_len = goose_h->len - sizeof(struct goosehdr);
-	
-	nlh += sizeof(struct goosehdr);
-	memcpy(apdu, nlh, apdu_len);
+/* The API for zero-copy GOOSE receiving
+ * Same as recv_raw(...), but nothing is copied: view points into the
+ * receiving buffers of nl_if and is valid until the next receiving
+ * call on nl_if. Frames whose length does not fit in what was
+ * received are skipped.
+ *
+ * Return value is APDU length, or -1.
+ */
+int recv_goose_view(struct nl_interface *nl_if, struct goose_view *view)
+{
+	struct nl_if_rec rec;
+	int ret;
+
+	sem_wait(&nl_if->access_in);
+
+	while ((ret = nl_if->ops->next_record(nl_if, NL_IF_REFILL, &rec)) == 0) {
+		if (nl_if_parse_view(rec.data, rec.len, view) == 0)
+			break;
+		nl_if->in_bad++;
+	}
+	if (ret == 0)
+		nl_if_record_tstamp(&rec, nl_if->in_tstamp, &view->tstamp, &view->vlan);
 
 	sem_post(&nl_if->access_in);
 
-	return apdu_len;
+	return (ret == 0) ? (int) view->apdu_len : -1;
 }
 
-/* The API for GOOSE transmission
- * An assembler to combine interface header, goose header,
- * and apdu datam, then call send_raw(...).
- * The funcation also computes the length of the goose packet,
- * and writes it to goose header.
+/* The API for batched GOOSE receiving
+ * Fill up to max frame descriptors. It blocks until at least one
+ * frame is received, then returns what is already pulled from the
+ * socket without another system call. APDUs are not copied, they
+ * are valid until the next receiving call on nl_if.
+ *
+ * Return value is the number of frames, or -1.
  */
-int send_goose_data(struct nl_interface *nl_if, struct nl_data_header *nl_data_h,
-					struct goosehdr *goose_h, unsigned char *apdu,
-					unsigned int apdu_len, unsigned short msg_type)
+int recv_goose_batch(struct nl_interface *nl_if, struct goose_frame *frames,
+					 unsigned int max)
+{
+	unsigned int num = 0;
+
+	sem_wait(&nl_if->access_in);
+
+	while (num < max) {
+		if (nl_if_next_frame(nl_if, (num == 0) ? NL_IF_REFILL : NL_IF_NO_REFILL,
+							 &frames[num]) != 0)
+			break;
+		num++;
+	}
+
+	sem_post(&nl_if->access_in);
+
+	return ((num == 0) && (max != 0)) ? -1 : (int) num;
+}
+
+/* File descriptor of the receiving socket of nl_if, for poll(),
+ * select() or epoll. It is readable when frames are pending; with
+ * the non-blocking APIs below, it is also safe edge-triggered.
+ */
+int nl_if_fd(struct nl_interface *nl_if)
+{
+	return nl_if->sock_fd;
+}
+
+/* The API for non-blocking GOOSE receiving
+ * Fill frame with the next received frame, never wait. The APDU
+ * is not copied, it is valid until the next receiving call on nl_if.
+ *
+ * Return value is 0, or -1 with errno EAGAIN if no frame is pending
+ * (or another thread is receiving on nl_if).
+ */
+int recv_goose_nb(struct nl_interface *nl_if, struct goose_frame *frame)
 {
 	int ret;
-	struct nlmsghdr *nlh = (struct nlmsghdr *) nl_if->iov_out.iov_base;
-	unsigned int nl_data_h_len = sizeof(struct nl_data_header);
-	unsigned int goose_h_len = sizeof(struct goosehdr);
-	unsigned int data_len = apdu_len + goose_h_len + nl_data_h_len;
 
-	/* compute the goose pktlen in header*/
-	goose_h->len = htons(apdu_len + goose_h_len);
-	
-	sem_wait(&nl_if->access_out);
+	if (sem_trywait(&nl_if->access_in) != 0)
+		return -1;
 
-	nlh->nlmsg_type = msg_type;
-	nlh->nlmsg_len = data_len;
-	nlh->nlmsg_pid = getpid();
-	nlh->nlmsg_flags = 0;
-	nl_if->iov_out.iov_len = NLMSG_SPACE(data_len);
+	ret = nl_if_next_frame(nl_if, NL_IF_REFILL_NB, frame);
 
-	memcpy(NLMSG_DATA(nlh), nl_data_h, nl_data_h_len);
-	memcpy(NLMSG_DATA(nlh) + nl_data_h_len, goose_h, goose_h_len);
-	memcpy(NLMSG_DATA(nlh) + nl_data_h_len + goose_h_len,
-		   apdu, apdu_len);		
-	
-	ret = sendmsg(nl_if->sock_fd, &nl_if->msg_out, 0);
+	sem_post(&nl_if->access_in);
 
-	sem_post(&nl_if->access_out);
-	
 	return ret;
 }
 
-/* Well, this is an old version with lower efficiency */
-int send_goose_data_old(struct nl_interface *nl_if, struct nl_data_header *nl_data_h,
-						struct goosehdr *goose_h, unsigned char *apdu,
-						unsigned int apdu_len, unsigned short msg_type)
+/* Callback dispatch for event loops
+ * Call cb for every pending frame, until the socket is drained
+ * (then errno is EAGAIN) or budget frames are handled (budget 0
+ * means no limit). Call it when nl_if_fd(...) is readable. The
+ * frame is valid during cb only; cb may send, but must not
+ * receive on nl_if.
+ *
+ * Return value is the number of frames handled, or -1 on an error
+ * other than EAGAIN.
+ */
+int goose_dispatch(struct nl_interface *nl_if, goose_frame_cb cb, void *arg,
+				   unsigned int budget)
+{
+	struct goose_frame frame;
+	unsigned int num = 0;
+	int err = 0;
+
+	if (sem_trywait(&nl_if->access_in) != 0)
+		return (errno == EAGAIN) ? 0 : -1;
+
+	while ((budget == 0) || (num < budget)) {
+		if (nl_if_next_frame(nl_if, NL_IF_REFILL_NB, &frame) != 0) {
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+				err = errno;
+			break;
+		}
+		cb(&frame, arg);
+		num++;
+	}
+
+	sem_post(&nl_if->access_in);
+
+	if ((num == 0) && (err != 0)) {
+		errno = err;
+		return -1;
+	}
+	return (int) num;
+}
+
+/* AF_PACKET backend
+ * See struct nl_if_packet. Received frames are handed over as
+ * records in place in the RX ring: the IFNAMSIZE bytes reserved
+ * before each frame (PACKET_RESERVE) take the device name, so
+ * that the frame follows as it does from the module.
+ */
+
+/* Frames of the GOOSE ethertype, with or without an 802.1Q tag
+ * (a tag stripped by the device is not seen here)
+ */
+static struct sock_filter nl_if_pkt_bpf[] = {
+	{ BPF_LD  | BPF_H   | BPF_ABS, 0, 0, 12 },
+	{ BPF_JMP | BPF_JEQ | BPF_K,   3, 0, ETH_P_GOOSE },
+	{ BPF_JMP | BPF_JEQ | BPF_K,   0, 3, ETH_P_8021Q },
+	{ BPF_LD  | BPF_H   | BPF_ABS, 0, 0, 16 },
+	{ BPF_JMP | BPF_JEQ | BPF_K,   0, 1, ETH_P_GOOSE },
+	{ BPF_RET | BPF_K,             0, 0, 0xffffffff },
+	{ BPF_RET | BPF_K,             0, 0, 0 }
+};
+
+/* Offset of the frame in a TX ring frame */
+#define GOOSE_PKT_TX_OFF TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+
+static inline struct tpacket_block_desc *nl_if_pkt_block(struct nl_if_packet *pkt,
+														 unsigned int idx)
+{
+	return (struct tpacket_block_desc *) (pkt->map + idx * GOOSE_PKT_BLOCK_SIZE);
+}
+
+/* Make a record of an Ethernet frame received in place, with
+ * IFNAMSIZE bytes of our own before it for dev_name. A tag in the
+ * frame is taken off, rec->tstamp.vlan is left alone otherwise.
+ * Return -1 if the frame is too short.
+ */
+static int nl_if_eth_rec(unsigned char *mac, unsigned int len, const char *dev_name,
+						 struct nl_if_rec *rec)
+{
+	if (len < ETH_HLEN + 4 + sizeof(struct goosehdr))
+		return -1;
+
+	/* A tag in the frame: move the addresses over it */
+	if (((mac[12] << 8) | mac[13]) == ETH_P_8021Q) {
+		rec->tstamp.vlan = GOOSE_VLAN_PRESENT | (mac[14] << 8) | mac[15];
+		memmove(mac + 4, mac, 2 * ETH_ALEN);
+		mac += 4;
+		len -= 4;
+	}
+
+	rec->data = mac - IFNAMSIZE;
+	memcpy(rec->data, dev_name, IFNAMSIZE);
+	rec->len = IFNAMSIZE + len;
+	rec->tstamp.reserved = 0;
+
+	return 0;
+}
+
+/* Make a record of a frame of the RX ring.
+ * Return -1 if the frame is skipped.
+ */
+static int nl_if_pkt_rec(struct nl_interface *nl_if, struct tpacket3_hdr *hdr,
+						 struct nl_if_rec *rec)
+{
+	struct nl_if_packet *pkt = nl_if->pkt;
+	unsigned char *mac = (unsigned char *) hdr + hdr->tp_mac;
+	unsigned int appid;
+
+	if (hdr->tp_snaplen < hdr->tp_len) {
+		nl_if->in_trunc++;
+		return -1;
+	}
+
+	rec->tstamp.vlan = 0;
+	if (hdr->tp_status & TP_STATUS_VLAN_VALID)
+		rec->tstamp.vlan = GOOSE_VLAN_PRESENT | hdr->hv1.tp_vlan_tci;
+	rec->tstamp.rx = (unsigned long long) hdr->tp_sec * 1000000000ULL + hdr->tp_nsec;
+	rec->tstamp.queued = rec->tstamp.rx;
+
+	if (nl_if_eth_rec(mac, hdr->tp_snaplen, pkt->dev_name, rec) != 0) {
+		nl_if->in_bad++;
+		return -1;
+	}
+
+	if (__atomic_load_n(&pkt->sub_count, __ATOMIC_RELAXED) != 0) {
+		appid = (rec->data[IFNAMSIZE + ETH_HLEN] << 8) | rec->data[IFNAMSIZE + ETH_HLEN + 1];
+		if (!(__atomic_load_n(&pkt->sub[appid >> 3], __ATOMIC_RELAXED) & (1 << (appid & 7))))
+			return -1;
+	}
+
+	return 0;
+}
+
+/* SO_RCVTIMEO of the socket in ms, -1 if none */
+static int nl_if_rcv_timeout(int fd)
+{
+	struct timeval tv;
+	socklen_t len = sizeof(struct timeval);
+
+	if ((getsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, &len) != 0) ||
+		((tv.tv_sec == 0) && (tv.tv_usec == 0)))
+		return -1;
+
+	return tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000;
+}
+
+/* Get the next received GOOSE record from the RX ring, see
+ * nl_if_next_record(...). A block is given back to the kernel when
+ * the next one is taken, so the frames of the last call stay valid;
+ * without refill, no other block is taken.
+ */
+static int nl_if_pkt_next_record(struct nl_interface *nl_if, int refill,
+								 struct nl_if_rec *rec)
 {
+	struct nl_if_packet *pkt = nl_if->pkt;
+	struct tpacket_block_desc *bd;
+	struct tpacket3_hdr *hdr;
+	struct pollfd pfd;
+	socklen_t len = sizeof(int);
 	int ret;
-	unsigned int goose_len = apdu_len + sizeof(struct goosehdr);
-	unsigned int raw_data_len = goose_len + sizeof(struct nl_data_header);
 
-	/* raw_data includes all data needed to transmit to kernel,
-	 * including data interface header + goose hdr + apdu */
-	unsigned char *raw_data = malloc(raw_data_len);
+	while (1) {
+		/* Frames of the current block */
+		while (pkt->rx_left > 0) {
+			hdr = (struct tpacket3_hdr *) pkt->rx_next;
+			pkt->rx_left--;
+			pkt->rx_next += hdr->tp_next_offset;
+			if (nl_if_pkt_rec(nl_if, hdr, rec) == 0)
+				return 0;
+		}
 
-	/* compute the goose pktlen in header*/
-	goose_h->len = htons(goose_len);
+		if (!refill)
+			return -1;
 
-	memcpy(raw_data,
-		   nl_data_h, sizeof(struct nl_data_header));
+		/* Then, the next block */
+		bd = nl_if_pkt_block(pkt, pkt->rx_block);
+		if (pkt->rx_held) {
+			__atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+			pkt->rx_held = 0;
+			pkt->rx_block = (pkt->rx_block + 1) % GOOSE_PKT_RX_BLOCKS;
+			bd = nl_if_pkt_block(pkt, pkt->rx_block);
+		}
 
-	memcpy(raw_data + sizeof(struct nl_data_header),
-		   goose_h, sizeof(struct goosehdr));
+		if (__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) {
+			pkt->rx_held = 1;
+			pkt->rx_left = bd->hdr.bh1.num_pkts;
+			pkt->rx_next = (unsigned char *) bd + bd->hdr.bh1.offset_to_first_pkt;
+			nl_if->in_tstamp = nl_if_now();
+			continue;
+		}
 
-	memcpy(raw_data + sizeof(struct nl_data_header) + sizeof (struct goosehdr),
-		   apdu, apdu_len);
+		/* Wait for a block, unless NL_IF_REFILL_NB */
+		pfd.fd = nl_if->sock_fd;
+		pfd.events = POLLIN | POLLRDNORM;
+		pfd.revents = 0;
+		ret = poll(&pfd, 1, (refill == NL_IF_REFILL_NB) ? 0 : nl_if_rcv_timeout(nl_if->sock_fd));
+		if (ret < 0)
+			return -1;
+		if (ret == 0) {
+			errno = EAGAIN;
+			return -1;
+		}
+		if (pfd.revents & POLLERR) {
+			/* Clear a pending socket error, it is not ours */
+			getsockopt(nl_if->sock_fd, SOL_SOCKET, SO_ERROR, &ret, &len);
+		}
+	}
+}
 
-	ret = send_raw(nl_if, raw_data, raw_data_len, msg_type);
-	
-	free(raw_data);
+/* Copy len bytes at offset off of the gathered parts to buf.
+ * Return the bytes copied.
+ */
+static unsigned int nl_if_gather(const struct iovec *parts, unsigned int num,
+								 unsigned int off, void *buf, unsigned int len)
+{
+	unsigned int i, n, done = 0;
 
-	return ret;
+	for (i = 0; (i < num) && (done < len); i++) {
+		if (off >= parts[i].iov_len) {
+			off -= parts[i].iov_len;
+			continue;
+		}
+		n = parts[i].iov_len - off;
+		if (n > len - done)
+			n = len - done;
+		memcpy((unsigned char *) buf + done, (unsigned char *) parts[i].iov_base + off, n);
+		done += n;
+		off = 0;
+	}
+
+	return done;
 }
 
-/* The API for sending GOOSE transmission control information
+/* Hand the frames put in the TX ring to the device. Without wait,
+ * their frames are given back to us later, as they are sent.
  */
+static int nl_if_pkt_kick(struct nl_interface *nl_if, int wait)
+{
+	struct sockaddr_ll addr;
 
-inline int send_goose_ctrl(struct nl_interface *nl_if, struct nl_ctrl_header *ctrl_info)
+	memset(&addr, 0, sizeof(struct sockaddr_ll));
+	addr.sll_family = AF_PACKET;
+	addr.sll_protocol = htons(ETH_P_GOOSE);
+	addr.sll_ifindex = nl_if->pkt->ifindex;
+
+	return sendto(nl_if->sock_fd, NULL, 0, wait ? 0 : MSG_DONTWAIT,
+				  (struct sockaddr *) &addr, sizeof(struct sockaddr_ll));
+}
+
+/* Put a frame in the TX ring: | daddr | haddr | ETH_P_GOOSE | payload |,
+ * the payload gathered from parts after skip bytes. When the ring
+ * is full, what is in it is sent first.
+ * Return 0, or -1 if the frame is not put.
+ */
+static int nl_if_pkt_put(struct nl_interface *nl_if, const unsigned char *daddr,
+						 const struct iovec *parts, unsigned int num,
+						 unsigned int skip, unsigned int len)
 {
-	return send_raw(nl_if, (unsigned char*) ctrl_info,
-					sizeof(struct nl_ctrl_header), NL_MSG_CTRL);
-	
+	struct nl_if_packet *pkt = nl_if->pkt;
+	struct tpacket3_hdr *hdr;
+	unsigned char *frame;
+
+	if (GOOSE_PKT_TX_OFF + ETH_HLEN + len > pkt->tx_frame_size) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	hdr = (struct tpacket3_hdr *) (pkt->tx_ring + pkt->tx_head * pkt->tx_frame_size);
+	if ((__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) &
+		 (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING)) &&
+		((nl_if_pkt_kick(nl_if, 1) < 0) ||
+		 (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) &
+		  (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING)))) {
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	frame = (unsigned char *) hdr + GOOSE_PKT_TX_OFF;
+	memcpy(frame, daddr, ETH_ALEN);
+	memcpy(frame + ETH_ALEN, pkt->haddr, ETH_ALEN);
+	frame[12] = ETH_P_GOOSE >> 8;
+	frame[13] = ETH_P_GOOSE & 0xff;
+	nl_if_gather(parts, num, skip, frame + ETH_HLEN, len);
+
+	hdr->tp_len = ETH_HLEN + len;
+	hdr->tp_snaplen = ETH_HLEN + len;
+	hdr->tp_next_offset = 0;
+	__atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+	pkt->tx_head = (pkt->tx_head + 1) % pkt->tx_frame_num;
+	return 0;
+}
+
+static const unsigned char nl_if_bcast[ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+/* Messages of send_raw(...) and friends, for backends sending
+ * Ethernet frames themselves (ops->put, ops->kick):
+ * | nl_data_header | goosehdr | apdu | frames are sent, and
+ * subscriptions go to ops->subscribe; all else needs the module.
+ */
+static int nl_if_raw_send_parts(struct nl_interface *nl_if, unsigned short msg_type,
+								const struct iovec *parts, unsigned int num)
+{
+	struct nl_data_header nl_data_h;
+	struct nl_sub_header nl_sub_h;
+	unsigned int i, len = 0;
+	int ret;
+
+	for (i = 0; i < num; i++)
+		len += parts[i].iov_len;
+
+	switch (msg_type) {
+	case NL_MSG_REPORT_TO_MODULE:
+		return 0;
+	case NL_MSG_SUBSCRIBE:
+	case NL_MSG_UNSUBSCRIBE:
+		if (nl_if_gather(parts, num, 0, &nl_sub_h, sizeof(struct nl_sub_header)) !=
+			sizeof(struct nl_sub_header))
+			break;
+		/* No lock, a receiving thread may wait with access_in */
+		nl_if->ops->subscribe(nl_if, nl_sub_h.appid, msg_type == NL_MSG_SUBSCRIBE);
+		return len;
+	default:
+		if (!(msg_type & (NL_MSG_DATA_BRDCAST | NL_MSG_DATA_UNICAST)) ||
+			(msg_type & ~(NL_MSG_DATA_BRDCAST | NL_MSG_DATA_UNICAST | NL_MSG_DATA_RELB)))
+			break;
+		if (len < sizeof(struct nl_data_header) + sizeof(struct goosehdr)) {
+			errno = EINVAL;
+			return -1;
+		}
+		nl_if_gather(parts, num, 0, &nl_data_h, sizeof(struct nl_data_header));
+
+		sem_wait(&nl_if->access_out);
+		ret = nl_if->ops->put(nl_if, (msg_type & NL_MSG_DATA_BRDCAST) ?
+							  nl_if_bcast : nl_data_h.daddr,
+							  parts, num, sizeof(struct nl_data_header),
+							  len - sizeof(struct nl_data_header));
+		if (ret == 0)
+			ret = nl_if->ops->kick(nl_if, 0);
+		sem_post(&nl_if->access_out);
+
+		return (ret < 0) ? -1 : (int) len;
+	}
+
+	errno = EOPNOTSUPP;
+	return -1;
+}
+
+/* Batches of send_goose_batch(...): all records are put, then one
+ * ops->kick sends them. TX timestamps are taken when it returns.
+ */
+static int nl_if_raw_send_batch(struct nl_interface *nl_if, struct goose_batch_rec *recs,
+								unsigned int num, int *status)
+{
+	struct iovec parts[2];
+	unsigned long long tstamp;
+	unsigned int i, j;
+	int ret = 0, err = 0;
+
+	sem_wait(&nl_if->access_out);
+
+	for (i = 0; i < num; i++) {
+		/* compute the goose pktlen in header*/
+		recs[i].goose_h->len = htons(recs[i].apdu_len + sizeof(struct goosehdr));
+
+		parts[0].iov_base = recs[i].goose_h;
+		parts[0].iov_len = sizeof(struct goosehdr);
+		parts[1].iov_base = recs[i].apdu;
+		parts[1].iov_len = recs[i].apdu_len;
+
+		ret = nl_if->ops->put(nl_if, (recs[i].msg_type & NL_MSG_DATA_BRDCAST) ?
+							  nl_if_bcast : recs[i].nl_data_h->daddr,
+							  parts, 2, 0, sizeof(struct goosehdr) + recs[i].apdu_len);
+		if (ret != 0)
+			break;
+	}
+
+	if (i != 0)
+		ret = nl_if->ops->kick(nl_if, 0);
+	err = (ret < 0) ? -errno : 0;
+	tstamp = nl_if_now();
+
+	for (j = 0; j < i; j++) {
+		if (status != NULL)
+			status[j] = err;
+		if (recs[j].msg_type & NL_MSG_DATA_TSTAMP)
+			recs[j].tx_tstamp = tstamp;
+	}
+
+	sem_post(&nl_if->access_out);
+
+	return ((ret < 0) && ((i == 0) || (status == NULL))) ? -1 : (int) i;
+}
+
+/* APPIDs of goose_subscribe(...), taken by nl_if_pkt_rec(...) */
+static void nl_if_pkt_subscribe(struct nl_interface *nl_if, unsigned short appid, int on)
+{
+	struct nl_if_packet *pkt = nl_if->pkt;
+	unsigned char bit = 1 << (appid & 7), old;
+
+	if (on) {
+		old = __atomic_fetch_or(&pkt->sub[appid >> 3], bit, __ATOMIC_RELAXED);
+		if (!(old & bit))
+			__atomic_add_fetch(&pkt->sub_count, 1, __ATOMIC_RELAXED);
+	} else {
+		old = __atomic_fetch_and(&pkt->sub[appid >> 3], (unsigned char) ~bit, __ATOMIC_RELAXED);
+		if (old & bit)
+			__atomic_sub_fetch(&pkt->sub_count, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static void nl_if_pkt_close(struct nl_interface *nl_if)
+{
+	/* Frames still in the TX ring go out first */
+	nl_if_pkt_kick(nl_if, 1);
+
+	munmap(nl_if->pkt->map, nl_if->pkt->map_len);
+	close(nl_if->sock_fd);
+	free(nl_if->pkt);
+	nl_if->pkt = NULL;
+}
+
+static const struct nl_if_ops nl_if_packet_ops = {
+	.backend     = NL_IF_BACKEND_PACKET,
+	.send_parts  = nl_if_raw_send_parts,
+	.send_batch  = nl_if_raw_send_batch,
+	.next_record = nl_if_pkt_next_record,
+	.close       = nl_if_pkt_close,
+	.put         = nl_if_pkt_put,
+	.kick        = nl_if_pkt_kick,
+	.subscribe   = nl_if_pkt_subscribe
+};
+
+/* AF_PACKET interface constructor
+ * Same APIs as nl_if_init(...), on dev_name without the kernel
+ * module (see struct nl_if_packet). Needs CAP_NET_RAW.
+ */
+int nl_if_init_packet(struct nl_interface *nl_if, const char *dev_name)
+{
+	struct nl_if_packet *pkt;
+	struct tpacket_req3 req;
+	struct sock_fprog fprog = {
+		.len = sizeof(nl_if_pkt_bpf) / sizeof(struct sock_filter),
+		.filter = nl_if_pkt_bpf
+	};
+	struct packet_mreq mreq;
+	struct sockaddr_ll addr;
+	struct ifreq ifr;
+	size_t rx_len;
+	int fd, mtu, ver = TPACKET_V3, reserve = IFNAMSIZE, one = 1;
+
+	memset(nl_if, 0, sizeof(struct nl_interface));
+	nl_if->ops = &nl_if_packet_ops;
+	nl_if->tx.fd = -1;
+
+	pkt = (struct nl_if_packet *) calloc(1, sizeof(struct nl_if_packet));
+	if (pkt == NULL)
+		return -1;
+	strncpy(pkt->dev_name, dev_name, IFNAMSIZE - 1);
+	pkt->ifindex = if_nametoindex(dev_name);
+	mtu = goose_dev_mtu(dev_name);
+	if ((pkt->ifindex == 0) || (mtu <= 0)) {
+		free(pkt);
+		errno = ENODEV;
+		return -1;
+	}
+	if (mtu > GOOSE_MAX_FRAME_LEN)
+		mtu = GOOSE_MAX_FRAME_LEN;
+
+	/* Largest frame handed over, tagged; dispatcher slots take it */
+	nl_if->in_buf_len = ETH_HLEN + 4 + mtu;
+
+	/* No protocol yet: nothing is received before the filter and the ring */
+	fd = socket(AF_PACKET, SOCK_RAW, 0);
+	if (fd < 0) {
+		free(pkt);
+		return -1;
+	}
+
+	memset(&ifr, 0, sizeof(struct ifreq));
+	strncpy(ifr.ifr_name, dev_name, IFNAMSIZ - 1);
+	if ((ioctl(fd, SIOCGIFHWADDR, &ifr) != 0) ||
+		(setsockopt(fd, SOL_PACKET, PACKET_VERSION, &ver, sizeof(int)) != 0) ||
+		(setsockopt(fd, SOL_PACKET, PACKET_RESERVE, &reserve, sizeof(int)) != 0) ||
+		(setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) != 0))
+		goto err_close;
+	memcpy(pkt->haddr, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+
+	/* Frames go to the driver at once (Linux 3.14), else by the qdisc */
+	setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(int));
+
+	memset(&req, 0, sizeof(struct tpacket_req3));
+	req.tp_block_size = GOOSE_PKT_BLOCK_SIZE;
+	req.tp_block_nr = GOOSE_PKT_RX_BLOCKS;
+	req.tp_frame_size = GOOSE_PKT_FRAME_SIZE;
+	req.tp_frame_nr = GOOSE_PKT_BLOCK_SIZE / GOOSE_PKT_FRAME_SIZE * GOOSE_PKT_RX_BLOCKS;
+	req.tp_retire_blk_tov = GOOSE_PKT_RX_TOV;
+	if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0)
+		goto err_close;
+	rx_len = (size_t) GOOSE_PKT_BLOCK_SIZE * GOOSE_PKT_RX_BLOCKS;
+
+	/* A TX frame holds a frame of the MTU */
+	pkt->tx_frame_size = GOOSE_PKT_FRAME_SIZE;
+	while (pkt->tx_frame_size < GOOSE_PKT_TX_OFF + ETH_HLEN + mtu)
+		pkt->tx_frame_size <<= 1;
+	pkt->tx_frame_num = GOOSE_PKT_BLOCK_SIZE / pkt->tx_frame_size * GOOSE_PKT_TX_BLOCKS;
+
+	memset(&req, 0, sizeof(struct tpacket_req3));
+	req.tp_block_size = GOOSE_PKT_BLOCK_SIZE;
+	req.tp_block_nr = GOOSE_PKT_TX_BLOCKS;
+	req.tp_frame_size = pkt->tx_frame_size;
+	req.tp_frame_nr = pkt->tx_frame_num;
+	if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) != 0)
+		goto err_close;
+
+	/* One mapping, the RX ring first */
+	pkt->map_len = rx_len + (size_t) GOOSE_PKT_BLOCK_SIZE * GOOSE_PKT_TX_BLOCKS;
+	pkt->map = (unsigned char *) mmap(NULL, pkt->map_len, PROT_READ | PROT_WRITE,
+									  MAP_SHARED | MAP_POPULATE, fd, 0);
+	if (pkt->map == MAP_FAILED)
+		goto err_close;
+	pkt->tx_ring = pkt->map + rx_len;
+
+	/* GOOSE goes to multicast addresses */
+	memset(&mreq, 0, sizeof(struct packet_mreq));
+	mreq.mr_ifindex = pkt->ifindex;
+	mreq.mr_type = PACKET_MR_ALLMULTI;
+	if (setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0)
+		goto err_unmap;
+
+	/* ETH_P_ALL, so that frames with a tag pass too */
+	memset(&addr, 0, sizeof(struct sockaddr_ll));
+	addr.sll_family = AF_PACKET;
+	addr.sll_protocol = htons(ETH_P_ALL);
+	addr.sll_ifindex = pkt->ifindex;
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(struct sockaddr_ll)) != 0)
+		goto err_unmap;
+
+	nl_if->sock_fd = fd;
+	nl_if->pkt = pkt;
+
+	sem_init(&nl_if->access_in,  0, 1);
+	sem_init(&nl_if->access_out, 0, 1);
+	return 0;
+
+err_unmap:
+	munmap(pkt->map, pkt->map_len);
+err_close:
+	close(fd);
+	free(pkt);
+	return -1;
+}
+
+/* AF_XDP backend
+ * See struct nl_if_xdp. The XDP program is assembled here and
+ * loaded with bpf(2), there is no libbpf.
+ */
+#if defined(XDP_USE_NEED_WAKEUP)
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL      69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET      70
+#endif
+
+/* Key of the APPID map: redirect all APPIDs */
+#define GOOSE_XDP_APPID_ALL      65536
+
+#define GOOSE_XDP_KICKS          64    /* sendto() for one wake-up */
+
+#define GOOSE_BPF_INSN(c, d, s, o, i) \
+	((struct bpf_insn) { .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) })
+#define GOOSE_BPF_MAP_FD(d, fd) \
+	GOOSE_BPF_INSN(BPF_LD | BPF_DW | BPF_IMM, d, BPF_PSEUDO_MAP_FD, 0, fd), \
+	GOOSE_BPF_INSN(0, 0, 0, 0, 0)
+
+static inline int nl_if_bpf(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof(union bpf_attr));
+}
+
+static int nl_if_bpf_map(unsigned int type, unsigned int entries)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(union bpf_attr));
+	attr.map_type = type;
+	attr.key_size = sizeof(unsigned int);
+	attr.value_size = sizeof(unsigned int);
+	attr.max_entries = entries;
+
+	return nl_if_bpf(BPF_MAP_CREATE, &attr);
+}
+
+static int nl_if_bpf_set(int map_fd, unsigned int key, unsigned int value)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(union bpf_attr));
+	attr.map_fd = map_fd;
+	attr.key = (unsigned long) &key;
+	attr.value = (unsigned long) &value;
+
+	return nl_if_bpf(BPF_MAP_UPDATE_ELEM, &attr);
+}
+
+/* The XDP program:
+ *   if the frame is GOOSE (tagged or not) and its APPID, or
+ *   GOOSE_XDP_APPID_ALL, is set in the APPID map
+ *       redirect it to the socket of its queue in the XSK map
+ *   else XDP_PASS
+ */
+static int nl_if_xdp_load(struct nl_if_xdp *xdp)
+{
+	struct bpf_insn prog[] = {
+		/* r6 = ctx, r7 = data, r8 = data_end */
+		GOOSE_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0),
+		GOOSE_BPF_INSN(BPF_LDX | BPF_W | BPF_MEM, 7, 6, offsetof(struct xdp_md, data), 0),
+		GOOSE_BPF_INSN(BPF_LDX | BPF_W | BPF_MEM, 8, 6, offsetof(struct xdp_md, data_end), 0),
+		/* 3: type and APPID in the frame */
+		GOOSE_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, 2, 7, 0, 0),
+		GOOSE_BPF_INSN(BPF_ALU64 | BPF_ADD | BPF_K, 2, 0, 0, ETH_HLEN + 4),
+		GOOSE_BPF_INSN(BPF_JMP | BPF_JGT | BPF_X, 2, 8, 34, 0),
+		GOOSE_BPF_INSN(BPF_LDX | BPF_H | BPF_MEM, 3, 7, 12, 0),
+		GOOSE_BPF_INSN(BPF_JMP | BPF_JNE | BPF_K, 3, 0, 5, htons(ETH_P_8021Q)),
+		/* 8: skip the tag */
+		GOOSE_BPF_INSN(BPF_ALU64 | BPF_ADD | BPF_K, 7, 0, 0, 4),
+		GOOSE_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, 2, 7, 0, 0),
+		GOOSE_BPF_INSN(BPF_ALU64 | BPF_ADD | BPF_K, 2, 0, 0, ETH_HLEN + 4),
+		GOOSE_BPF_INSN(BPF_JMP | BPF_JGT | BPF_X, 2, 8, 28, 0),
+		GOOSE_BPF_INSN(BPF_LDX | BPF_H | BPF_MEM, 3, 7, 12, 0),
+		/* 13: GOOSE, look its APPID up */
+		GOOSE_BPF_INSN(BPF_JMP | BPF_JNE | BPF_K, 3, 0, 26, htons(ETH_P_GOOSE)),
+		GOOSE_BPF_INSN(BPF_LDX | BPF_H | BPF_MEM, 3, 7, ETH_HLEN, 0),
+		GOOSE_BPF_INSN(BPF_ALU | BPF_END | BPF_TO_BE, 3, 0, 0, 16),
+		GOOSE_BPF_INSN(BPF_STX | BPF_W | BPF_MEM, 10, 3, -4, 0),
+		GOOSE_BPF_MAP_FD(1, xdp->appid_map_fd),
+		GOOSE_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, 2, 10, 0, 0),
+		GOOSE_BPF_INSN(BPF_ALU64 | BPF_ADD | BPF_K, 2, 0, 0, -4),
+		GOOSE_BPF_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+		GOOSE_BPF_INSN(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 2, 0),
+		GOOSE_BPF_INSN(BPF_LDX | BPF_W | BPF_MEM, 1, 0, 0, 0),
+		GOOSE_BPF_INSN(BPF_JMP | BPF_JNE | BPF_K, 1, 0, 9, 0),
+		/* 25: not subscribed, unless all are */
+		GOOSE_BPF_INSN(BPF_ST | BPF_W | BPF_MEM, 10, 0, -4, GOOSE_XDP_APPID_ALL),
+		GOOSE_BPF_MAP_FD(1, xdp->appid_map_fd),
+		GOOSE_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, 2, 10, 0, 0),
+		GOOSE_BPF_INSN(BPF_ALU64 | BPF_ADD | BPF_K, 2, 0, 0, -4),
+		GOOSE_BPF_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+		GOOSE_BPF_INSN(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 8, 0),
+		GOOSE_BPF_INSN(BPF_LDX | BPF_W | BPF_MEM, 1, 0, 0, 0),
+		GOOSE_BPF_INSN(BPF_JMP | BPF_JEQ | BPF_K, 1, 0, 6, 0),
+		/* 34: to the socket of the queue, passed if there is none */
+		GOOSE_BPF_MAP_FD(1, xdp->xsk_map_fd),
+		GOOSE_BPF_INSN(BPF_LDX | BPF_W | BPF_MEM, 2, 6, offsetof(struct xdp_md, rx_queue_index), 0),
+		GOOSE_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS),
+		GOOSE_BPF_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+		GOOSE_BPF_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+		/* 40 */
+		GOOSE_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS),
+		GOOSE_BPF_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+	};
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(union bpf_attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insns = (unsigned long) prog;
+	attr.insn_cnt = sizeof(prog) / sizeof(struct bpf_insn);
+	attr.license = (unsigned long) "GPL";
+
+	xdp->prog_fd = nl_if_bpf(BPF_PROG_LOAD, &attr);
+	return (xdp->prog_fd < 0) ? -1 : 0;
+}
+
+/* Attach the program to the device, until link_fd is closed */
+static int nl_if_xdp_attach(struct nl_if_xdp *xdp, int mode)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(union bpf_attr));
+	attr.link_create.prog_fd = xdp->prog_fd;
+	attr.link_create.target_ifindex = xdp->ifindex;
+	attr.link_create.attach_type = BPF_XDP;
+
+	if (mode != GOOSE_XDP_MODE_SKB) {
+		attr.link_create.flags = XDP_FLAGS_DRV_MODE;
+		xdp->link_fd = nl_if_bpf(BPF_LINK_CREATE, &attr);
+		if ((xdp->link_fd >= 0) || (mode == GOOSE_XDP_MODE_DRV))
+			return (xdp->link_fd < 0) ? -1 : 0;
+	}
+
+	attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+	xdp->link_fd = nl_if_bpf(BPF_LINK_CREATE, &attr);
+	return (xdp->link_fd < 0) ? -1 : 0;
+}
+
+/* Map ring off of the socket, of n descriptors of size bytes */
+static int nl_if_xdp_ring(int fd, struct goose_xdp_ring *ring,
+						  const struct xdp_ring_offset *off, unsigned int size,
+						  unsigned long long pgoff)
+{
+	ring->map_len = off->desc + GOOSE_XDP_RING_SIZE * size;
+	ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+					 MAP_SHARED | MAP_POPULATE, fd, pgoff);
+	if (ring->map == MAP_FAILED) {
+		ring->map = NULL;
+		return -1;
+	}
+
+	ring->producer = (unsigned int *) ((char *) ring->map + off->producer);
+	ring->consumer = (unsigned int *) ((char *) ring->map + off->consumer);
+	ring->flags = (unsigned int *) ((char *) ring->map + off->flags);
+	ring->desc = (char *) ring->map + off->desc;
+	return 0;
+}
+
+/* Give the frames of the last pull back to the fill ring */
+static void nl_if_xdp_release(struct nl_if_xdp *xdp)
+{
+	struct xdp_desc *desc = (struct xdp_desc *) xdp->rx.desc;
+	unsigned long long *fill = (unsigned long long *) xdp->fill.desc;
+	unsigned int i;
+
+	for (i = 0; i < xdp->rx_num; i++)
+		fill[(xdp->fill.cached + i) & (GOOSE_XDP_RING_SIZE - 1)] =
+			desc[(xdp->rx.cached + i) & (GOOSE_XDP_RING_SIZE - 1)].addr &
+			~((unsigned long long) GOOSE_XDP_FRAME_SIZE - 1);
+
+	xdp->fill.cached += xdp->rx_num;
+	__atomic_store_n(xdp->fill.producer, xdp->fill.cached, __ATOMIC_RELEASE);
+	xdp->rx.cached += xdp->rx_num;
+	__atomic_store_n(xdp->rx.consumer, xdp->rx.cached, __ATOMIC_RELEASE);
+
+	xdp->rx_num = 0;
+	xdp->rx_idx = 0;
+}
+
+/* Get the next received GOOSE record from the RX ring, see
+ * nl_if_next_record(...). Descriptors are pulled GOOSE_XDP_RX_BATCH
+ * at most at once, and given back when the next ones are pulled.
+ */
+static int nl_if_xdp_next_record(struct nl_interface *nl_if, int refill,
+								 struct nl_if_rec *rec)
+{
+	struct nl_if_xdp *xdp = nl_if->xdp;
+	struct xdp_desc *desc;
+	struct pollfd pfd;
+	unsigned int avail;
+	int ret, polled = 0;
+
+	while (1) {
+		/* Frames of the last pull */
+		while (xdp->rx_idx < xdp->rx_num) {
+			desc = &((struct xdp_desc *) xdp->rx.desc)[(xdp->rx.cached + xdp->rx_idx++) &
+													   (GOOSE_XDP_RING_SIZE - 1)];
+			rec->tstamp.vlan = 0;
+			rec->tstamp.rx = nl_if->in_tstamp;
+			rec->tstamp.queued = nl_if->in_tstamp;
+			if (nl_if_eth_rec(xdp->umem + desc->addr, desc->len, xdp->dev_name, rec) == 0)
+				return 0;
+			nl_if->in_bad++;
+		}
+
+		if (!refill)
+			return -1;
+
+		/* Then, the next ones */
+		if (xdp->rx_num != 0)
+			nl_if_xdp_release(xdp);
+
+		avail = __atomic_load_n(xdp->rx.producer, __ATOMIC_ACQUIRE) - xdp->rx.cached;
+		if (avail != 0) {
+			xdp->rx_num = (avail < GOOSE_XDP_RX_BATCH) ? avail : GOOSE_XDP_RX_BATCH;
+			nl_if->in_tstamp = nl_if_now();
+			continue;
+		}
+
+		/* Busy poll the queue (or wake the driver up to fill) once */
+		if (!polled) {
+			polled = 1;
+			recvfrom(nl_if->sock_fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+			continue;
+		}
+
+		if (refill == NL_IF_REFILL_NB) {
+			errno = EAGAIN;
+			return -1;
+		}
+
+		pfd.fd = nl_if->sock_fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		ret = poll(&pfd, 1, nl_if_rcv_timeout(nl_if->sock_fd));
+		if (ret < 0)
+			return -1;
+		if (ret == 0) {
+			errno = EAGAIN;
+			return -1;
+		}
+		polled = 0;
+	}
+}
+
+/* Take back the TX frames the kernel is done with */
+static void nl_if_xdp_complete(struct nl_if_xdp *xdp)
+{
+	unsigned long long *comp = (unsigned long long *) xdp->comp.desc;
+	unsigned int prod = __atomic_load_n(xdp->comp.producer, __ATOMIC_ACQUIRE);
+
+	for (; xdp->comp.cached != prod; xdp->comp.cached++)
+		xdp->tx_free[xdp->tx_free_num++] = comp[xdp->comp.cached & (GOOSE_XDP_RING_SIZE - 1)];
+	__atomic_store_n(xdp->comp.consumer, xdp->comp.cached, __ATOMIC_RELEASE);
+}
+
+/* Publish the TX descriptors put and wake the kernel up if it
+ * needs it; with wait, until all frames are sent.
+ */
+static int nl_if_xdp_kick(struct nl_interface *nl_if, int wait)
+{
+	struct nl_if_xdp *xdp = nl_if->xdp;
+	unsigned int i;
+	int ret = 0;
+
+	__atomic_store_n(xdp->tx.producer, xdp->tx.cached, __ATOMIC_RELEASE);
+
+	/* In copy mode, a wake-up sends a limited number of frames */
+	for (i = 0; i < GOOSE_XDP_KICKS; i++) {
+		if (!(__atomic_load_n(xdp->tx.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP) ||
+			(__atomic_load_n(xdp->tx.consumer, __ATOMIC_ACQUIRE) == xdp->tx.cached))
+			break;
+		ret = sendto(nl_if->sock_fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+		if ((ret < 0) && (errno != EAGAIN) && (errno != EBUSY) && (errno != ENOBUFS))
+			return -1;
+		ret = 0;
+	}
+
+	nl_if_xdp_complete(xdp);
+	while (wait && (xdp->tx_free_num < GOOSE_XDP_FRAMES / 2) && (i++ < 1000 * GOOSE_XDP_KICKS)) {
+		if (__atomic_load_n(xdp->tx.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP)
+			sendto(nl_if->sock_fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+		sched_yield();
+		nl_if_xdp_complete(xdp);
+	}
+
+	return ret;
+}
+
+/* Put a frame in the TX ring, see nl_if_pkt_put(...). When no TX
+ * frame is free, what is in the ring is sent first.
+ */
+static int nl_if_xdp_put(struct nl_interface *nl_if, const unsigned char *daddr,
+						 const struct iovec *parts, unsigned int num,
+						 unsigned int skip, unsigned int len)
+{
+	struct nl_if_xdp *xdp = nl_if->xdp;
+	struct xdp_desc *desc;
+	unsigned char *frame;
+	unsigned long long addr;
+	unsigned int i;
+
+	if (ETH_HLEN + len > GOOSE_XDP_FRAME_SIZE) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	if (xdp->tx_free_num == 0)
+		nl_if_xdp_complete(xdp);
+	for (i = 0; (xdp->tx_free_num == 0) && (i < GOOSE_XDP_KICKS); i++) {
+		if (nl_if_xdp_kick(nl_if, 0) < 0)
+			return -1;
+		if (xdp->tx_free_num == 0)
+			sched_yield();
+	}
+	if (xdp->tx_free_num == 0) {
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	addr = xdp->tx_free[--xdp->tx_free_num];
+	frame = xdp->umem + addr;
+	memcpy(frame, daddr, ETH_ALEN);
+	memcpy(frame + ETH_ALEN, xdp->haddr, ETH_ALEN);
+	frame[12] = ETH_P_GOOSE >> 8;
+	frame[13] = ETH_P_GOOSE & 0xff;
+	nl_if_gather(parts, num, skip, frame + ETH_HLEN, len);
+
+	desc = &((struct xdp_desc *) xdp->tx.desc)[xdp->tx.cached & (GOOSE_XDP_RING_SIZE - 1)];
+	desc->addr = addr;
+	desc->len = ETH_HLEN + len;
+	desc->options = 0;
+	xdp->tx.cached++;
+
+	return 0;
+}
+
+/* APPIDs of goose_subscribe(...), in the map of the program */
+static void nl_if_xdp_subscribe(struct nl_interface *nl_if, unsigned short appid, int on)
+{
+	struct nl_if_xdp *xdp = nl_if->xdp;
+
+	/* The first one stops redirecting all APPIDs, the last one restarts it */
+	if (on) {
+		nl_if_bpf_set(xdp->appid_map_fd, appid, 1);
+		if (__atomic_add_fetch(&xdp->sub_count, 1, __ATOMIC_RELAXED) == 1)
+			nl_if_bpf_set(xdp->appid_map_fd, GOOSE_XDP_APPID_ALL, 0);
+	} else if (xdp->sub_count != 0) {
+		nl_if_bpf_set(xdp->appid_map_fd, appid, 0);
+		if (__atomic_sub_fetch(&xdp->sub_count, 1, __ATOMIC_RELAXED) == 0)
+			nl_if_bpf_set(xdp->appid_map_fd, GOOSE_XDP_APPID_ALL, 1);
+	}
+}
+
+static void nl_if_xdp_free(struct nl_if_xdp *xdp)
+{
+	struct goose_xdp_ring *rings[4] = {&xdp->rx, &xdp->tx, &xdp->fill, &xdp->comp};
+	unsigned int i;
+
+	/* Detach the program first, then the maps go with it */
+	if (xdp->link_fd >= 0)
+		close(xdp->link_fd);
+	if (xdp->prog_fd >= 0)
+		close(xdp->prog_fd);
+	if (xdp->xsk_map_fd >= 0)
+		close(xdp->xsk_map_fd);
+	if (xdp->appid_map_fd >= 0)
+		close(xdp->appid_map_fd);
+	for (i = 0; i < 4; i++)
+		if (rings[i]->map != NULL)
+			munmap(rings[i]->map, rings[i]->map_len);
+	if (xdp->umem != NULL)
+		munmap(xdp->umem, xdp->umem_len);
+	free(xdp);
+}
+
+static void nl_if_xdp_close(struct nl_interface *nl_if)
+{
+	/* Frames still in the TX ring go out first */
+	nl_if_xdp_kick(nl_if, 1);
+
+	close(nl_if->sock_fd);
+	nl_if_xdp_free(nl_if->xdp);
+	nl_if->xdp = NULL;
+}
+
+static const struct nl_if_ops nl_if_xdp_ops = {
+	.backend     = NL_IF_BACKEND_XDP,
+	.send_parts  = nl_if_raw_send_parts,
+	.send_batch  = nl_if_raw_send_batch,
+	.next_record = nl_if_xdp_next_record,
+	.close       = nl_if_xdp_close,
+	.put         = nl_if_xdp_put,
+	.kick        = nl_if_xdp_kick,
+	.subscribe   = nl_if_xdp_subscribe
+};
+
+/* AF_XDP interface constructor
+ * Same APIs as nl_if_init(...), on queue of dev_name without the
+ * kernel module (see struct nl_if_xdp). mode is GOOSE_XDP_MODE_XXX.
+ */
+int nl_if_init_xdp(struct nl_interface *nl_if, const char *dev_name,
+				   unsigned int queue, int mode)
+{
+	struct nl_if_xdp *xdp;
+	struct xdp_umem_reg mr;
+	struct xdp_mmap_offsets off;
+	struct sockaddr_xdp addr;
+	struct ifreq ifr;
+	socklen_t len = sizeof(struct xdp_mmap_offsets);
+	unsigned long long *fill;
+	unsigned int i, ring_size = GOOSE_XDP_RING_SIZE;
+	int fd, opt;
+
+	memset(nl_if, 0, sizeof(struct nl_interface));
+	nl_if->ops = &nl_if_xdp_ops;
+	nl_if->tx.fd = -1;
+
+	if (queue >= GOOSE_XDP_MAX_QUEUES) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	xdp = (struct nl_if_xdp *) calloc(1, sizeof(struct nl_if_xdp));
+	if (xdp == NULL)
+		return -1;
+	xdp->prog_fd = xdp->link_fd = xdp->xsk_map_fd = xdp->appid_map_fd = -1;
+	strncpy(xdp->dev_name, dev_name, IFNAMSIZE - 1);
+	xdp->queue = queue;
+	xdp->ifindex = if_nametoindex(dev_name);
+	if (xdp->ifindex == 0) {
+		free(xdp);
+		errno = ENODEV;
+		return -1;
+	}
+
+	fd = socket(AF_XDP, SOCK_RAW, 0);
+	if (fd < 0) {
+		free(xdp);
+		return -1;
+	}
+
+	memset(&ifr, 0, sizeof(struct ifreq));
+	strncpy(ifr.ifr_name, dev_name, IFNAMSIZ - 1);
+	opt = socket(AF_INET, SOCK_DGRAM, 0);
+	if ((opt < 0) || (ioctl(opt, SIOCGIFHWADDR, &ifr) != 0)) {
+		if (opt >= 0)
+			close(opt);
+		goto err_close;
+	}
+	close(opt);
+	memcpy(xdp->haddr, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+
+	/* Largest frame handed over, tagged and within a UMEM frame;
+	 * dispatcher slots take it
+	 */
+	opt = goose_dev_mtu(dev_name);
+	if (opt <= 0)
+		opt = ETH_DATA_LEN;
+	nl_if->in_buf_len = ETH_HLEN + 4 + ((opt < GOOSE_MAX_FRAME_LEN) ? opt : GOOSE_MAX_FRAME_LEN);
+	if (nl_if->in_buf_len > GOOSE_XDP_FRAME_SIZE)
+		nl_if->in_buf_len = GOOSE_XDP_FRAME_SIZE;
+
+	/* UMEM: the first half receives, the second half sends */
+	xdp->umem_len = (size_t) GOOSE_XDP_FRAMES * GOOSE_XDP_FRAME_SIZE;
+	xdp->umem = (unsigned char *) mmap(NULL, xdp->umem_len, PROT_READ | PROT_WRITE,
+									   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (xdp->umem == MAP_FAILED) {
+		xdp->umem = NULL;
+		goto err_close;
+	}
+
+	memset(&mr, 0, sizeof(struct xdp_umem_reg));
+	mr.addr = (unsigned long) xdp->umem;
+	mr.len = xdp->umem_len;
+	mr.chunk_size = GOOSE_XDP_FRAME_SIZE;
+	mr.headroom = 0;
+	if ((setsockopt(fd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr)) != 0) ||
+		(setsockopt(fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(int)) != 0) ||
+		(setsockopt(fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof(int)) != 0) ||
+		(setsockopt(fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(int)) != 0) ||
+		(setsockopt(fd, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(int)) != 0) ||
+		(getsockopt(fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &len) != 0))
+		goto err_close;
+
+	if ((nl_if_xdp_ring(fd, &xdp->rx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) != 0) ||
+		(nl_if_xdp_ring(fd, &xdp->tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) != 0) ||
+		(nl_if_xdp_ring(fd, &xdp->fill, &off.fr, sizeof(unsigned long long),
+						XDP_UMEM_PGOFF_FILL_RING) != 0) ||
+		(nl_if_xdp_ring(fd, &xdp->comp, &off.cr, sizeof(unsigned long long),
+						XDP_UMEM_PGOFF_COMPLETION_RING) != 0))
+		goto err_close;
+
+	fill = (unsigned long long *) xdp->fill.desc;
+	for (i = 0; i < GOOSE_XDP_FRAMES / 2; i++) {
+		fill[i] = (unsigned long long) i * GOOSE_XDP_FRAME_SIZE;
+		xdp->tx_free[i] = (unsigned long long) (GOOSE_XDP_FRAMES / 2 + i) * GOOSE_XDP_FRAME_SIZE;
+	}
+	xdp->tx_free_num = GOOSE_XDP_FRAMES / 2;
+	xdp->fill.cached = GOOSE_XDP_FRAMES / 2;
+	__atomic_store_n(xdp->fill.producer, xdp->fill.cached, __ATOMIC_RELEASE);
+
+	/* The program, its maps, and the socket in them */
+	xdp->xsk_map_fd = nl_if_bpf_map(BPF_MAP_TYPE_XSKMAP, GOOSE_XDP_MAX_QUEUES);
+	xdp->appid_map_fd = nl_if_bpf_map(BPF_MAP_TYPE_ARRAY, GOOSE_XDP_APPID_ALL + 1);
+	if ((xdp->xsk_map_fd < 0) || (xdp->appid_map_fd < 0) ||
+		(nl_if_bpf_set(xdp->appid_map_fd, GOOSE_XDP_APPID_ALL, 1) != 0) ||
+		(nl_if_xdp_load(xdp) != 0) || (nl_if_xdp_attach(xdp, mode) != 0))
+		goto err_close;
+
+	/* Zero-copy if the driver has it, else copy mode */
+	memset(&addr, 0, sizeof(struct sockaddr_xdp));
+	addr.sxdp_family = AF_XDP;
+	addr.sxdp_ifindex = xdp->ifindex;
+	addr.sxdp_queue_id = queue;
+	addr.sxdp_flags = XDP_USE_NEED_WAKEUP;
+	if ((bind(fd, (struct sockaddr *) &addr, sizeof(struct sockaddr_xdp)) != 0) ||
+		(nl_if_bpf_set(xdp->xsk_map_fd, queue, fd) != 0))
+		goto err_close;
+
+	/* Busy polling, where the kernel has it */
+	opt = 1;
+	setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &opt, sizeof(int));
+	opt = GOOSE_XDP_BUSY_POLL;
+	setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &opt, sizeof(int));
+	opt = GOOSE_XDP_RX_BATCH;
+	setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &opt, sizeof(int));
+
+	nl_if->sock_fd = fd;
+	nl_if->xdp = xdp;
+
+	sem_init(&nl_if->access_in,  0, 1);
+	sem_init(&nl_if->access_out, 0, 1);
+	return 0;
+
+err_close:
+	opt = errno;
+	close(fd);
+	nl_if_xdp_free(xdp);
+	errno = opt;
+	return -1;
+}
+
+#else
+
+int nl_if_init_xdp(struct nl_interface *nl_if, const char *dev_name,
+				   unsigned int queue, int mode)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif
+
+/* "<device>[:<queue>[:skb|drv]]" of NL_IF_BACKEND_ENV */
+static int nl_if_init_xdp_env(struct nl_interface *nl_if, const char *spec)
+{
+	char dev_name[IFNAMSIZE], mode[4] = "";
+	unsigned int queue = 0;
+
+	memset(dev_name, 0, IFNAMSIZE);
+	if (sscanf(spec, "%15[^:]:%u:%3s", dev_name, &queue, mode) < 1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return nl_if_init_xdp(nl_if, dev_name, queue,
+						  (strcmp(mode, "skb") == 0) ? GOOSE_XDP_MODE_SKB :
+						  (strcmp(mode, "drv") == 0) ? GOOSE_XDP_MODE_DRV :
+						  GOOSE_XDP_MODE_AUTO);
+}
+
+/* io_uring receiving backend
+ * A multishot recv stays in flight on the socket of nl_if and
+ * fills buffers of a ring provided to the kernel, so frames are
+ * received without a system call per message. Needs Linux 6.0,
+ * goose_uring_open(...) fails with ENOSYS otherwise.
+ */
+#if defined(IORING_RECV_MULTISHOT)
+
+#define GOOSE_URING_ENTRIES      8
+#define GOOSE_URING_BGID         0x6005     /* buffer group */
+
+static inline int goose_uring_enter(struct goose_uring *ur, unsigned int submit,
+									unsigned int wait)
+{
+	return syscall(__NR_io_uring_enter, ur->ring_fd, submit, wait,
+				   wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+/* Hand buffer bid back to the kernel, published by goose_uring_flush(...) */
+static inline void goose_uring_recycle(struct goose_uring *ur, unsigned short bid)
+{
+	struct io_uring_buf *buf = &ur->br->bufs[ur->br_tail & (GOOSE_URING_BUFS - 1)];
+
+	buf->addr = (unsigned long) (ur->bufs + bid * ur->buf_len);
+	buf->len = ur->buf_len;
+	buf->bid = bid;
+	ur->br_tail++;
+}
+
+static inline void goose_uring_flush(struct goose_uring *ur)
+{
+	__atomic_store_n(&ur->br->tail, ur->br_tail, __ATOMIC_RELEASE);
+}
+
+/* (Re)arm the multishot recv, it stops e.g. when buffers run out */
+static int goose_uring_arm(struct goose_uring *ur)
+{
+	unsigned int tail = *ur->sq_tail;
+	unsigned int idx = tail & *ur->sq_mask;
+	struct io_uring_sqe *sqe = &ur->sqes[idx];
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = ur->sock_fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = GOOSE_URING_BGID;
+	ur->sq_array[idx] = idx;
+	__atomic_store_n(ur->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	if (goose_uring_enter(ur, 1, 0) < 0)
+		return -1;
+	ur->armed = 1;
+	return 0;
+}
+
+/* io_uring backend constructor
+ * Frames of nl_if must then be received by goose_uring_dispatch(...)
+ * only, in one thread.
+ */
+int goose_uring_open(struct goose_uring *ur, struct nl_interface *nl_if)
+{
+	struct io_uring_params p;
+	struct io_uring_buf_reg reg;
+	unsigned int i;
+
+	/* Frames of the other backends are in their rings */
+	if (nl_if->ops->backend != NL_IF_BACKEND_NETLINK) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	memset(ur, 0, sizeof(struct goose_uring));
+	memset(&p, 0, sizeof(struct io_uring_params));
+
+	ur->sock_fd = nl_if->sock_fd;
+	ur->buf_len = nl_if->in_buf_len;
+	ur->ring_fd = syscall(__NR_io_uring_setup, GOOSE_URING_ENTRIES, &p);
+	if (ur->ring_fd < 0)
+		return -1;
+
+	ur->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ur->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ur->cq_len > ur->sq_len)
+			ur->sq_len = ur->cq_len;
+		ur->cq_len = 0;
+	}
+	ur->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	ur->sq_ptr = mmap(NULL, ur->sq_len, PROT_READ | PROT_WRITE,
+					  MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_SQ_RING);
+	if (ur->sq_ptr == MAP_FAILED)
+		goto err_close;
+	ur->cq_ptr = ur->sq_ptr;
+	if (ur->cq_len != 0) {
+		ur->cq_ptr = mmap(NULL, ur->cq_len, PROT_READ | PROT_WRITE,
+						  MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_CQ_RING);
+		if (ur->cq_ptr == MAP_FAILED)
+			goto err_sq;
+	}
+	ur->sqes = (struct io_uring_sqe *) mmap(NULL, ur->sqes_len, PROT_READ | PROT_WRITE,
+											MAP_SHARED | MAP_POPULATE, ur->ring_fd,
+											IORING_OFF_SQES);
+	if (ur->sqes == MAP_FAILED)
+		goto err_cq;
+
+	ur->sq_tail = (unsigned int *) ((char *) ur->sq_ptr + p.sq_off.tail);
+	ur->sq_mask = (unsigned int *) ((char *) ur->sq_ptr + p.sq_off.ring_mask);
+	ur->sq_array = (unsigned int *) ((char *) ur->sq_ptr + p.sq_off.array);
+	ur->cq_head = (unsigned int *) ((char *) ur->cq_ptr + p.cq_off.head);
+	ur->cq_tail = (unsigned int *) ((char *) ur->cq_ptr + p.cq_off.tail);
+	ur->cq_mask = (unsigned int *) ((char *) ur->cq_ptr + p.cq_off.ring_mask);
+	ur->cqes = (struct io_uring_cqe *) ((char *) ur->cq_ptr + p.cq_off.cqes);
+
+	/* Provided buffers, the ring must be page aligned */
+	ur->br = (struct io_uring_buf_ring *) mmap(NULL, GOOSE_URING_BUFS *
+											   sizeof(struct io_uring_buf),
+											   PROT_READ | PROT_WRITE,
+											   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ur->br == MAP_FAILED)
+		goto err_sqes;
+	ur->bufs = (unsigned char *) malloc(GOOSE_URING_BUFS * ur->buf_len);
+	if (ur->bufs == NULL)
+		goto err_br;
+
+	memset(&reg, 0, sizeof(struct io_uring_buf_reg));
+	reg.ring_addr = (unsigned long) ur->br;
+	reg.ring_entries = GOOSE_URING_BUFS;
+	reg.bgid = GOOSE_URING_BGID;
+	if (syscall(__NR_io_uring_register, ur->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+		goto err_bufs;
+
+	for (i = 0; i < GOOSE_URING_BUFS; i++)
+		goose_uring_recycle(ur, i);
+	goose_uring_flush(ur);
+
+	if (goose_uring_arm(ur) == 0)
+		return 0;
+
+err_bufs:
+	free(ur->bufs);
+err_br:
+	munmap(ur->br, GOOSE_URING_BUFS * sizeof(struct io_uring_buf));
+err_sqes:
+	munmap(ur->sqes, ur->sqes_len);
+err_cq:
+	if (ur->cq_len != 0)
+		munmap(ur->cq_ptr, ur->cq_len);
+err_sq:
+	munmap(ur->sq_ptr, ur->sq_len);
+err_close:
+	close(ur->ring_fd);
+	return -1;
+}
+
+/* io_uring backend destructor
+ * Closing the ring cancels the pending recv.
+ */
+int goose_uring_close(struct goose_uring *ur)
+{
+	close(ur->ring_fd);
+	free(ur->bufs);
+	munmap(ur->br, GOOSE_URING_BUFS * sizeof(struct io_uring_buf));
+	munmap(ur->sqes, ur->sqes_len);
+	if (ur->cq_len != 0)
+		munmap(ur->cq_ptr, ur->cq_len);
+	munmap(ur->sq_ptr, ur->sq_len);
+	return 0;
+}
+
+/* Call cb for every frame of the completed receives. If wait is
+ * set and nothing is completed, wait for one receive. The ring fd
+ * (goose_uring_fd(...)) is readable when receives are completed,
+ * it may be added to an epoll set instead of waiting.
+ *
+ * Return value is the number of frames handled, or -1.
+ */
+int goose_uring_dispatch(struct goose_uring *ur, goose_frame_cb cb, void *arg, int wait)
+{
+	struct goose_frame frame;
+	struct io_uring_cqe *cqe;
+	struct nlmsghdr *nlh;
+	struct nl_if_rec rec;
+	unsigned long long tstamp;
+	unsigned int head, tail, bid;
+	int len, num = 0;
+
+	head = *ur->cq_head;
+	tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+	if ((head == tail) && wait) {
+		if ((goose_uring_enter(ur, 0, 1) < 0) && (errno != EINTR))
+			return -1;
+		tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+	}
+
+	tstamp = nl_if_now();
+	for (; head != tail; head++) {
+		cqe = &ur->cqes[head & *ur->cq_mask];
+
+		if (cqe->flags & IORING_CQE_F_BUFFER) {
+			bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+			nlh = (struct nlmsghdr *) (ur->bufs + bid * ur->buf_len);
+			len = cqe->res;
+			for (; (len > 0) && NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+				if ((nlh->nlmsg_type != NL_MSG_DATA_RECV) ||
+					(nlh->nlmsg_len < NLMSG_LENGTH(sizeof(struct nl_rx_tstamp) +
+												   GOOSE_RECORD_HDRLEN)))
+					continue;
+				nl_if_nlh_rec(nlh, &rec);
+				if (nl_if_parse_record(&rec, tstamp, &frame) != 0)
+					continue;
+				cb(&frame, arg);
+				num++;
+			}
+			goose_uring_recycle(ur, bid);
+		}
+
+		if (!(cqe->flags & IORING_CQE_F_MORE))
+			ur->armed = 0;
+	}
+	__atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+	goose_uring_flush(ur);
+
+	if (!ur->armed && (goose_uring_arm(ur) != 0))
+		return -1;
+
+	return num;
+}
+
+#else
+
+int goose_uring_open(struct goose_uring *ur, struct nl_interface *nl_if)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int goose_uring_close(struct goose_uring *ur)
+{
+	return 0;
+}
+
+int goose_uring_dispatch(struct goose_uring *ur, goose_frame_cb cb, void *arg, int wait)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif
+
+int goose_uring_fd(struct goose_uring *ur)
+{
+	return ur->ring_fd;
+}
+
+static inline struct goose_tx_slot *goose_tx_ring_slot(struct goose_tx_ring *ring,
+													   unsigned int idx)
+{
+	return (struct goose_tx_slot *) (ring->slots +
+		(idx & (GOOSE_TX_RING_SLOTS - 1)) * GOOSE_RING_SLOT_SIZE);
+}
+
+/* TX ring constructor
+ * Open and map the TX ring of the kernel module.
+ */
+int goose_tx_ring_open(struct goose_tx_ring *ring)
+{
+	void *mem;
+
+	ring->fd = open("/dev/" GOOSE_TX_RING_DEV, O_RDWR);
+	if (ring->fd < 0)
+		return -1;
+
+	mem = mmap(NULL, GOOSE_TX_RING_SIZE, PROT_READ | PROT_WRITE,
+			   MAP_SHARED, ring->fd, 0);
+	if (mem == MAP_FAILED) {
+		close(ring->fd);
+		return -1;
+	}
+
+	ring->hdr = (struct goose_ring_hdr *) mem;
+	ring->slots = (unsigned char *) mem + GOOSE_RING_HDR_SIZE;
+	ring->prod = 0;
+	ring->done = 0;
+
+	return 0;
+}
+
+/* TX ring destructor
+ * It waits in the kernel until all frames are sent.
+ */
+int goose_tx_ring_close(struct goose_tx_ring *ring)
+{
+	munmap(ring->hdr, GOOSE_TX_RING_SIZE);
+	return close(ring->fd);
+}
+
+/* Put a frame in the next slot of the TX ring, no system call.
+ * The frame is sent at the next goose_tx_ring_kick(...).
+ * ifindex 0 means the default device of the module.
+ *
+ * Return value is 0, or -1 if the ring is full (call
+ * goose_tx_ring_complete(...)) or the frame is too large.
+ */
+int goose_tx_ring_put(struct goose_tx_ring *ring, int ifindex, unsigned char *daddr,
+					  struct goosehdr *goose_h, unsigned char *apdu,
+					  unsigned int apdu_len, unsigned short msg_type)
+{
+	struct goose_tx_slot *slot = goose_tx_ring_slot(ring, ring->prod);
+	unsigned char *data = (unsigned char *) (slot + 1);
+	unsigned int goose_h_len = sizeof(struct goosehdr);
+
+	if ((ring->prod - ring->done >= GOOSE_TX_RING_SLOTS) ||
+		(*(volatile unsigned int *) &slot->flags != GOOSE_TX_SLOT_AVAILABLE) ||
+		(apdu_len + goose_h_len > GOOSE_TX_SLOT_DATALEN))
+		return -1;
+
+	/* compute the goose pktlen in header*/
+	goose_h->len = htons(apdu_len + goose_h_len);
+
+	slot->ifindex = ifindex;
+	slot->len = apdu_len + goose_h_len;
+	slot->msg_type = msg_type;
+	if (daddr != NULL)
+		memcpy(slot->daddr, daddr, 6);
+
+	memcpy(data, goose_h, goose_h_len);
+	memcpy(data + goose_h_len, apdu, apdu_len);
+
+	/* The slot must be written before it is requested */
+	__sync_synchronize();
+	*(volatile unsigned int *) &slot->flags = GOOSE_TX_SLOT_REQUEST;
+
+	ring->prod++;
+	return 0;
+}
+
+/* Doorbell: ask the kernel to transmit all requested slots.
+ * Return value is the number of slots taken by the kernel, or -1.
+ */
+int goose_tx_ring_kick(struct goose_tx_ring *ring)
+{
+	return ioctl(ring->fd, GOOSE_IOC_TX_KICK);
+}
+
+/* Collect completed slots in order, no system call.
+ * If status is not NULL, it receives the result of each
+ * completed frame (0 or a negative errno).
+ *
+ * Return value is the number of completed slots, at most max.
+ */
+int goose_tx_ring_complete(struct goose_tx_ring *ring, int *status, unsigned int max)
+{
+	struct goose_tx_slot *slot;
+	unsigned int num = 0;
+
+	while ((num < max) && (ring->done != ring->prod)) {
+		slot = goose_tx_ring_slot(ring, ring->done);
+		if (*(volatile unsigned int *) &slot->flags != GOOSE_TX_SLOT_AVAILABLE)
+			break;
+
+		/* Read the status only after flags */
+		__sync_synchronize();
+		if (status != NULL)
+			status[num] = slot->status;
+
+		ring->done++;
+		num++;
+	}
+
+	return num;
+}
+
+/* RX ring constructor
+ * Open and map the RX ring of the kernel module. From now on,
+ * received frames go to the ring instead of netlink.
+ */
+int goose_rx_ring_open(struct goose_rx_ring *ring)
+{
+	void *mem;
+
+	ring->fd = open("/dev/" GOOSE_RX_RING_DEV, O_RDWR);
+	if (ring->fd < 0)
+		return -1;
+
+	mem = mmap(NULL, GOOSE_RX_RING_SIZE, PROT_READ | PROT_WRITE,
+			   MAP_SHARED, ring->fd, 0);
+	if (mem == MAP_FAILED) {
+		close(ring->fd);
+		return -1;
+	}
+
+	ring->hdr = (struct goose_ring_hdr *) mem;
+	ring->slots = (unsigned char *) mem + GOOSE_RING_HDR_SIZE;
+	ring->cons = ring->hdr->cons;
+
+	return 0;
+}
+
+/* RX ring destructor */
+int goose_rx_ring_close(struct goose_rx_ring *ring)
+{
+	munmap(ring->hdr, GOOSE_RX_RING_SIZE);
+	return close(ring->fd);
+}
+
+/* Get the next frame from the RX ring, without copying
+ * and without system call. The frame is valid until
+ * goose_rx_ring_release(...).
+ *
+ * Return value is 1 if a frame is got, 0 if the ring is empty.
+ */
+int goose_rx_ring_next(struct goose_rx_ring *ring, struct goose_frame *frame)
+{
+	struct goose_ring_slot *slot;
+
+	while (ring->cons != *(volatile unsigned int *) &ring->hdr->prod) {
+		/* Read the slot only after prod */
+		__sync_synchronize();
+
+		slot = (struct goose_ring_slot *) (ring->slots +
+			(ring->cons & (GOOSE_RX_RING_SLOTS - 1)) * GOOSE_RING_SLOT_SIZE);
+
+		if ((slot->len <= GOOSE_RING_SLOT_SIZE - sizeof(struct goose_ring_slot)) &&
+			(nl_if_parse_frame((unsigned char *) (slot + 1), slot->len, frame) == 0)) {
+			frame->tstamp.rx = slot->tstamp.rx;
+			frame->tstamp.queued = slot->tstamp.queued;
+			frame->tstamp.dequeued = nl_if_now();
+			frame->vlan = slot->tstamp.vlan;
+			return 1;
+		}
+
+		/* Broken slot, skip it */
+		goose_rx_ring_release(ring);
+	}
+
+	return 0;
+}
+
+/* Give the slot of the last frame back to the kernel */
+void goose_rx_ring_release(struct goose_rx_ring *ring)
+{
+	/* Finish reading the slot before handing it back */
+	__sync_synchronize();
+
+	ring->cons++;
+	*(volatile unsigned int *) &ring->hdr->cons = ring->cons;
+}
+
+/* Wait until the RX ring is not empty.
+ * The timeout is in ms, -1 for infinite.
+ *
+ * Return value is 1 if the ring is not empty, 0 on timeout, -1 on error.
+ */
+int goose_rx_ring_wait(struct goose_rx_ring *ring, int timeout)
+{
+	struct pollfd pfd = {
+		.fd = ring->fd,
+		.events = POLLIN
+	};
+
+	if (ring->cons != *(volatile unsigned int *) &ring->hdr->prod)
+		return 1;
+
+	return poll(&pfd, 1, timeout);
+}
+
+/* The API for GOOSE transmission
+ * An assembler to combine interface header, goose header,
+ * and apdu datam, then call send_raw(...).
+ * The funcation also computes the length of the goose packet,
+ * and writes it to goose header.
+ */
+int send_goose_data(struct nl_interface *nl_if, struct nl_data_header *nl_data_h,
+					struct goosehdr *goose_h, unsigned char *apdu,
+					unsigned int apdu_len, unsigned short msg_type)
+{
+	unsigned int goose_h_len = sizeof(struct goosehdr);
+	struct iovec parts[3] = {
+		{ .iov_base = nl_data_h, .iov_len = sizeof(struct nl_data_header) },
+		{ .iov_base = goose_h,   .iov_len = goose_h_len },
+		{ .iov_base = apdu,      .iov_len = apdu_len }
+	};
+
+	/* compute the goose pktlen in header*/
+	goose_h->len = htons(apdu_len + goose_h_len);
+	
+	return nl_if->ops->send_parts(nl_if, msg_type, parts, 3);
+}
+
+/* Collect the report of a batch sent on ctx.
+ * The kernel replies with one message holding a nlmsgerr per
+ * record sent with NLM_F_ACK, and a nl_tx_tstamp per record sent
+ * with NL_MSG_DATA_TSTAMP. Their nlmsg_seq is the index of the record.
+ * A nlmsgerr of nlmsg_seq NL_BATCH_SEQ_ALL means that no record of
+ * the batch was sent.
+ *
+ * Return value is 0, or -1 with errno set (ETIMEDOUT without a
+ * report within NL_BATCH_REPORT_TIMEOUT).
+ */
+static int recv_batch_report(struct nl_tx_ctx *ctx, struct goose_batch_rec *recs,
+							 int *status, unsigned int num)
+{
+	struct nlmsghdr *nlh = (struct nlmsghdr *) ctx->iov.iov_base;
+	struct pollfd pfd = {
+		.fd = ctx->fd,
+		.events = POLLIN
+	};
+	struct nlmsgerr *err;
+	struct nl_tx_tstamp *ts;
+	int len;
+
+	len = poll(&pfd, 1, NL_BATCH_REPORT_TIMEOUT);
+	if (len <= 0) {
+		if (len == 0) {
+			ctx->stale = 1;
+			errno = ETIMEDOUT;
+		}
+		return -1;
+	}
+
+	ctx->iov.iov_len = NL_MAX_BATCH_LEN;
+	len = recvmsg(ctx->fd, &ctx->msg, MSG_DONTWAIT);
+	if (len < 0)
+		return len;
+
+	for (; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+		if ((nlh->nlmsg_type == NLMSG_ERROR) && (nlh->nlmsg_seq == NL_BATCH_SEQ_ALL)) {
+			errno = -((struct nlmsgerr *) NLMSG_DATA(nlh))->error;
+			return -1;
+		}
+
+		if (nlh->nlmsg_seq >= num)
+			continue;
+
+		if ((nlh->nlmsg_type == NLMSG_ERROR) && (status != NULL)) {
+			err = (struct nlmsgerr *) NLMSG_DATA(nlh);
+			status[nlh->nlmsg_seq] = err->error;
+		} else if (nlh->nlmsg_type == NL_MSG_TX_TSTAMP) {
+			ts = (struct nl_tx_tstamp *) NLMSG_DATA(nlh);
+			recs[nlh->nlmsg_seq].tx_tstamp = ts->tstamp;
+		}
+	}
+
+	return 0;
+}
+
+/* The API for batched GOOSE transmission
+ * Pack many frames into one netlink message, so that they
+ * are transmitted by one system call:
+ * -----------------------------------------------------------
+ * | nlmsghdr | nl_data_header | goosehdr | apdu | nlmsghdr ...
+ * -----------------------------------------------------------
+ * If the batch does not fit in NL_MAX_BATCH_LEN, it is split.
+ * If status is not NULL, status[i] receives the result of recs[i]
+ * (0 or a negative errno) from the kernel. Records whose msg_type
+ * has NL_MSG_DATA_TSTAMP get the time they were handed to the
+ * device in tx_tstamp.
+ *
+ * Return value is the number of records sent, or -1 if none is.
+ * When a part of a split batch fails, the records before it are
+ * sent and counted.
+ */
+int send_goose_batch(struct nl_interface *nl_if, struct goose_batch_rec *recs,
+					 unsigned int num, int *status)
+{
+	return nl_if->ops->send_batch(nl_if, recs, num, status);
+}
+
+static int nl_if_nl_send_batch(struct nl_interface *nl_if, struct goose_batch_rec *recs,
+							   unsigned int num, int *status)
+{
+	int ret;
+
+	sem_wait(&nl_if->access_out);
+	ret = send_goose_batch_ctx(&nl_if->tx, recs, num, status);
+	sem_post(&nl_if->access_out);
+
+	return ret;
+}
+
+static const struct nl_if_ops nl_if_netlink_ops = {
+	.backend     = NL_IF_BACKEND_NETLINK,
+	.send_parts  = nl_if_send_parts,
+	.send_batch  = nl_if_nl_send_batch,
+	.next_record = nl_if_next_record,
+	.close       = nl_if_nl_close
+};
+
+/* Same as send_goose_batch(...) on a send context of the calling
+ * thread, without any lock.
+ */
+int send_goose_batch_ctx(struct nl_tx_ctx *ctx, struct goose_batch_rec *recs,
+						 unsigned int num, int *status)
+{
+	unsigned char *buf = (unsigned char *) ctx->iov.iov_base;
+	unsigned int nl_data_h_len = sizeof(struct nl_data_header);
+	unsigned int goose_h_len = sizeof(struct goosehdr);
+	unsigned int i, first = 0, off = 0, rec_len;
+	struct nlmsghdr *nlh;
+	int ret = 0, report = 0;
+
+	for (i = 0; i <= num; i++) {
+		rec_len = (i < num) ?
+			NLMSG_SPACE(nl_data_h_len + goose_h_len + recs[i].apdu_len) : 0;
+
+		/* Flush what we have if the record does not fit, or at the end */
+		if ((i == num) || ((off + rec_len > NL_MAX_BATCH_LEN) && (off != 0))) {
+			if (off == 0)
+				break;
+
+			/* A late report must not pass for the one of this part */
+			if (ctx->stale && ((status != NULL) || report)) {
+				while (recv(ctx->fd, NULL, 0, MSG_DONTWAIT | MSG_TRUNC) >= 0)
+					;
+				ctx->stale = 0;
+			}
+
+			ctx->iov.iov_len = off;
+			ret = sendmsg(ctx->fd, &ctx->msg, 0);
+			if ((ret >= 0) && ((status != NULL) || report))
+				ret = recv_batch_report(ctx, recs, status, num);
+			if (ret < 0)
+				break;
+
+			first = i;
+			off = 0;
+			report = 0;
+		}
+
+		if (i == num)
+			break;
+
+		if (rec_len > NL_MAX_BATCH_LEN) {
+			ret = -1;
+			break;
+		}
+
+		/* compute the goose pktlen in header*/
+		recs[i].goose_h->len = htons(recs[i].apdu_len + goose_h_len);
+
+		nlh = (struct nlmsghdr *) (buf + off);
+		nlh->nlmsg_type = recs[i].msg_type;
+		nlh->nlmsg_len = NLMSG_LENGTH(nl_data_h_len + goose_h_len + recs[i].apdu_len);
+		nlh->nlmsg_pid = ctx->pid;
+		nlh->nlmsg_seq = i;
+		nlh->nlmsg_flags = NLM_F_MULTI | ((status != NULL) ? NLM_F_ACK : 0);
+
+		memcpy(NLMSG_DATA(nlh), recs[i].nl_data_h, nl_data_h_len);
+		memcpy(NLMSG_DATA(nlh) + nl_data_h_len, recs[i].goose_h, goose_h_len);
+		memcpy(NLMSG_DATA(nlh) + nl_data_h_len + goose_h_len,
+			   recs[i].apdu, recs[i].apdu_len);
+
+		if (recs[i].msg_type & NL_MSG_DATA_TSTAMP) {
+			recs[i].tx_tstamp = 0;
+			report = 1;
+		}
+
+		off += rec_len;
+	}
+
+	return ((ret < 0) && (first == 0)) ? -1 : (int) first;
+}
+
+/* The API for GOOSE transmission with a TX timestamp
+ * Same as send_goose_data(...), but the frame goes as a batch of
+ * one record, and the call waits for the kernel report. tx_tstamp
+ * receives the time in ns the frame was handed to the device.
+ *
+ * Return value is 0, or -1 if the frame is not sent.
+ */
+int send_goose_data_ts(struct nl_interface *nl_if, struct nl_data_header *nl_data_h,
+					   struct goosehdr *goose_h, unsigned char *apdu,
+					   unsigned int apdu_len, unsigned short msg_type,
+					   unsigned long long *tx_tstamp)
+{
+	struct goose_batch_rec rec = {
+		.nl_data_h = nl_data_h,
+		.goose_h   = goose_h,
+		.apdu      = apdu,
+		.apdu_len  = apdu_len,
+		.msg_type  = msg_type | NL_MSG_DATA_TSTAMP
+	};
+	int status = -1;
+
+	if ((send_goose_batch(nl_if, &rec, 1, &status) != 1) || (status != 0))
+		return -1;
+
+	*tx_tstamp = rec.tx_tstamp;
+	return 0;
+}
+
+/* Well, this is an old version with lower efficiency */
+int send_goose_data_old(struct nl_interface *nl_if, struct nl_data_header *nl_data_h,
+						struct goosehdr *goose_h, unsigned char *apdu,
+						unsigned int apdu_len, unsigned short msg_type)
+{
+	int ret;
+	unsigned int goose_len = apdu_len + sizeof(struct goosehdr);
+	unsigned int raw_data_len = goose_len + sizeof(struct nl_data_header);
+
+	/* raw_data includes all data needed to transmit to kernel,
+	 * including data interface header + goose hdr + apdu */
+	unsigned char *raw_data = malloc(raw_data_len);
+
+	/* compute the goose pktlen in header*/
+	goose_h->len = htons(goose_len);
+
+	memcpy(raw_data,
+		   nl_data_h, sizeof(struct nl_data_header));
+
+	memcpy(raw_data + sizeof(struct nl_data_header),
+		   goose_h, sizeof(struct goosehdr));
+
+	memcpy(raw_data + sizeof(struct nl_data_header) + sizeof (struct goosehdr),
+		   apdu, apdu_len);
+
+	ret = send_raw(nl_if, raw_data, raw_data_len, msg_type);
+	
+	free(raw_data);
+
+	return ret;
+}
+
+/* The API for sending GOOSE transmission control information
+ */
+
+inline int send_goose_ctrl(struct nl_interface *nl_if, struct nl_ctrl_header *ctrl_info)
+{
+	return send_raw(nl_if, (unsigned char*) ctrl_info,
+					sizeof(struct nl_ctrl_header), NL_MSG_CTRL);
+	
+}
+
+/* The API for changing receiving filters of the module
+ * See struct nl_filter_header, the filters are shown in
+ * /proc/goose/filter.
+ */
+
+inline int send_goose_filter(struct nl_interface *nl_if, struct nl_filter_header *filter)
+{
+	return send_raw(nl_if, (unsigned char*) filter,
+					sizeof(struct nl_filter_header), NL_MSG_FILTER);
+}
+
+/* The APIs for GOOSE subscription
+ * Frames of a subscribed APPID are delivered to all interfaces
+ * subscribing it, and not to the interface registered last.
+ * If daddr is not NULL, only frames sent to daddr match.
+ */
+
+int goose_subscribe(struct nl_interface *nl_if, unsigned short appid,
+					unsigned char *daddr)
+{
+	struct nl_sub_header nl_sub_h;
+
+	memset(&nl_sub_h, 0, sizeof(struct nl_sub_header));
+	nl_sub_h.appid = appid;
+	if (daddr != NULL)
+		memcpy(nl_sub_h.daddr, daddr, 6);
+
+	return send_raw(nl_if, (unsigned char*) &nl_sub_h,
+					sizeof(struct nl_sub_header), NL_MSG_SUBSCRIBE);
+}
+
+int goose_unsubscribe(struct nl_interface *nl_if, unsigned short appid,
+					  unsigned char *daddr)
+{
+	struct nl_sub_header nl_sub_h;
+
+	memset(&nl_sub_h, 0, sizeof(struct nl_sub_header));
+	nl_sub_h.appid = appid;
+	if (daddr != NULL)
+		memcpy(nl_sub_h.daddr, daddr, 6);
+
+	return send_raw(nl_if, (unsigned char*) &nl_sub_h,
+					sizeof(struct nl_sub_header), NL_MSG_UNSUBSCRIBE);
+}
+
+/* The APIs for 802.1Q tagging
+ * goose_set_vlan(...) sends the frames of appid with a tag of vid
+ * (0 for priority tagged frames) and pcp, which also selects their
+ * priority on the host. goose_clear_vlan(...) gives them back the
+ * module's default, /proc/goose/vlan_{tag,id,pcp}.
+ */
+
+int goose_set_vlan(struct nl_interface *nl_if, unsigned short appid,
+				   unsigned short vid, unsigned char pcp)
+{
+	struct nl_vlan_header nl_vlan_h;
+
+	memset(&nl_vlan_h, 0, sizeof(struct nl_vlan_header));
+	nl_vlan_h.op = GOOSE_VLAN_SET;
+	nl_vlan_h.appid = appid;
+	nl_vlan_h.vid = vid;
+	nl_vlan_h.pcp = pcp;
+
+	return send_raw(nl_if, (unsigned char*) &nl_vlan_h,
+					sizeof(struct nl_vlan_header), NL_MSG_VLAN);
+}
+
+int goose_clear_vlan(struct nl_interface *nl_if, unsigned short appid)
+{
+	struct nl_vlan_header nl_vlan_h;
+
+	memset(&nl_vlan_h, 0, sizeof(struct nl_vlan_header));
+	nl_vlan_h.op = GOOSE_VLAN_DEL;
+	nl_vlan_h.appid = appid;
+
+	return send_raw(nl_if, (unsigned char*) &nl_vlan_h,
+					sizeof(struct nl_vlan_header), NL_MSG_VLAN);
+}
+
+/* The APIs for retransmission profiles
+ * goose_set_profile(...) gives profile id (1 - GOOSE_PROFILES - 1,
+ * 0 is the default one) a retransmission schedule, which multicast
+ * frames stop after the ACKs of acks receivers (0 for never), then
+ * goose_map_profile(...) makes reliable frames of appid follow it;
+ * mapping to profile 0 gives the APPID the default schedule back.
+ */
+
+int goose_set_profile(struct nl_interface *nl_if, unsigned int id,
+					  const struct goose_param_t *param, unsigned int acks)
+{
+	struct nl_profile_header nl_profile_h;
+
+	memset(&nl_profile_h, 0, sizeof(struct nl_profile_header));
+	nl_profile_h.op = GOOSE_PROFILE_SET;
+	nl_profile_h.id = id;
+	nl_profile_h.goose_param = *param;
+	nl_profile_h.acks = acks;
+
+	return send_raw(nl_if, (unsigned char*) &nl_profile_h,
+					sizeof(struct nl_profile_header), NL_MSG_PROFILE);
+}
+
+int goose_map_profile(struct nl_interface *nl_if, unsigned short appid,
+					  unsigned int id)
+{
+	struct nl_profile_header nl_profile_h;
+
+	memset(&nl_profile_h, 0, sizeof(struct nl_profile_header));
+	nl_profile_h.op = GOOSE_PROFILE_MAP;
+	nl_profile_h.appid = appid;
+	nl_profile_h.id = id;
+
+	return send_raw(nl_if, (unsigned char*) &nl_profile_h,
+					sizeof(struct nl_profile_header), NL_MSG_PROFILE);
+}
+
+/* The APIs for publications repeated by the kernel module
+ * goose_publish(...) hands a new state of the dataset to the module,
+ * which sends it at once and repeats it (t1, 2 * t1, ... up to
+ * tran_intvl) increasing sqNum, with no further call. The APDU should
+ * have sqNum; its stNum is not changed by the module.
+ * goose_unpublish(...) stops the publication of appid on the device
+ * of nl_data_h. Publications also stop when nl_if is closed.
+ */
+
+int goose_publish(struct nl_interface *nl_if, struct nl_data_header *nl_data_h,
+				  struct goosehdr *goose_h, unsigned char *apdu,
+				  unsigned int apdu_len, unsigned short t1)
+{
+	struct nl_pub_header nl_pub_h = {
+		.op = GOOSE_PUB_SET,
+		.t1 = t1
+	};
+	unsigned int goose_h_len = sizeof(struct goosehdr);
+	struct iovec parts[4] = {
+		{ .iov_base = &nl_pub_h, .iov_len = sizeof(struct nl_pub_header) },
+		{ .iov_base = nl_data_h, .iov_len = sizeof(struct nl_data_header) },
+		{ .iov_base = goose_h,   .iov_len = goose_h_len },
+		{ .iov_base = apdu,      .iov_len = apdu_len }
+	};
+
+	if (sizeof(struct nl_pub_header) + sizeof(struct nl_data_header) +
+		goose_h_len + apdu_len > NL_MAX_DATALEN_ACCEPTED)
+		return -1;
+
+	/* compute the goose pktlen in header*/
+	goose_h->len = htons(apdu_len + goose_h_len);
+
+	return nl_if->ops->send_parts(nl_if, NL_MSG_PUBLISH, parts, 4);
+}
+
+int goose_unpublish(struct nl_interface *nl_if, struct nl_data_header *nl_data_h,
+					unsigned short appid)
+{
+	unsigned char data[sizeof(struct nl_pub_header) + sizeof(struct nl_data_header) +
+					   sizeof(struct goosehdr)];
+	struct nl_pub_header nl_pub_h = {
+		.op = GOOSE_PUB_STOP
+	};
+	struct goosehdr goose_h;
+
+	memset(&goose_h, 0, sizeof(struct goosehdr));
+	goose_h.appid = htons(appid);
+
+	memcpy(data, &nl_pub_h, sizeof(struct nl_pub_header));
+	memcpy(data + sizeof(struct nl_pub_header), nl_data_h, sizeof(struct nl_data_header));
+	memcpy(data + sizeof(struct nl_pub_header) + sizeof(struct nl_data_header),
+		   &goose_h, sizeof(struct goosehdr));
+
+	return send_raw(nl_if, data, sizeof(data), NL_MSG_PUBLISH);
+}
+
+/* GOOSE APDU encoder
+ * Tags of the IECGoosePdu ([APPLICATION 1] IMPLICIT SEQUENCE)
+ */
+#define GOOSE_PDU_TAG            0x61
+#define GOOSE_PDU_GOCBREF        0x80
+#define GOOSE_PDU_TAL            0x81
+#define GOOSE_PDU_DATSET         0x82
+#define GOOSE_PDU_GOID           0x83
+#define GOOSE_PDU_T              0x84
+#define GOOSE_PDU_STNUM          0x85
+#define GOOSE_PDU_SQNUM          0x86
+#define GOOSE_PDU_TEST           0x87
+#define GOOSE_PDU_CONFREV        0x88
+#define GOOSE_PDU_NDSCOM         0x89
+#define GOOSE_PDU_NUMENTRIES     0x8a
+#define GOOSE_PDU_ALLDATA        0xab
+
+/* Minimal two's complement encoding of an INTEGER, return its size */
+static unsigned int goose_ber_int(unsigned char *out, long long val)
+{
+	unsigned char buf[9];
+	unsigned int i, n = 0;
+
+	buf[0] = (val < 0) ? 0xff : 0;
+	for (i = 0; i < 8; i++)
+		buf[8 - i] = (unsigned char) (val >> (8 * i));
+
+	/* Drop leading bytes which only repeat the sign */
+	while ((n < 8) && (((buf[n] == 0x00) && !(buf[n + 1] & 0x80)) ||
+					   ((buf[n] == 0xff) && (buf[n + 1] & 0x80))))
+		n++;
+
+	memcpy(out, buf + n, 9 - n);
+	return 9 - n;
+}
+
+/* UtcTime: seconds (4), fraction of second (3), quality (1) */
+static void goose_ber_utctime(unsigned char *out, unsigned long long ns, unsigned char quality)
+{
+	unsigned int sec = ns / 1000000000ULL;
+	unsigned int frac = ((ns % 1000000000ULL) << 24) / 1000000000ULL;
+
+	out[0] = sec >> 24;
+	out[1] = sec >> 16;
+	out[2] = sec >> 8;
+	out[3] = sec;
+	out[4] = frac >> 16;
+	out[5] = frac >> 8;
+	out[6] = frac;
+	out[7] = quality;
+}
+
+/* Append a TLV to the APDU, the value length is below 256.
+ * Return the offset of the tag, or -1 if the APDU is full.
+ */
+static int goose_enc_put(struct goose_encoder *enc, unsigned char tag,
+						 const void *val, unsigned int len)
+{
+	unsigned int pos = enc->len, hdr = (len < 0x80) ? 2 : 3;
+
+	if ((len > 0xff) || (pos + hdr + len > GOOSE_ENC_APDU_LEN))
+		return -1;
+
+	enc->apdu[pos] = tag;
+	if (hdr == 3) {
+		enc->apdu[pos + 1] = 0x81;
+		enc->apdu[pos + 2] = len;
+	} else {
+		enc->apdu[pos + 1] = len;
+	}
+	if (len != 0)
+		memcpy(enc->apdu + pos + hdr, val, len);
+
+	enc->len += hdr + len;
+	return pos;
+}
+
+static int goose_enc_put_int(struct goose_encoder *enc, unsigned char tag, long long val)
+{
+	unsigned char buf[9];
+
+	return goose_enc_put(enc, tag, buf, goose_ber_int(buf, val));
+}
+
+static int goose_enc_put_str(struct goose_encoder *enc, unsigned char tag, const char *str)
+{
+	return goose_enc_put(enc, tag, str, strlen(str));
+}
+
+/* 2-byte long form length, at the length field of the tag at off */
+static inline void goose_enc_put_len2(struct goose_encoder *enc, unsigned int off)
+{
+	unsigned int len = enc->len - (off + 4);
+
+	enc->apdu[off + 1] = 0x82;
+	enc->apdu[off + 2] = len >> 8;
+	enc->apdu[off + 3] = len & 0xff;
+}
+
+/* Change the value size of the short-form TLV at off to len,
+ * moving the fields behind it. Slow path only.
+ */
+static int goose_enc_resize(struct goose_encoder *enc, unsigned int off, unsigned int len)
+{
+	unsigned int old_len = enc->apdu[off + 1], tail = off + 2 + old_len, i;
+	int delta = (int) len - (int) old_len;
+
+	if ((len >= 0x80) || (enc->len + delta > GOOSE_ENC_APDU_LEN))
+		return -1;
+
+	memmove(enc->apdu + tail + delta, enc->apdu + tail, enc->len - tail);
+	enc->apdu[off + 1] = len;
+	enc->len += delta;
+
+	if (enc->off_t > off)
+		enc->off_t += delta;
+	if (enc->off_stnum > off)
+		enc->off_stnum += delta;
+	if (enc->off_sqnum > off)
+		enc->off_sqnum += delta;
+	if (enc->off_all_data > off)
+		enc->off_all_data += delta;
+	for (i = 0; i < enc->num; i++)
+		if (enc->off[i] > off)
+			enc->off[i] += delta;
+
+	/* allData is the last field of the goosePdu */
+	goose_enc_put_len2(enc, 0);
+	goose_enc_put_len2(enc, enc->off_all_data);
+	return 0;
+}
+
+/* Write a value at the TLV at off, in place if its size is the same */
+static int goose_enc_patch(struct goose_encoder *enc, unsigned int off,
+						   const void *val, unsigned int len)
+{
+	if ((enc->apdu[off + 1] != len) && (goose_enc_resize(enc, off, len) != 0))
+		return -1;
+
+	memcpy(enc->apdu + off + 2, val, len);
+	return 0;
+}
+
+static int goose_enc_patch_int(struct goose_encoder *enc, unsigned int off, long long val)
+{
+	unsigned char buf[9];
+	unsigned int len = goose_ber_int(buf, val);
+
+	/* Fast path: same size */
+	if (enc->apdu[off + 1] == len) {
+		memcpy(enc->apdu + off + 2, buf, len);
+		return 0;
+	}
+	return goose_enc_patch(enc, off, buf, len);
+}
+
+/* Offset of member idx if it has the type, or 0 */
+static inline unsigned int goose_enc_member(struct goose_encoder *enc, unsigned int idx,
+											unsigned char type)
+{
+	return ((idx < enc->num) && (enc->type[idx] == type)) ? enc->off[idx] : 0;
+}
+
+/* Build the APDU template of a dataset.
+ * stNum starts at 1, sqNum at 0, t and all members are zero
+ * (empty visible strings, octet strings of size zero bytes).
+ *
+ * Return value is 0, or -1 if the dataset does not fit.
+ */
+int goose_enc_init(struct goose_encoder *enc, const struct goose_dataset *ds)
+{
+	unsigned char zero[256];
+	unsigned int i, len;
+	int pos;
+
+	if ((ds->num > GOOSE_ENC_MAX_MEMBERS) || (ds->gocb_ref == NULL) || (ds->dat_set == NULL))
+		return -1;
+
+	memset(zero, 0, sizeof(zero));
+	memset(enc, 0, sizeof(struct goose_encoder));
+	enc->stnum = 1;
+	enc->sqnum = 0;
+	enc->time_quality = ds->time_quality;
+	enc->num = ds->num;
+
+	/* goosePdu, length filled at the end */
+	enc->apdu[0] = GOOSE_PDU_TAG;
+	enc->len = 4;
+
+	if ((goose_enc_put_str(enc, GOOSE_PDU_GOCBREF, ds->gocb_ref) < 0) ||
+		(goose_enc_put_int(enc, GOOSE_PDU_TAL, ds->time_allowed_to_live) < 0) ||
+		(goose_enc_put_str(enc, GOOSE_PDU_DATSET, ds->dat_set) < 0) ||
+		((ds->go_id != NULL) && (goose_enc_put_str(enc, GOOSE_PDU_GOID, ds->go_id) < 0)))
+		return -1;
+
+	if ((pos = goose_enc_put(enc, GOOSE_PDU_T, zero, 8)) < 0)
+		return -1;
+	enc->off_t = pos;
+	goose_ber_utctime(enc->apdu + pos + 2, 0, enc->time_quality);
+
+	if ((pos = goose_enc_put_int(enc, GOOSE_PDU_STNUM, enc->stnum)) < 0)
+		return -1;
+	enc->off_stnum = pos;
+	if ((pos = goose_enc_put_int(enc, GOOSE_PDU_SQNUM, enc->sqnum)) < 0)
+		return -1;
+	enc->off_sqnum = pos;
+
+	zero[0] = ds->test ? 0xff : 0;
+	if (goose_enc_put(enc, GOOSE_PDU_TEST, zero, 1) < 0)
+		return -1;
+	if (goose_enc_put_int(enc, GOOSE_PDU_CONFREV, ds->conf_rev) < 0)
+		return -1;
+	zero[0] = ds->nds_com ? 0xff : 0;
+	if (goose_enc_put(enc, GOOSE_PDU_NDSCOM, zero, 1) < 0)
+		return -1;
+	zero[0] = 0;
+	if (goose_enc_put_int(enc, GOOSE_PDU_NUMENTRIES, ds->num) < 0)
+		return -1;
+
+	/* allData, length filled at the end */
+	if (enc->len + 4 > GOOSE_ENC_APDU_LEN)
+		return -1;
+	enc->off_all_data = enc->len;
+	enc->apdu[enc->len] = GOOSE_PDU_ALLDATA;
+	enc->len += 4;
+
+	for (i = 0; i < ds->num; i++) {
+		enc->type[i] = ds->members[i].type;
+
+		switch (ds->members[i].type) {
+		case GOOSE_DATA_BOOLEAN:
+			len = 1;
+			break;
+		case GOOSE_DATA_BITSTRING:
+			len = 1 + (ds->members[i].size + 7) / 8;
+			zero[0] = (len - 1) * 8 - ds->members[i].size;   /* unused bits */
+			break;
+		case GOOSE_DATA_INTEGER:
+		case GOOSE_DATA_UNSIGNED:
+			len = 1;
+			break;
+		case GOOSE_DATA_FLOAT:
+			len = 5;
+			zero[0] = 0x08;   /* exponent width */
+			break;
+		case GOOSE_DATA_OCTETSTRING:
+			len = ds->members[i].size;
+			break;
+		case GOOSE_DATA_VISIBLESTRING:
+			len = 0;
+			break;
+		case GOOSE_DATA_UTCTIME:
+			len = 8;
+			zero[7] = enc->time_quality;
+			break;
+		default:
+			return -1;
+		}
+
+		/* Members are patched with a short form length */
+		if (len >= 0x80)
+			return -1;
+
+		pos = goose_enc_put(enc, ds->members[i].type, zero, len);
+		if (pos < 0)
+			return -1;
+		enc->off[i] = pos;
+		zero[0] = 0;
+		zero[7] = 0;
+	}
+
+	goose_enc_put_len2(enc, 0);
+	goose_enc_put_len2(enc, enc->off_all_data);
+	return 0;
+}
+
+/* Set members of the dataset.
+ * Return value is 0, or -1 if idx is not a member of that type.
+ */
+
+int goose_enc_set_bool(struct goose_encoder *enc, unsigned int idx, int val)
+{
+	unsigned int off = goose_enc_member(enc, idx, GOOSE_DATA_BOOLEAN);
+
+	if (off == 0)
+		return -1;
+	enc->apdu[off + 2] = val ? 0xff : 0;
+	return 0;
+}
+
+int goose_enc_set_int(struct goose_encoder *enc, unsigned int idx, int val)
+{
+	unsigned int off = goose_enc_member(enc, idx, GOOSE_DATA_INTEGER);
+
+	return (off == 0) ? -1 : goose_enc_patch_int(enc, off, val);
+}
+
+int goose_enc_set_uint(struct goose_encoder *enc, unsigned int idx, unsigned int val)
+{
+	unsigned int off = goose_enc_member(enc, idx, GOOSE_DATA_UNSIGNED);
+
+	return (off == 0) ? -1 : goose_enc_patch_int(enc, off, val);
+}
+
+int goose_enc_set_float(struct goose_encoder *enc, unsigned int idx, float val)
+{
+	unsigned int off = goose_enc_member(enc, idx, GOOSE_DATA_FLOAT);
+	unsigned int bits;
+
+	if (off == 0)
+		return -1;
+
+	memcpy(&bits, &val, 4);
+	enc->apdu[off + 3] = bits >> 24;
+	enc->apdu[off + 4] = bits >> 16;
+	enc->apdu[off + 5] = bits >> 8;
+	enc->apdu[off + 6] = bits;
+	return 0;
+}
+
+/* Bit i of bits is bit i of the bit string (the first one is the
+ * most significant bit of the first byte), at most 32 bits.
+ */
+int goose_enc_set_bitstring(struct goose_encoder *enc, unsigned int idx, unsigned int bits)
+{
+	unsigned int off = goose_enc_member(enc, idx, GOOSE_DATA_BITSTRING);
+	unsigned int i, nbits;
+	unsigned char *p;
+
+	if (off == 0)
+		return -1;
+
+	p = enc->apdu + off + 3;
+	nbits = (enc->apdu[off + 1] - 1) * 8 - enc->apdu[off + 2];
+	memset(p, 0, enc->apdu[off + 1] - 1);
+	for (i = 0; (i < nbits) && (i < 32); i++)
+		if (bits & (1U << i))
+			p[i / 8] |= 0x80 >> (i % 8);
+	return 0;
+}
+
+int goose_enc_set_utctime(struct goose_encoder *enc, unsigned int idx, unsigned long long ns)
+{
+	unsigned int off = goose_enc_member(enc, idx, GOOSE_DATA_UTCTIME);
+
+	if (off == 0)
+		return -1;
+	goose_ber_utctime(enc->apdu + off + 2, ns, enc->time_quality);
+	return 0;
+}
+
+/* For octet and visible strings, at most 127 bytes */
+int goose_enc_set_string(struct goose_encoder *enc, unsigned int idx,
+						 const void *val, unsigned int len)
+{
+	unsigned int off = goose_enc_member(enc, idx, GOOSE_DATA_OCTETSTRING);
+
+	if (off == 0)
+		off = goose_enc_member(enc, idx, GOOSE_DATA_VISIBLESTRING);
+	return (off == 0) ? -1 : goose_enc_patch(enc, off, val, len);
+}
+
+/* State change: stNum + 1, sqNum 0 and t of the change, in ns.
+ * Call it after the members are set, then send enc->apdu.
+ */
+int goose_enc_change(struct goose_encoder *enc, unsigned long long ns)
+{
+	/* stNum and sqNum roll over to 1 */
+	enc->stnum = (enc->stnum == 0xffffffff) ? 1 : enc->stnum + 1;
+	enc->sqnum = 0;
+
+	goose_ber_utctime(enc->apdu + enc->off_t + 2, ns, enc->time_quality);
+	if ((goose_enc_patch_int(enc, enc->off_stnum, enc->stnum) != 0) ||
+		(goose_enc_patch_int(enc, enc->off_sqnum, enc->sqnum) != 0))
+		return -1;
+	return 0;
+}
+
+/* Repetition without change: sqNum + 1 */
+int goose_enc_repeat(struct goose_encoder *enc)
+{
+	enc->sqnum = (enc->sqnum == 0xffffffff) ? 1 : enc->sqnum + 1;
+	return goose_enc_patch_int(enc, enc->off_sqnum, enc->sqnum);
+}
+
+/* GOOSE APDU decoder */
+
+/* BER length at p, return the size of the length field, 0 if bad */
+static unsigned int goose_ber_len(const unsigned char *p, unsigned int avail,
+								  unsigned int *len)
+{
+	if (avail < 1)
+		return 0;
+	if (p[0] < 0x80) {
+		*len = p[0];
+		return 1;
+	}
+	if ((p[0] == 0x81) && (avail >= 2)) {
+		*len = p[1];
+		return 2;
+	}
+	if ((p[0] == 0x82) && (avail >= 3)) {
+		*len = (p[1] << 8) | p[2];
+		return 3;
+	}
+	return 0;
+}
+
+static long long goose_ber_get_int(const unsigned char *p, unsigned int len)
+{
+	long long val = (len != 0) && (p[0] & 0x80) ? -1 : 0;
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		val = (val << 8) | p[i];
+	return val;
+}
+
+static unsigned long long goose_ber_get_utctime(const unsigned char *p)
+{
+	unsigned long long sec = ((unsigned int) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	unsigned long long frac = (p[4] << 16) | (p[5] << 8) | p[6];
+
+	return sec * 1000000000ULL + ((frac * 1000000000ULL) >> 24);
+}
+
+/* Comparison of the allData region */
+static int goose_memeq_scalar(const unsigned char *a, const unsigned char *b, unsigned int len)
+{
+	return memcmp(a, b, len) == 0;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static int goose_memeq_sse2(const unsigned char *a, const unsigned char *b, unsigned int len)
+{
+	unsigned int i = 0;
+
+	for (; i + 16 <= len; i += 16)
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + i)),
+											 _mm_loadu_si128((const __m128i *) (b + i))))
+			!= 0xffff)
+			return 0;
+	for (; i < len; i++)
+		if (a[i] != b[i])
+			return 0;
+	return 1;
+}
+
+__attribute__((target("avx2")))
+static int goose_memeq_avx2(const unsigned char *a, const unsigned char *b, unsigned int len)
+{
+	unsigned int i = 0;
+
+	for (; i + 32 <= len; i += 32)
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (a + i)),
+												   _mm256_loadu_si256((const __m256i *) (b + i))))
+			!= -1)
+			return 0;
+	for (; i + 16 <= len; i += 16)
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + i)),
+											 _mm_loadu_si128((const __m128i *) (b + i))))
+			!= 0xffff)
+			return 0;
+	for (; i < len; i++)
+		if (a[i] != b[i])
+			return 0;
+	return 1;
+}
+#endif
+
+static int (*goose_memeq)(const unsigned char *a, const unsigned char *b,
+						  unsigned int len) = goose_memeq_scalar;
+
+void goose_dec_init(struct goose_decoder *dec)
+{
+	memset(dec, 0, offsetof(struct goose_decoder, data));
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("avx2"))
+		goose_memeq = goose_memeq_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		goose_memeq = goose_memeq_sse2;
+#endif
+}
+
+/* Decode the members of allData (in dec->data) */
+static void goose_dec_values(struct goose_decoder *dec)
+{
+	const unsigned char *p = dec->data, *end = dec->data + dec->data_len;
+	struct goose_value *val;
+	unsigned int len, n, i, nbits;
+
+	for (dec->num = 0; (p + 2 <= end) && (dec->num < GOOSE_ENC_MAX_MEMBERS); dec->num++) {
+		n = goose_ber_len(p + 1, end - p - 1, &len);
+		if ((n == 0) || (p + 1 + n + len > end))
+			break;
+
+		val = &dec->values[dec->num];
+		val->type = p[0];
+		val->len = (len < 0x100) ? len : 0xff;
+		val->raw = p + 1 + n;
+		memset(&val->v, 0, sizeof(val->v));
+
+		switch (val->type) {
+		case GOOSE_DATA_BOOLEAN:
+			val->v.b = (len != 0) && (val->raw[0] != 0);
+			break;
+		case GOOSE_DATA_INTEGER:
+		case GOOSE_DATA_UNSIGNED:
+			if (len <= 8)
+				val->v.i = goose_ber_get_int(val->raw, len);
+			break;
+		case GOOSE_DATA_FLOAT:
+			/* Only the 32 bit format: exponent width 8 */
+			if ((len == 5) && (val->raw[0] == 0x08)) {
+				unsigned int bits = ((unsigned int) val->raw[1] << 24) | (val->raw[2] << 16) |
+					(val->raw[3] << 8) | val->raw[4];
+				memcpy(&val->v.f, &bits, 4);
+			}
+			break;
+		case GOOSE_DATA_BITSTRING:
+			if (len >= 1) {
+				nbits = (len - 1) * 8 - val->raw[0];
+				for (i = 0; (i < nbits) && (i < 32); i++)
+					if (val->raw[1 + i / 8] & (0x80 >> (i % 8)))
+						val->v.bits |= 1U << i;
+			}
+			break;
+		case GOOSE_DATA_UTCTIME:
+			if (len == 8)
+				val->v.ns = goose_ber_get_utctime(val->raw);
+			break;
+		default:
+			/* Strings and constructed data: raw bytes only */
+			break;
+		}
+
+		p += 1 + n + len;
+	}
+}
+
+/* Full BER walk of a goosePdu, learning its layout */
+static int goose_dec_full(struct goose_decoder *dec, const unsigned char *apdu, unsigned int len)
+{
+	unsigned int pos, end, flen, n;
+	const unsigned char *v;
+
+	dec->valid = 0;
+
+	if ((len < 2) || (apdu[0] != GOOSE_PDU_TAG))
+		return -1;
+	n = goose_ber_len(apdu + 1, len - 1, &flen);
+	if ((n == 0) || (1 + n + flen > len))
+		return -1;
+	pos = 1 + n;
+	end = pos + flen;
+
+	dec->off_t = dec->off_stnum = dec->off_sqnum = dec->off_data = 0;
+	dec->data_len = 0;
+
+	while (pos + 2 <= end) {
+		n = goose_ber_len(apdu + pos + 1, end - pos - 1, &flen);
+		if ((n == 0) || (pos + 1 + n + flen > end))
+			return -1;
+		v = apdu + pos + 1 + n;
+
+		switch (apdu[pos]) {
+		case GOOSE_PDU_T:
+			if ((n != 1) || (flen != 8))
+				return -1;
+			dec->off_t = pos;
+			dec->t = goose_ber_get_utctime(v);
+			break;
+		case GOOSE_PDU_STNUM:
+			if ((n != 1) || (flen == 0) || (flen > 5))
+				return -1;
+			dec->off_stnum = pos;
+			dec->stnum = goose_ber_get_int(v, flen);
+			memcpy(dec->stnum_raw, apdu + pos, 2 + flen);
+			break;
+		case GOOSE_PDU_SQNUM:
+			if ((n != 1) || (flen == 0) || (flen > 5))
+				return -1;
+			dec->off_sqnum = pos;
+			dec->sqnum = goose_ber_get_int(v, flen);
+			dec->sqnum_len = flen;
+			break;
+		case GOOSE_PDU_TEST:
+			dec->test = (flen != 0) && (v[0] != 0);
+			break;
+		case GOOSE_PDU_CONFREV:
+			dec->conf_rev = goose_ber_get_int(v, (flen <= 5) ? flen : 5);
+			break;
+		case GOOSE_PDU_NDSCOM:
+			dec->nds_com = (flen != 0) && (v[0] != 0);
+			break;
+		case GOOSE_PDU_ALLDATA:
+			if (flen > sizeof(dec->data))
+				return -1;
+			dec->off_data = v - apdu;
+			dec->data_len = flen;
+			memcpy(dec->data, v, flen);
+			break;
+		default:
+			break;
+		}
+
+		pos += 1 + n + flen;
+	}
+
+	if ((dec->off_t == 0) || (dec->off_stnum == 0) || (dec->off_sqnum == 0) ||
+		(dec->off_data == 0))
+		return -1;
+
+	goose_dec_values(dec);
+
+	/* The fast path needs sqNum before, and allData last, as encoded
+	 * by IEC 61850-8-1; what lies between them is compared as well.
+	 */
+	dec->len = len;
+	dec->off_cfg = dec->off_sqnum + 2 + dec->sqnum_len;
+	dec->valid = (dec->off_data + dec->data_len == len) && (dec->off_cfg <= dec->off_data) &&
+		(dec->off_data - dec->off_cfg <= GOOSE_DEC_CFG_LEN);
+	if (dec->valid) {
+		dec->cfg_len = dec->off_data - dec->off_cfg;
+		memcpy(dec->cfg_raw, apdu + dec->off_cfg, dec->cfg_len);
+	}
+	return GOOSE_DEC_CHANGED;
+}
+
+/* Decode a received APDU (struct goose_frame apdu and apdu_len).
+ *
+ * Return value is GOOSE_DEC_SAME if stNum, test, confRev, ndsCom and
+ * allData are those of the last accepted frame (only sqnum and t
+ * are updated), GOOSE_DEC_CHANGED if the frame is decoded, or -1 if it is malformed.
+ */
+int goose_dec_frame(struct goose_decoder *dec, const unsigned char *apdu, unsigned int len)
+{
+	const unsigned char *p;
+
+	/* Fast path: same layout, same stNum, test, confRev, ndsCom and allData */
+	if (dec->valid && (len == dec->len) &&
+		(memcmp(apdu + dec->off_stnum, dec->stnum_raw, 2 + dec->stnum_raw[1]) == 0) &&
+		(apdu[dec->off_sqnum] == GOOSE_PDU_SQNUM) && (apdu[dec->off_sqnum + 1] == dec->sqnum_len) &&
+		(memcmp(apdu + dec->off_cfg, dec->cfg_raw, dec->cfg_len) == 0) &&
+		(apdu[dec->off_t] == GOOSE_PDU_T) && (apdu[dec->off_t + 1] == 8) &&
+		goose_memeq(apdu + dec->off_data, dec->data, dec->data_len)) {
+		p = apdu + dec->off_sqnum;
+		dec->sqnum = goose_ber_get_int(p + 2, p[1]);
+		dec->t = goose_ber_get_utctime(apdu + dec->off_t + 2);
+		return GOOSE_DEC_SAME;
+	}
+
+	return goose_dec_full(dec, apdu, len);
+}
+
+/* GOOSE dispatcher
+ * Slot of a worker ring: | goose_disp_slot | APDU ... |
+ */
+struct goose_disp_slot {
+	unsigned int bucket;
+	struct goose_frame frame;   /* apdu points behind the slot header */
+};
+
+/* Spins of an idle worker before it sleeps */
+#define GOOSE_DISP_SPINS         2000
+/* Frames the receiver takes from nl_if between checks of stop */
+#define GOOSE_DISP_RX_BUDGET     1024
+
+static inline void goose_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	_mm_pause();
+#endif
+}
+
+static inline unsigned int goose_disp_bucket(unsigned short appid)
+{
+	return ((appid * 0x9e3779b1u) >> 24) & (GOOSE_DISP_BUCKETS - 1);
+}
+
+static inline struct goose_disp_slot *goose_disp_slot(struct goose_dispatcher *disp,
+													  struct goose_disp_worker *w,
+													  unsigned int idx)
+{
+	return (struct goose_disp_slot *) (w->slots +
+		(idx & (GOOSE_DISP_RING_SLOTS - 1)) * disp->slot_size);
+}
+
+static void goose_disp_pin(int cpu)
+{
+	cpu_set_t set;
+
+	if (cpu < 0)
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+}
+
+static inline void goose_disp_wake(struct goose_disp_worker *w)
+{
+	if (__atomic_exchange_n(&w->sleeping, 0, __ATOMIC_SEQ_CST))
+		syscall(SYS_futex, &w->sleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/* A worker with an empty ring, or NULL */
+static struct goose_disp_worker *goose_disp_idle(struct goose_dispatcher *disp,
+												 unsigned int from)
+{
+	struct goose_disp_worker *w;
+	unsigned int i;
+
+	for (i = 1; i < disp->num; i++) {
+		w = &disp->workers[(from + i) % disp->num];
+		if (w->tail == __atomic_load_n(&w->head, __ATOMIC_ACQUIRE))
+			return w;
+	}
+	return NULL;
+}
+
+/* Hand a frame to the worker of its stream; the APDU is copied.
+ * Only one thread may push: the receiver of the dispatcher, or the
+ * caller if the dispatcher has no nl_if. It waits while the ring
+ * of the worker is full.
+ *
+ * Return value is 0, or -1 if the frame does not fit in a slot or
+ * the dispatcher stops.
+ */
+int goose_disp_push(struct goose_dispatcher *disp, const struct goose_frame *frame)
+{
+	unsigned int b = goose_disp_bucket(frame->goose_h.appid);
+	struct goose_disp_worker *w = &disp->workers[disp->owner[b]], *idle;
+	struct goose_disp_slot *slot;
+
+	if (frame->apdu_len > disp->slot_size - sizeof(struct goose_disp_slot))
+		return -1;
+
+	/* The worker is behind: an idle one takes the stream over, if no
+	 * frame of the stream is left behind (pending is only raised here)
+	 */
+	if ((w->tail - __atomic_load_n(&w->head, __ATOMIC_ACQUIRE) >= GOOSE_DISP_STEAL_THRESH) &&
+		(__atomic_load_n(&disp->pending[b], __ATOMIC_ACQUIRE) == 0)) {
+		idle = goose_disp_idle(disp, disp->owner[b]);
+		if (idle != NULL) {
+			disp->owner[b] = idle - disp->workers;
+			idle->steals++;
+			w = idle;
+		}
+	}
+
+	if (w->tail - __atomic_load_n(&w->head, __ATOMIC_ACQUIRE) >= GOOSE_DISP_RING_SLOTS) {
+		disp->ring_full++;
+		while (w->tail - __atomic_load_n(&w->head, __ATOMIC_ACQUIRE) >= GOOSE_DISP_RING_SLOTS) {
+			if (__atomic_load_n(&disp->stop, __ATOMIC_ACQUIRE))
+				return -1;
+			goose_disp_wake(w);
+			sched_yield();
+		}
+	}
+
+	slot = goose_disp_slot(disp, w, w->tail);
+	slot->bucket = b;
+	slot->frame = *frame;
+	slot->frame.apdu = (unsigned char *) (slot + 1);
+	memcpy(slot + 1, frame->apdu, frame->apdu_len);
+
+	__atomic_add_fetch(&disp->pending[b], 1, __ATOMIC_RELAXED);
+
+	/* Publish the slot, then see if the worker sleeps */
+	__atomic_store_n(&w->tail, w->tail + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&w->sleeping, __ATOMIC_SEQ_CST))
+		goose_disp_wake(w);
+
+	return 0;
+}
+
+static void *goose_disp_worker_run(void *arg)
+{
+	struct goose_disp_worker *w = (struct goose_disp_worker *) arg;
+	struct goose_dispatcher *disp = w->disp;
+	struct goose_disp_slot *slot;
+	struct timespec ts = {0, 100000000};
+	unsigned int head, spins = 0;
+
+	goose_disp_pin(w->cpu);
+
+	while (1) {
+		head = w->head;
+		if (head != __atomic_load_n(&w->tail, __ATOMIC_ACQUIRE)) {
+			slot = goose_disp_slot(disp, w, head);
+			disp->cb(&slot->frame, disp->arg);
+
+			/* Done with the frame before the stream may move */
+			__atomic_sub_fetch(&disp->pending[slot->bucket], 1, __ATOMIC_RELEASE);
+			w->frames++;
+			__atomic_store_n(&w->head, head + 1, __ATOMIC_RELEASE);
+			spins = 0;
+			continue;
+		}
+
+		/* Queued frames are handled before stopping */
+		if (__atomic_load_n(&disp->stop, __ATOMIC_ACQUIRE))
+			break;
+
+		if (++spins < GOOSE_DISP_SPINS) {
+			goose_cpu_relax();
+			continue;
+		}
+
+		__atomic_store_n(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+		if (head == __atomic_load_n(&w->tail, __ATOMIC_SEQ_CST))
+			syscall(SYS_futex, &w->sleeping, FUTEX_WAIT_PRIVATE, 1, &ts, NULL, 0);
+		__atomic_store_n(&w->sleeping, 0, __ATOMIC_RELAXED);
+		spins = 0;
+	}
+
+	return NULL;
+}
+
+static void goose_disp_route(struct goose_frame *frame, void *arg)
+{
+	goose_disp_push((struct goose_dispatcher *) arg, frame);
+}
+
+static void *goose_disp_receiver(void *arg)
+{
+	struct goose_dispatcher *disp = (struct goose_dispatcher *) arg;
+	struct pollfd pfd = {
+		.fd = nl_if_fd(disp->nl_if),
+		.events = POLLIN
+	};
+
+	goose_disp_pin(disp->rx_cpu);
+
+	while (!__atomic_load_n(&disp->stop, __ATOMIC_ACQUIRE)) {
+		if (poll(&pfd, 1, 100) <= 0)
+			continue;
+		goose_dispatch(disp->nl_if, goose_disp_route, disp, GOOSE_DISP_RX_BUDGET);
+	}
+
+	return NULL;
+}
+
+/* Dispatcher constructor
+ * Start num workers running cb for each frame, the worker i pinned
+ * to cpus[i] (cpus may be NULL, a CPU of -1 is not pinned). With an
+ * nl_if, a receiver thread pinned to rx_cpu drains it, nothing else
+ * may receive on nl_if meanwhile. Without, the caller feeds frames
+ * with goose_disp_push(...).
+ */
+int goose_disp_start(struct goose_dispatcher *disp, struct nl_interface *nl_if,
+					 unsigned int num, const int *cpus, int rx_cpu,
+					 goose_frame_cb cb, void *arg)
+{
+	struct goose_disp_worker *w;
+	unsigned int i;
+
+	if ((num == 0) || (num > GOOSE_DISP_MAX_WORKERS) || (cb == NULL))
+		return -1;
+
+	memset(disp, 0, sizeof(struct goose_dispatcher));
+	disp->nl_if = nl_if;
+	disp->cb = cb;
+	disp->arg = arg;
+	disp->rx_cpu = rx_cpu;
+	disp->slot_size = (sizeof(struct goose_disp_slot) +
+					   ((nl_if != NULL) ? nl_if->in_buf_len : GOOSE_MAX_APDU_LEN) + 63) & ~63;
+
+	for (i = 0; i < GOOSE_DISP_BUCKETS; i++)
+		disp->owner[i] = i % num;
+
+	for (i = 0; i < num; i++) {
+		w = &disp->workers[i];
+		w->disp = disp;
+		w->cpu = (cpus != NULL) ? cpus[i] : -1;
+		w->slots = (unsigned char *) malloc(GOOSE_DISP_RING_SLOTS * disp->slot_size);
+		if ((w->slots == NULL) ||
+			(pthread_create(&w->tid, NULL, goose_disp_worker_run, w) != 0)) {
+			free(w->slots);
+			goose_disp_stop(disp);
+			return -1;
+		}
+		disp->num++;
+	}
+
+	if ((nl_if != NULL) &&
+		(pthread_create(&disp->rx_tid, NULL, goose_disp_receiver, disp) != 0)) {
+		disp->nl_if = NULL;
+		goose_disp_stop(disp);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Dispatcher destructor
+ * Frames already handed to the workers are handled first.
+ */
+int goose_disp_stop(struct goose_dispatcher *disp)
+{
+	unsigned int i;
+
+	__atomic_store_n(&disp->stop, 1, __ATOMIC_RELEASE);
+
+	if (disp->nl_if != NULL)
+		pthread_join(disp->rx_tid, NULL);
+
+	for (i = 0; i < disp->num; i++) {
+		goose_disp_wake(&disp->workers[i]);
+		pthread_join(disp->workers[i].tid, NULL);
+		free(disp->workers[i].slots);
+	}
+
+	return 0;
 }
@@ -11,30 +11,445 @@
 #include <linux/netlink.h>
 #include <linux/socket.h>
 #include <arpa/inet.h>
+#include <sys/ioctl.h>
 
 #include <semaphore.h>
+#include <pthread.h>
 
 #include "goose_module.h"
 #include "proto_goose.h"
 
+/* Size of the buffer for a batch, larger batches are split */
+#define NL_MAX_BATCH_LEN 65536
+
+/* Time to wait for the report of a batch, in ms */
+#define NL_BATCH_REPORT_TIMEOUT 1000
+
+/* Send context:
+ * A netlink socket with a kernel-assigned port and its own buffer,
+ * for batches and their reports. Contexts share nothing, so each
+ * sending thread should have one. Starts with
+ *    nl_tx_ctx_init(...)
+ * and ends with
+ *    nl_tx_ctx_close(...)
+ */
+struct nl_tx_ctx {
+	int fd;
+	unsigned int pid;          /* port assigned by the kernel */
+	struct sockaddr_nl dest_addr;
+	struct iovec iov;
+	struct msghdr msg;
+	int stale;                 /* a report timed out, it may still come */
+};
+
+/* AF_PACKET backend, without the kernel module, see
+ * nl_if_init_packet(...). Frames go through PACKET_MMAP TPACKET_V3
+ * rings of one socket bound to a device: the RX ring hands over
+ * blocks of frames, a block is given back once all its frames are
+ * parsed; the TX ring is flushed by one sendto() for all frames put
+ * since the last one, bypassing the qdisc. A block which is not
+ * full is handed over after GOOSE_PKT_RX_TOV ms at the latest.
+ * Frames are sent on the device of the backend, serialized by
+ * access_out; NL_MSG_DATA_RELB frames are sent once. Subscriptions
+ * select APPIDs (their daddr is ignored). What lives in the module
+ * (publications, filters, 802.1Q tags, nl_tx_ctx, the module rings
+ * and io_uring) is not available.
+ */
+#define GOOSE_PKT_BLOCK_SIZE     (1 << 16)
+#define GOOSE_PKT_RX_BLOCKS      32
+#define GOOSE_PKT_TX_BLOCKS      4
+#define GOOSE_PKT_RX_TOV         1     /* ms */
+#define GOOSE_PKT_FRAME_SIZE     2048  /* smallest TX frame */
+
+/* nl_if_init(...) takes the AF_PACKET backend if this environment
+ * variable is "packet:<device>", e.g. GOOSE_BACKEND=packet:eth0, and
+ * the AF_XDP one if it is "xdp:<device>[:<queue>[:skb|drv]]"
+ */
+#define NL_IF_BACKEND_ENV        "GOOSE_BACKEND"
+
+#define NL_IF_BACKEND_NETLINK    0
+#define NL_IF_BACKEND_PACKET     1
+#define NL_IF_BACKEND_XDP        2
+
+struct nl_if_packet {
+	int ifindex;
+	char dev_name[IFNAMSIZE];
+	unsigned char haddr[6];    /* source address of the frames sent */
+	unsigned char *map;        /* RX blocks, then TX frames */
+	size_t map_len;
+	unsigned char *tx_ring;
+	unsigned int tx_frame_size;
+	unsigned int tx_frame_num;
+	unsigned int tx_head;      /* next TX frame to fill */
+	unsigned int rx_block;     /* block being parsed */
+	int rx_held;               /* rx_block is handed over */
+	unsigned int rx_left;      /* its frames not parsed yet */
+	unsigned char *rx_next;
+	unsigned int sub_count;    /* APPIDs subscribed, 0 for all */
+	unsigned char sub[65536 / 8];
+};
+
+/* AF_XDP backend, without the kernel module, see nl_if_init_xdp(...).
+ * An XDP program on the device redirects the GOOSE frames (0x88b8,
+ * tagged or not) of the subscribed APPIDs, or all of them while none
+ * is subscribed, to an XSK socket of one queue; other frames go on to
+ * the stack. Frames live in a UMEM of GOOSE_XDP_FRAMES frames, half
+ * of them for receiving (the fill ring), half for sending. Received
+ * frames are parsed in place and given back at the next receiving
+ * call; sent frames are put in the TX ring and the kernel is woken
+ * up once per batch. The socket is busy polled (Linux 5.11).
+ * The program is attached in driver mode if the device has it, else
+ * in generic (skb) mode, e.g. on veth; zero-copy needs a driver with
+ * AF_XDP support, copy mode is taken otherwise. It is detached when
+ * the interface is closed. Needs Linux 5.9 and CAP_NET_ADMIN, CAP_BPF.
+ * Frames have no kernel timestamp (rx is when they are pulled) and
+ * tags stripped by the device are lost. Frames larger than a UMEM
+ * frame are not received. Other limits are those of the AF_PACKET
+ * backend.
+ */
+#define GOOSE_XDP_FRAMES         4096
+#define GOOSE_XDP_FRAME_SIZE     4096
+#define GOOSE_XDP_RING_SIZE      (GOOSE_XDP_FRAMES / 2)   /* descriptors of a ring */
+#define GOOSE_XDP_RX_BATCH       64    /* descriptors pulled at once */
+#define GOOSE_XDP_BUSY_POLL      20    /* us */
+#define GOOSE_XDP_MAX_QUEUES     64
+
+#define GOOSE_XDP_MODE_AUTO      0     /* driver mode, else generic */
+#define GOOSE_XDP_MODE_SKB       1
+#define GOOSE_XDP_MODE_DRV       2
+
+struct goose_xdp_ring {
+	unsigned int *producer;
+	unsigned int *consumer;
+	unsigned int *flags;
+	void *desc;
+	unsigned int cached;       /* our producer or consumer index */
+	void *map;
+	size_t map_len;
+};
+
+struct nl_if_xdp {
+	int ifindex;
+	unsigned int queue;
+	char dev_name[IFNAMSIZE];
+	unsigned char haddr[6];    /* source address of the frames sent */
+	int prog_fd, link_fd;
+	int xsk_map_fd, appid_map_fd;
+	unsigned char *umem;
+	size_t umem_len;
+	struct goose_xdp_ring rx, tx, fill, comp;
+	unsigned int rx_num;       /* descriptors pulled from rx */
+	unsigned int rx_idx;       /* of them parsed */
+	unsigned int sub_count;    /* APPIDs subscribed, 0 for all */
+	unsigned int tx_free_num;
+	unsigned long long tx_free[GOOSE_XDP_FRAMES / 2];
+};
+
+struct nl_if_ops;
+
 /* Netlink interface:
  * Store socket, caches for interation with kernel.
  * Starts with
  *    nl_if_init(...)
  * and ends with
  *    nl_if_close(...)
+ * The port of the socket is assigned by the kernel, so a process may
+ * open several interfaces. Single messages are gathered from the
+ * caller's buffers and need no lock, any thread may send them.
+ * Receiving is serialized by access_in, batches sent on nl_if by
+ * access_out (threads sending batches should use their own
+ * nl_tx_ctx instead).
  */
+/* Number of messages pulled from the socket by one recvmmsg() */
+#define NL_RECV_MMSG_NUM 16
+
 struct nl_interface {
-	struct iovec iov_in, iov_out;
+	struct iovec iov_in[NL_RECV_MMSG_NUM];
 	struct sockaddr_nl src_addr, dest_addr;	
-	struct msghdr msg_in, msg_out;
+	struct mmsghdr msg_in[NL_RECV_MMSG_NUM];
+	unsigned int in_num;       /* messages in msg_in */
+	unsigned int in_idx;       /* message being parsed */
+	struct nlmsghdr *in_nlh;   /* next record of message in_idx */
+	int in_rem;                /* bytes left from in_nlh */
+	unsigned long long in_tstamp; /* when msg_in was pulled, in ns */
+	unsigned int in_buf_len;   /* of each iov_in, by the largest MTU (or frame) */
+	unsigned long in_trunc;    /* messages larger than in_buf_len, dropped */
+	unsigned long in_bad;      /* frames with a broken length, dropped */
 	int sock_fd;
+	struct nl_tx_ctx tx;       /* batches sent on nl_if */
 	sem_t access_in;
 	sem_t access_out;	
+	const struct nl_if_ops *ops;  /* backend */
+	struct nl_if_packet *pkt;  /* AF_PACKET backend, NULL for the module */
+	struct nl_if_xdp *xdp;     /* AF_XDP backend, NULL for the module */
+};
+
+/* One GOOSE frame of a batch */
+struct goose_batch_rec {
+	struct nl_data_header *nl_data_h;
+	struct goosehdr *goose_h;
+	unsigned char *apdu;
+	unsigned int apdu_len;
+	unsigned short msg_type;
+	unsigned long long tx_tstamp; /* set if msg_type has NL_MSG_DATA_TSTAMP */
+};
+
+/* Timestamps of a received frame in ns (CLOCK_REALTIME):
+ *   rx       - the frame reaches the host
+ *   queued   - the module hands it to user space
+ *   dequeued - the library pulls it from the socket or the ring
+ */
+struct goose_rx_tstamp {
+	unsigned long long rx;
+	unsigned long long queued;
+	unsigned long long dequeued;
+};
+
+/* Largest APDU of a frame */
+#define GOOSE_MAX_APDU_LEN (GOOSE_MAX_FRAME_LEN - sizeof(struct goosehdr))
+
+/* A received GOOSE frame, read only and in place in the receiving
+ * buffers of the interface: valid until the next receiving call.
+ * apdu_len is the one of the goose header, checked against the
+ * received bytes.
+ */
+struct goose_view {
+	const struct nl_data_header *nl_data_h;
+	const struct goosehdr *goose_h;    /* as on the wire, network order */
+	unsigned short appid;              /* host order */
+	const unsigned char *apdu;
+	unsigned int apdu_len;
+	struct goose_rx_tstamp tstamp;
+	unsigned int vlan;                 /* GOOSE_VLAN_PRESENT | TCI, or 0 */
+};
+
+/* A received GOOSE frame.
+ * apdu points into the receiving buffers of the interface,
+ * it is valid until the next receiving call.
+ */
+struct goose_frame {
+	struct nl_data_header nl_data_h;
+	struct goosehdr goose_h;   /* appid and len in host order */
+	unsigned char *apdu;
+	unsigned int apdu_len;
+	struct goose_rx_tstamp tstamp;
+	unsigned int vlan;         /* GOOSE_VLAN_PRESENT | TCI, or 0 */
+};
+
+/* Callback of the dispatch APIs, frame is valid during the call only */
+typedef void (*goose_frame_cb)(struct goose_frame *frame, void *arg);
+
+/* io_uring receiving backend, see goose_uring_open(...).
+ * Starts with
+ *    goose_uring_open(...)
+ * and ends with
+ *    goose_uring_close(...)
+ */
+#define GOOSE_URING_BUFS 64        /* provided buffers of in_buf_len */
+
+struct goose_uring {
+	int ring_fd;
+	int sock_fd;
+	int armed;                 /* multishot recv in flight */
+	void *sq_ptr, *cq_ptr;
+	size_t sq_len, cq_len, sqes_len;
+	unsigned int *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	struct io_uring_buf_ring *br;
+	unsigned short br_tail;
+	unsigned int buf_len;      /* in_buf_len of the interface */
+	unsigned char *bufs;
+};
+
+/* Shared memory TX ring of the kernel module, see goose_module.h.
+ * Starts with
+ *    goose_tx_ring_open(...)
+ * and ends with
+ *    goose_tx_ring_close(...)
+ */
+struct goose_tx_ring {
+	int fd;
+	struct goose_ring_hdr *hdr;
+	unsigned char *slots;
+	unsigned int prod;         /* next slot to fill */
+	unsigned int done;         /* next slot to complete */
+};
+
+/* Shared memory RX ring of the kernel module, see goose_module.h.
+ * Starts with
+ *    goose_rx_ring_open(...)
+ * and ends with
+ *    goose_rx_ring_close(...)
+ * While the ring is open, received frames are not sent by netlink.
+ */
+struct goose_rx_ring {
+	int fd;
+	struct goose_ring_hdr *hdr;
+	unsigned char *slots;
+	unsigned int cons;         /* local copy of the consumer index */
+};
+
+/* GOOSE APDU encoder
+ * goose_enc_init(...) encodes an IECGoosePdu once from a dataset
+ * description and keeps the offsets of t, stNum, sqNum and every
+ * member of allData. Publishing then patches these fields in place
+ * in enc->apdu, without allocation or re-encoding. Only a value
+ * changing its encoded size (an INTEGER crossing a byte boundary,
+ * a string changing its length) moves the fields behind it.
+ * The goosePdu and allData lengths use the 2-byte long form, so
+ * they never change their own size.
+ */
+
+/* Types of dataset members, their BER tags in allData */
+#define GOOSE_DATA_BOOLEAN       0x83
+#define GOOSE_DATA_BITSTRING     0x84
+#define GOOSE_DATA_INTEGER       0x85
+#define GOOSE_DATA_UNSIGNED      0x86
+#define GOOSE_DATA_FLOAT         0x87   /* 32 bit */
+#define GOOSE_DATA_OCTETSTRING   0x89
+#define GOOSE_DATA_VISIBLESTRING 0x8a
+#define GOOSE_DATA_UTCTIME       0x91
+
+struct goose_enc_member {
+	unsigned char type;        /* GOOSE_DATA_XXX */
+	unsigned char size;        /* bits of a bit string, initial bytes of an octet string */
+};
+
+struct goose_dataset {
+	const char *gocb_ref;
+	const char *dat_set;
+	const char *go_id;         /* NULL to omit it */
+	unsigned int time_allowed_to_live;   /* ms */
+	unsigned int conf_rev;
+	int test;
+	int nds_com;
+	unsigned char time_quality;          /* of t and UtcTime members */
+	const struct goose_enc_member *members;
+	unsigned int num;
+};
+
+#define GOOSE_ENC_MAX_MEMBERS    128
+#define GOOSE_ENC_APDU_LEN       GOOSE_MAX_APDU_LEN
+
+struct goose_encoder {
+	unsigned char apdu[GOOSE_ENC_APDU_LEN];
+	unsigned int len;          /* APDU length */
+	unsigned int stnum, sqnum;
+	unsigned char time_quality;
+	unsigned int off_t, off_stnum, off_sqnum, off_all_data;   /* offsets of the tags */
+	unsigned int num;
+	unsigned int off[GOOSE_ENC_MAX_MEMBERS];
+	unsigned char type[GOOSE_ENC_MAX_MEMBERS];
+};
+
+/* GOOSE APDU decoder
+ * One decoder per received stream (APPID / datSet). It learns the
+ * layout of the stream from the first frame. When stNum, the
+ * fields between sqNum and allData (test, confRev, ndsCom,
+ * numDatSetEntries) and the allData bytes are those of the last
+ * accepted frame (a heartbeat), only sqNum and t are read; allData
+ * is compared with SSE2 or AVX2, without a BER walk. Otherwise the
+ * frame is decoded into dec->values.
+ */
+#define GOOSE_DEC_SAME           0   /* data unchanged, only sqnum and t updated */
+#define GOOSE_DEC_CHANGED        1   /* values decoded */
+
+#define GOOSE_DEC_CFG_LEN        32  /* bytes from sqNum to allData, at most */
+
+struct goose_value {
+	unsigned char type;        /* BER tag, GOOSE_DATA_XXX for known types */
+	unsigned char len;         /* bytes of the value */
+	const unsigned char *raw;  /* value in dec->data */
+	union {
+		int b;
+		long long i;           /* GOOSE_DATA_INTEGER, GOOSE_DATA_UNSIGNED */
+		float f;
+		unsigned int bits;     /* bit i of the bit string, up to 32 */
+		unsigned long long ns; /* GOOSE_DATA_UTCTIME */
+	} v;
+};
+
+struct goose_decoder {
+	unsigned int stnum, sqnum;
+	unsigned long long t;      /* ns */
+	unsigned int conf_rev;
+	int test, nds_com;
+	unsigned int num;          /* members decoded */
+	struct goose_value values[GOOSE_ENC_MAX_MEMBERS];
+	/* Layout of the last accepted frame */
+	int valid;
+	unsigned int len;
+	unsigned int off_t, off_stnum, off_sqnum, off_data;
+	unsigned char stnum_raw[8];  /* stNum TLV */
+	unsigned int sqnum_len;
+	unsigned int off_cfg, cfg_len;                  /* behind sqNum, up to allData */
+	unsigned char cfg_raw[GOOSE_DEC_CFG_LEN];
+	unsigned int data_len;       /* allData content */
+	unsigned char data[GOOSE_ENC_APDU_LEN] __attribute__((aligned(32)));
+};
+
+/* GOOSE dispatcher
+ * A receiver thread drains nl_if and hands every frame to one of
+ * the worker threads, which run the handler. Frames are routed by
+ * APPID to one of GOOSE_DISP_BUCKETS streams, and a stream belongs
+ * to one worker at a time, so the frames of an APPID are handled in
+ * order. Each worker has a single-producer single-consumer ring fed
+ * by the receiver only, no lock is taken per frame.
+ * When the ring of a worker backs up, an idle worker steals the
+ * stream of the next frame, provided none of its frames is still
+ * queued or being handled (the order is kept).
+ * Starts with
+ *    goose_disp_start(...)
+ * and ends with
+ *    goose_disp_stop(...)
+ */
+#define GOOSE_DISP_MAX_WORKERS   64
+#define GOOSE_DISP_RING_SLOTS    256   /* power of 2 */
+#define GOOSE_DISP_BUCKETS       256   /* streams */
+#define GOOSE_DISP_STEAL_THRESH  16    /* queued frames before stealing */
+
+struct goose_dispatcher;
+
+struct goose_disp_worker {
+	/* Written by the receiver */
+	unsigned int tail __attribute__((aligned(64)));
+	unsigned int sleeping;     /* worker waits on it, futex */
+	/* Written by the worker */
+	unsigned int head __attribute__((aligned(64)));
+	unsigned long frames;      /* frames handled */
+	unsigned char *slots;
+	struct goose_dispatcher *disp;
+	pthread_t tid;
+	int cpu;                   /* -1 if not pinned */
+	unsigned long steals;      /* streams stolen, by the receiver */
+};
+
+struct goose_dispatcher {
+	struct nl_interface *nl_if;  /* NULL: frames come by goose_disp_push(...) */
+	goose_frame_cb cb;
+	void *arg;
+	unsigned int num;            /* workers */
+	unsigned int slot_size;
+	int stop;
+	int rx_cpu;
+	pthread_t rx_tid;
+	unsigned long ring_full;     /* waits for a full ring */
+	unsigned char owner[GOOSE_DISP_BUCKETS];     /* worker of a stream */
+	unsigned int pending[GOOSE_DISP_BUCKETS];    /* frames queued or in the handler */
+	struct goose_disp_worker workers[GOOSE_DISP_MAX_WORKERS];
 };
 
 int nl_if_init (struct nl_interface *nl_if);
+int nl_if_init_packet(struct nl_interface *nl_if, const char *dev_name);
+int nl_if_init_xdp(struct nl_interface *nl_if, const char *dev_name,
+				   unsigned int queue, int mode);
 int nl_if_close (struct nl_interface *nl_if);
+int nl_if_backend(struct nl_interface *nl_if);
+
+int nl_tx_ctx_init(struct nl_tx_ctx *ctx);
+int nl_tx_ctx_close(struct nl_tx_ctx *ctx);
 
 /* GOOSE Communication APIs */
 int send_raw(struct nl_interface *nl_if, unsigned char *data,
@@ -44,7 +459,106 @@ int send_goose_data(struct nl_interface *nl_if, struct nl_data_header *nl_data_h
 					struct goosehdr *goose_h, unsigned char *apdu,
 					unsigned int apdu_len, unsigned short msg_type);
 
+int send_goose_batch(struct nl_interface *nl_if, struct goose_batch_rec *recs,
+					 unsigned int num, int *status);
+
+int send_goose_batch_ctx(struct nl_tx_ctx *ctx, struct goose_batch_rec *recs,
+						 unsigned int num, int *status);
+
+int send_goose_data_ts(struct nl_interface *nl_if, struct nl_data_header *nl_data_h,
+					   struct goosehdr *goose_h, unsigned char *apdu,
+					   unsigned int apdu_len, unsigned short msg_type,
+					   unsigned long long *tx_tstamp);
+
 int send_goose_ctrl(struct nl_interface *nl_if, struct nl_ctrl_header *ctrl_info);
 
+int send_goose_filter(struct nl_interface *nl_if, struct nl_filter_header *filter);
+
+int goose_set_vlan(struct nl_interface *nl_if, unsigned short appid,
+				   unsigned short vid, unsigned char pcp);
+int goose_clear_vlan(struct nl_interface *nl_if, unsigned short appid);
+
+int goose_set_profile(struct nl_interface *nl_if, unsigned int id,
+					  const struct goose_param_t *param, unsigned int acks);
+int goose_map_profile(struct nl_interface *nl_if, unsigned short appid,
+					  unsigned int id);
+
+int goose_subscribe(struct nl_interface *nl_if, unsigned short appid,
+					unsigned char *daddr);
+
+int goose_unsubscribe(struct nl_interface *nl_if, unsigned short appid,
+					  unsigned char *daddr);
+
+int goose_publish(struct nl_interface *nl_if, struct nl_data_header *nl_data_h,
+				  struct goosehdr *goose_h, unsigned char *apdu,
+				  unsigned int apdu_len, unsigned short t1);
+
+int goose_unpublish(struct nl_interface *nl_if, struct nl_data_header *nl_data_h,
+					unsigned short appid);
+
 int recv_raw(struct nl_interface *nl_if, struct nl_data_header *nl_data_h,
 			 struct goosehdr *goose_h, unsigned char *apdu);
+
+int recv_raw_ts(struct nl_interface *nl_if, struct nl_data_header *nl_data_h,
+				struct goosehdr *goose_h, unsigned char *apdu,
+				struct goose_rx_tstamp *tstamp);
+
+int recv_goose_batch(struct nl_interface *nl_if, struct goose_frame *frames,
+					 unsigned int max);
+
+int recv_goose_view(struct nl_interface *nl_if, struct goose_view *view);
+
+int goose_dev_mtu(const char *dev_name);
+int goose_set_dev(struct nl_data_header *nl_data_h, const char *dev_name);
+
+/* Non-blocking receiving APIs, for event loops */
+int nl_if_fd(struct nl_interface *nl_if);
+int recv_goose_nb(struct nl_interface *nl_if, struct goose_frame *frame);
+int goose_dispatch(struct nl_interface *nl_if, goose_frame_cb cb, void *arg,
+				   unsigned int budget);
+
+/* io_uring receiving APIs */
+int goose_uring_open(struct goose_uring *ur, struct nl_interface *nl_if);
+int goose_uring_close(struct goose_uring *ur);
+int goose_uring_fd(struct goose_uring *ur);
+int goose_uring_dispatch(struct goose_uring *ur, goose_frame_cb cb, void *arg, int wait);
+
+/* TX ring APIs */
+int goose_tx_ring_open(struct goose_tx_ring *ring);
+int goose_tx_ring_close(struct goose_tx_ring *ring);
+int goose_tx_ring_put(struct goose_tx_ring *ring, int ifindex, unsigned char *daddr,
+					  struct goosehdr *goose_h, unsigned char *apdu,
+					  unsigned int apdu_len, unsigned short msg_type);
+int goose_tx_ring_kick(struct goose_tx_ring *ring);
+int goose_tx_ring_complete(struct goose_tx_ring *ring, int *status, unsigned int max);
+
+/* RX ring APIs */
+int goose_rx_ring_open(struct goose_rx_ring *ring);
+int goose_rx_ring_close(struct goose_rx_ring *ring);
+int goose_rx_ring_next(struct goose_rx_ring *ring, struct goose_frame *frame);
+void goose_rx_ring_release(struct goose_rx_ring *ring);
+int goose_rx_ring_wait(struct goose_rx_ring *ring, int timeout);
+
+/* GOOSE APDU encoder APIs */
+int goose_enc_init(struct goose_encoder *enc, const struct goose_dataset *ds);
+int goose_enc_set_bool(struct goose_encoder *enc, unsigned int idx, int val);
+int goose_enc_set_int(struct goose_encoder *enc, unsigned int idx, int val);
+int goose_enc_set_uint(struct goose_encoder *enc, unsigned int idx, unsigned int val);
+int goose_enc_set_float(struct goose_encoder *enc, unsigned int idx, float val);
+int goose_enc_set_bitstring(struct goose_encoder *enc, unsigned int idx, unsigned int bits);
+int goose_enc_set_utctime(struct goose_encoder *enc, unsigned int idx, unsigned long long ns);
+int goose_enc_set_string(struct goose_encoder *enc, unsigned int idx,
+						 const void *val, unsigned int len);
+int goose_enc_change(struct goose_encoder *enc, unsigned long long ns);
+int goose_enc_repeat(struct goose_encoder *enc);
+
+/* GOOSE APDU decoder APIs */
+void goose_dec_init(struct goose_decoder *dec);
+int goose_dec_frame(struct goose_decoder *dec, const unsigned char *apdu, unsigned int len);
+
+/* GOOSE dispatcher APIs */
+int goose_disp_start(struct goose_dispatcher *disp, struct nl_interface *nl_if,
+					 unsigned int num, const int *cpus, int rx_cpu,
+					 goose_frame_cb cb, void *arg);
+int goose_disp_push(struct goose_dispatcher *disp, const struct goose_frame *frame);
+int goose_disp_stop(struct goose_dispatcher *disp);